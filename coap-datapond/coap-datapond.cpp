@@ -34,42 +34,126 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #include "coap-datapond.h"
 #include "WiFiUdp.h"
 #include "coap-protocol.h"
+#include "datapond-format.h"
+
+#if POND_METRICS
+/*	Operation a callback code is counted under	*/
+static uns8 metricOp(uns8 callbackCode) {
+	switch (callbackCode) {
+		case LOGIN_CODE:
+			return METRIC_LOGIN;
+		case CREATE_DROPLET:
+			return METRIC_CREATE;
+		case READ_DROPLET:
+		case READ_STREAM:
+		case READ_SERIES:
+			return METRIC_READ;
+	}
+	return METRIC_OTHER;
+}
+#endif
 
 CoapDatapond::CoapDatapond(const char* ip, int thisport, int remoteport) {
 	pondIPAddress = ip;
 	localPort = thisport;
 	serverPort = remoteport;
+	batchLength = 0;
+	batchCount = 0;
+	pondUsername[0] = '\0';
+	pondPassword[0] = '\0';
+	cookie[0] = '\0';
 }
 
-void CoapDatapond::begin(String user, String pass, uns16 id) {
+/*	Credentials are copied, longer ones than CREDENTIAL_SIZE - 1 are cut short	*/
+void CoapDatapond::begin(const char* user, const char* pass, uns16 id) {
 	CoapProtocol::begin();
 	CoapProtocol::setDestination(pondIPAddress, serverPort);
 	messageID = id;
-	pondUsername = user;
-	pondPassword = pass;
+	pondAppend(pondUsername, 0, CREDENTIAL_SIZE, user);
+	pondAppend(pondPassword, 0, CREDENTIAL_SIZE, pass);
 	//oap(pondIPAddress);
 	//oap(serverPort);	
 	
 	current_token_id = 0x00;
+	lastToken = 0x00;
+	pondRtoInit(&rtoEstimator, millis());
+	for (int i = 0; i < TOKENID_BUFFER_SIZE; i++) {
+		tokenBuffer[i].in_use = false;
+		freeSlots[i] = TOKENID_BUFFER_SIZE - 1 - i;
+	}
+	freeCount = TOKENID_BUFFER_SIZE;
 }
 
-/*	Receives a packet address and extracts the payload from it	*/
-void CoapDatapond::collectPayload() {
-	uns8* payPtr = packet.getPayloadAddr();
-	payload = "";
-	if (payPtr == NULL)
-		return;
-	while (*payPtr != '\0') {
-		payload += (char)*payPtr++;
-	}
+/*	Selects FORMAT_TEXT or FORMAT_CBOR for droplets and reads. An open batch keeps its format	*/
+void CoapDatapond::setContentFormat(uns8 format) {
+	contentFormat = format;
+	if (batchCount == 0)
+		batchFormat = format;
 }
 
-/*	Extracts the cookie from payload	*/
+/*	Points the payload view at the payload of the received message. Nothing is copied	*/
+void CoapDatapond::collectPayload(const uns8* pkt, int pktLen) {
+	const uns8* content = NULL;
+	payloadLength = pondCoapPayload(pkt, pktLen, &content);
+	payloadPtr = (const char*)content;
+}
+
+/*	Extracts the cookie from the login response	*/
 void CoapDatapond::collectCookie() {
-	int cookieStart = payload.indexOf("n\":\"") + 4;
-	int cookieEnd = payload.indexOf("=") + 1;
-	cookie = "session=";
-	cookie += payload.substring(cookieStart, cookieEnd);
+	pond_view session;
+	//A cookie too long to keep would be sent cut short, so it's left out and requests fail as unauthorized
+	if (!pondJsonFind(payloadPtr, payloadLength, "session", &session) || (8 + session.len >= COOKIE_SIZE))
+		return;
+	memcpy(cookie, "session=", 8);
+	memcpy(cookie + 8, session.ptr, session.len);
+	cookieLength = 8 + session.len;
+	cookie[cookieLength] = '\0';
+	sessionCount++;
+	loginBackoff = SESSION_RETRY_MIN;
+}
+
+/*	Forgets a session the server rejected and logs in again, unless a login is already on its way	*/
+void CoapDatapond::expireSession() {
+	cookie[0] = '\0';
+	cookieLength = 0;
+	sessionCount++;
+	loginArmed = true;
+	retryLogin();
+}
+
+/*	Logs in while there is no session. Each login that brings none back doubles the wait for the next.
+	Nothing is sent before the sketch's own login(), so it never goes out twice	*/
+void CoapDatapond::retryLogin() {
+	if (!loginArmed || (cookieLength != 0) || loginInFlight || (pondUsername[0] == '\0'))
+		return;
+	if (millis() - loginTime < loginBackoff)
+		return;
+	if (login() < 0)
+		return;
+	loginBackoff = (2 * loginBackoff < SESSION_RETRY_MAX) ? 2 * loginBackoff : SESSION_RETRY_MAX;
+}
+
+/*	Copies the session out so it can be kept over deep sleep. Returns false without one	*/
+bool CoapDatapond::exportSession(pond_session* session) {
+	if (cookieLength == 0)
+		return false;
+	if (!pondSessionFill(session, pondIPAddress, serverPort, cookie))
+		return false;
+	session->messageID = messageID;
+	session->token = current_token_id;
+	pondSessionSeal(session);
+	return true;
+}
+
+/*	Picks up a saved session. Message IDs and tokens carry on, so the server won't see repeats	*/
+bool CoapDatapond::restoreSession(const pond_session* session) {
+	if (!pondSessionValid(session, pondIPAddress, serverPort))
+		return false;
+	cookieLength = pondAppend(cookie, 0, COOKIE_SIZE, session->cookie);
+	sessionCount++;
+	messageID = session->messageID;
+	current_token_id = (pond_token)session->token;
+	return true;
 }
 
 /*	Processes the coap queue. Takes the callback functions from main program as args	*/
@@ -79,13 +163,47 @@ void CoapDatapond::run() {
 		int index = CoapProtocol::receivePacket();
 	}	
 	CoapProtocol::process_rx_queue();
-	CoapProtocol::process_tx_queue();
+	//One new packet goes out per pass, so the queue is drained of every one waiting. The
+	//first pass runs regardless, it also resends and times out what's already out
+	do {
+		CoapProtocol::process_tx_queue();
+		markSent();
+	} while (txCount > 0);
+	drainLog();
+	refreshObservations();
+	retryLogin();
+	pondRtoAge(&rtoEstimator, millis());
+	deliverCached();
+	for (PondAggregator* agg = aggregators; agg != NULL; agg = agg->next)
+		flushAggregator(agg, millis());
+	
+	if (windowBlocked && readyToSend()) {
+		windowBlocked = false;
+		if (_readyFn != NULL)
+			_readyFn(getCredits());
+	}
 }
 
-/*	Clears both TX and RX queues	*/
+/*	Clears both TX and RX queues. Droplets still in flight are kept in the log, logged batches
+	were never consumed so they go out again with the next drain	*/
 void CoapDatapond::emptyQueue() {
 	CoapProtocol::clearQueue(RX);
 	CoapProtocol::clearQueue(TX);
+	txHead = 0;
+	txCount = 0;
+	
+	for (int i = 0; i < TOKENID_BUFFER_SIZE; i++) {
+		//Observations are kept and register again once they lapse
+		if (!tokenBuffer[i].in_use || tokenBuffer[i].observe)
+			continue;
+		if ((dropletLog != NULL) && tokenBuffer[i].single_droplet)
+			dropletLog->append(tokenBuffer[i].stream_id, tokenBuffer[i].value);
+		completeRequest(i, false, 0);
+		endUpload(i);
+		removeTokenEntry(i);
+	}
+	drainInFlight = false;
+	loginInFlight = false;
 }
 
 
@@ -93,102 +211,1185 @@ void CoapDatapond::emptyQueue() {
 ////			Datapond Transactions			 	////
 ////////////////////////////////////////////////////////
 
-/*	Create login packet and add it to txBuffer. Token_id = 0	*/
-int CoapDatapond::login() {
-	body = "{\"email\":\"soon@along.com\",\"password\":\"blankevent\"}";
+/*	Create login packet and add it to txBuffer	*/
+int CoapDatapond::login(pond_done_fn done, void* context) {
+	int len = pondAppend(body, 0, BODY_BUFFER_SIZE, "{\"email\":\"");
+	len = pondAppend(body, len, BODY_BUFFER_SIZE, pondUsername);
+	len = pondAppend(body, len, BODY_BUFFER_SIZE, "\",\"password\":\"");
+	len = pondAppend(body, len, BODY_BUFFER_SIZE, pondPassword);
+	len = pondAppend(body, len, BODY_BUFFER_SIZE, "\"}");
+	loginArmed = true;
+	
+	int slot = insertTokenEntry(LOGIN_CODE, done, context);
+	if (slot < 0)
+		return TOKEN_TABLE_FULL;
 	
 	packet.begin();
 	packet.addHeader(TYPE_CON, COAP_POST, messageID++);
-	packet.addTokens(TOKENID_LENGTH, &current_token_id);
+	addToken(slot);
 	packet.addOption(OPT_URI_PATH, 4, "user");
 	packet.addOption(OPT_URI_PATH, 5, "login");
-	packet.addPayload(body.length(), body.c_str());
+	packet.addPayload(len, body);
 	
-	insertTokenEntry(LOGIN_CODE);
-	return CoapProtocol::addToTX(packet.getPacket(), packet.getPacketLength());
+	int result = sendRequest(slot);
+	if (result != -1) {
+		loginInFlight = true;
+		loginTime = millis();
+	}
+	return result;
 }
 
 /*	Create new droplet in stream stream_id	*/
-int CoapDatapond::createDroplet(int stream_id, String data) {
-	url = "stream=" + (String)stream_id;
-	body = "value=" + data;
+int CoapDatapond::createDroplet(int stream_id, const String& data, pond_done_fn done, void* context) {
+	return createDroplet(stream_id, data.c_str(), done, context);
+}
+
+/*	Create new droplet in stream stream_id with a text value. Text that reads as a number is also logged as one	*/
+int CoapDatapond::createDroplet(int stream_id, const char* data, pond_done_fn done, void* context) {
+	char* end;
+	double value = strtod(data, &end);
+	//The log keeps numbers only, other text is lost if it can't be sent
+	bool numeric = (end != data) && (*end == '\0');
+	return sendDroplet(stream_id, data, value, numeric, done, context);
+}
 
+/*	Create new droplet in stream stream_id. With a log set, returns DROPLET_STORED when it can't be sent	*/
+int CoapDatapond::createDroplet(int stream_id, double data, pond_done_fn done, void* context) {
+	return sendDroplet(stream_id, NULL, data, true, done, context);
+}
+
+/*	Sends a droplet under the stream's delivery policy. text is sent as is if set, else value is formatted	*/
+int CoapDatapond::sendDroplet(int stream_id, const char* text, double value, bool loggable, pond_done_fn done, void* context) {
+	//Not logged in yet, the server would reject it
+	if (loggable && (dropletLog != NULL) && (cookieLength == 0)) {
+		if (dropletLog->append(stream_id, value))
+			return DROPLET_STORED;
+	}
+	
+	forgetStream(stream_id);
+	//The body is written first so a value that won't fit is rejected rather than sent cut short
+	int len;
+	if (contentFormat == FORMAT_CBOR) {
+		PondCborWriter cbor((uns8*)body, BODY_BUFFER_SIZE);
+		cbor.beginMap(1);
+		cbor.writeText("value");
+		if (loggable)
+			cbor.writeDouble(value);
+		else
+			cbor.writeText(text);
+		if (!cbor.ok())
+			return -1;
+		len = cbor.length();
+	}
+	else {
+		if ((text != NULL) && (strlen(text) + 6 >= BODY_BUFFER_SIZE))
+			return -1;
+		len = pondAppend(body, 0, BODY_BUFFER_SIZE, "value=");
+		if (text != NULL)
+			len = pondAppend(body, len, BODY_BUFFER_SIZE, text);
+		else
+			len += pondFormatDouble(body + len, value, 2);
+	}
+	
+	//A NON droplet has no slot to keep a delegate in
+	pond_delivery* policy = findDelivery(stream_id);
+	bool confirm = (done != NULL) || sendConfirmable(policy);
+	int slot = -1;
+	if (confirm) {
+		slot = insertTokenEntry(CREATE_DROPLET, done, context);
+		if (slot < 0) {
+			if (loggable && (dropletLog != NULL) && dropletLog->append(stream_id, value))
+				return DROPLET_STORED;
+			return TOKEN_TABLE_FULL;
+		}
+		tokenBuffer[slot].single_droplet = loggable;
+		tokenBuffer[slot].stream_id = stream_id;
+		tokenBuffer[slot].value = value;
+		tokenBuffer[slot].probe = (policy != NULL);
+	}
+	
 	packet.begin();
-	packet.addHeader(TYPE_CON, COAP_POST, messageID++);
-	packet.addTokens(TOKENID_LENGTH, &current_token_id);
+	if (confirm) {
+		packet.addHeader(TYPE_CON, COAP_POST, messageID++);
+		addToken(slot);
+	}
+	else {
+		uns8 tkn[TOKENID_LENGTH];
+		writeNonToken(tkn);
+		POND_METRIC(request(METRIC_CREATE));
+		packet.addHeader(TYPE_NON, COAP_POST, messageID++);
+		packet.addTokens(TOKENID_LENGTH, tkn);
+	}
 	packet.addOption(OPT_URI_PATH, 7, "droplet");
-	packet.addOption(OPT_URI_QUERY, url.length(), url.c_str());
-	packet.addOption(OPT_URI_QUERY, body.length(), body.c_str());
-	packet.addOption(OPT_URI_QUERY, cookie.length(), cookie.c_str());
+	if (contentFormat == FORMAT_CBOR) {
+		addContentFormat();
+		addStreamQuery(stream_id);
+		packet.addOption(OPT_URI_QUERY, cookieLength, cookie);
+		packet.addPayload(len, body);
+	}
+	else {
+		addStreamQuery(stream_id);
+		packet.addOption(OPT_URI_QUERY, len, body);
+		packet.addOption(OPT_URI_QUERY, cookieLength, cookie);
+	}
+
+	int result;
+	if (confirm)
+		result = sendRequest(slot);
+	else
+		result = transmit(packet.getPacket(), packet.getPacketLength(), -1);
+	if ((result == -1) && loggable && (dropletLog != NULL)) {
+		if (dropletLog->append(stream_id, value))
+			return DROPLET_STORED;
+	}
+	return result;
+}
+
+/*	Get last created droplet in stream_id	*/
+int CoapDatapond::getLastDroplet(int stream_id, pond_done_fn done, void* context) {
+	return readResource(RESOURCE_LAST_DROPLET, READ_DROPLET, stream_id, done, context);
+}
+
+/*	Get stats of the day from stream stream_id	*/
+int CoapDatapond::getStatsToday(int stream_id, pond_done_fn done, void* context) {
+	return readResource(RESOURCE_STATS_TODAY, READ_STREAM, stream_id, done, context);
+}
+
+int CoapDatapond::getStream(int stream_id, pond_done_fn done, void* context) {
+	return readResource(RESOURCE_STREAM, READ_STREAM, stream_id, done, context);
+}
+
+/*	Reads the packed series of stream_id. The samples go to the read series handler	*/
+int CoapDatapond::getSeries(int stream_id, pond_done_fn done, void* context) {
+	return readResource(RESOURCE_SERIES, READ_SERIES, stream_id, done, context);
+}
+
+/*	Queues a read of resource. Responses too big for one block come back through the block handler	*/
+int CoapDatapond::readResource(uns8 resource, uns8 callbackCode, int stream_id, pond_done_fn done, void* context) {
+	int slot = insertTokenEntry(callbackCode, done, context);
+	if (slot < 0)
+		return TOKEN_TABLE_FULL;
+	tokenBuffer[slot].resource = resource;
+	tokenBuffer[slot].stream_id = stream_id;
 	
-	insertTokenEntry(CREATE_DROPLET);
-	return CoapProtocol::addToTX(packet.getPacket(), packet.getPacketLength());
+	if (cache != NULL) {
+		tokenBuffer[slot].cached = true;
+		tokenBuffer[slot].accept = contentFormat;
+		//Fresh entries are handed over by run(), so the handler still runs after the token is known
+		pond_cache_entry* entry = cachedEntry(slot);
+		if ((entry != NULL) && cache->isFresh(entry, millis())) {
+			tokenBuffer[slot].from_cache = true;
+			cachedCount++;
+			return 0;
+		}
+	}
+	
+	buildRead(slot);
+	return sendRequest(slot);
 }
 
-/*	Create new droplet in stream stream_id	*/
-int CoapDatapond::createDroplet(int stream_id, double data) {
-	url = "stream=" + (String)stream_id;
-	body = "value=" + (String)data;
+/*	Builds the GET for the slot's resource. Block2 asks for the slot's next block at our block size	*/
+void CoapDatapond::buildRead(int slot) {
+	uns8 block[3];
+	int len;
+	
+	packet.begin();
+	packet.addHeader(TYPE_CON, COAP_GET, messageID++);
+	addToken(slot);
+	//A stale entry is revalidated, an unchanged resource comes back as a header-only 2.03
+	pond_cache_entry* entry = cachedEntry(slot);
+	if ((entry != NULL) && (entry->etagLength > 0) && (tokenBuffer[slot].block_num == 0))
+		packet.addOption(OPT_ETAG, entry->etagLength, (const char*)entry->etag);
+	switch (tokenBuffer[slot].resource) {
+		case RESOURCE_LAST_DROPLET:
+			packet.addOption(OPT_URI_PATH, 7, "droplet");
+			packet.addOption(OPT_URI_PATH, 4, "last");
+			addStreamQuery(tokenBuffer[slot].stream_id);
+			break;
+		case RESOURCE_STATS_TODAY:
+			len = pondFormatInt(url, tokenBuffer[slot].stream_id);
+			packet.addOption(OPT_URI_PATH, 6, "stream");
+			packet.addOption(OPT_URI_PATH, 5, "stats");
+			packet.addOption(OPT_URI_PATH, 5, "today");
+			packet.addOption(OPT_URI_PATH, len, url);
+			break;
+		case RESOURCE_STREAM:
+			len = pondFormatInt(url, tokenBuffer[slot].stream_id);
+			packet.addOption(OPT_URI_PATH, 6, "stream");
+			packet.addOption(OPT_URI_PATH, len, url);
+			break;
+		case RESOURCE_SERIES:
+			packet.addOption(OPT_URI_PATH, 7, "droplet");
+			packet.addOption(OPT_URI_PATH, 6, "series");
+			addStreamQuery(tokenBuffer[slot].stream_id);
+			break;
+	}
+	packet.addOption(OPT_URI_QUERY, cookieLength, cookie);
+	if (tokenBuffer[slot].resource == RESOURCE_SERIES) {
+		const char format = FORMAT_OCTET;
+		packet.addOption(OPT_ACCEPT, 1, &format);
+	}
+	else {
+		addAccept();
+	}
+	len = pondCoapBlockOption(block, tokenBuffer[slot].block_num, false, tokenBuffer[slot].block_szx);
+	packet.addOption(OPT_BLOCK2, len, (const char*)block);
+}
 
+
+////////////////////////////////////////////////////////
+////			Aggregation						 	////
+////////////////////////////////////////////////////////
+
+/*	Adds agg to the aggregators run() closes windows on. It must stay valid	*/
+void CoapDatapond::addAggregator(PondAggregator* agg) {
+	for (PondAggregator* a = aggregators; a != NULL; a = a->next) {
+		if (a == agg)
+			return;
+	}
+	agg->next = aggregators;
+	aggregators = agg;
+}
+
+/*	Adds a sample, sending the summary first if its window has closed	*/
+void CoapDatapond::sample(PondAggregator* agg, double value) {
+	uns32 now = millis();
+	flushAggregator(agg, now);
+	agg->add(value, now);
+}
+
+/*	Sends one droplet per summary field that has a stream	*/
+void CoapDatapond::flushAggregator(PondAggregator* agg, uns32 now) {
+	pond_reading summary;
+	if (!agg->poll(now, &summary))
+		return;
+	for (int i = 0; i < AGG_FIELDS; i++) {
+		double value;
+		int stream_id = agg->output(i, &summary, &value);
+		if (stream_id != 0)
+			createDroplet(stream_id, value);
+	}
+}
+
+
+////////////////////////////////////////////////////////
+////			Read Cache						 	////
+////////////////////////////////////////////////////////
+
+/*	Caches reads in responseCache, NULL turns caching off	*/
+void CoapDatapond::setCache(PondCache* responseCache) {
+	cache = responseCache;
+}
+
+/*	Returns the cache entry of the slot's read, NULL if there isn't one	*/
+pond_cache_entry* CoapDatapond::cachedEntry(int slot) {
+	uns8 request[READ_REQUEST_SIZE];
+	if ((cache == NULL) || !tokenBuffer[slot].cached)
+		return NULL;
+	return cache->find(request, cacheRequest(slot, request));
+}
+
+/*	Writes what the slot's read is cached under into request. Returns its length	*/
+uns8 CoapDatapond::cacheRequest(int slot, uns8* request) {
+	request[0] = tokenBuffer[slot].resource;
+	memcpy(request + 1, &tokenBuffer[slot].stream_id, sizeof(int));
+	request[1 + sizeof(int)] = tokenBuffer[slot].accept;
+	return 2 + sizeof(int);
+}
+
+/*	Drops the cached reads a write to stream_id makes stale, in every format they were read in	*/
+void CoapDatapond::forgetStream(int stream_id) {
+	static const uns8 written[] = {RESOURCE_LAST_DROPLET, RESOURCE_STATS_TODAY, RESOURCE_SERIES};
+	uns8 request[READ_REQUEST_SIZE];
+	if (cache == NULL)
+		return;
+	memcpy(request + 1, &stream_id, sizeof(int));
+	for (uns8 i = 0; i < sizeof(written); i++) {
+		request[0] = written[i];
+		cache->invalidatePrefix(request, 1 + sizeof(int));
+	}
+}
+
+/*	Answers reads that found a fresh entry. One evicted since is sent to the server after all	*/
+void CoapDatapond::deliverCached() {
+	for (int i = 0; (i < TOKENID_BUFFER_SIZE) && (cachedCount > 0); i++) {
+		if (!tokenBuffer[i].in_use || !tokenBuffer[i].from_cache)
+			continue;
+		tokenBuffer[i].from_cache = false;
+		cachedCount--;
+		
+		pond_cache_entry* entry = cachedEntry(i);
+		if (entry == NULL) {
+			buildRead(i);
+			if (transmit(packet.getPacket(), packet.getPacketLength(), i) == -1)
+				failExchange(i);
+			continue;
+		}
+		cache->hit(entry, millis());
+		payloadPtr = entry->body;
+		payloadLength = entry->bodyLength;
+		deliverResponse(i, true, entry->format, CODE_CONTENT);
+		removeTokenEntry(i);
+	}
+}
+
+
+////////////////////////////////////////////////////////
+////			Packed Series					 	////
+////////////////////////////////////////////////////////
+
+/*	Adds a sample, sending the series once it's full. Returns the send's result, 0 while collecting	*/
+int CoapDatapond::sample(PondSeries* series, uns32 timestamp, double value) {
+	int result = 0;
+	if (!series->writer.append(timestamp, value)) {
+		result = sendSeries(series);
+		//Still full when it couldn't be sent, so the sample is lost
+		if (!series->writer.append(timestamp, value))
+			return result;
+	}
+	if (series->writer.count() >= series->limit)
+		result = sendSeries(series);
+	return result;
+}
+
+/*	Sends the samples collected so far as one droplet. They are kept if it can't be queued	*/
+int CoapDatapond::sendSeries(PondSeries* series) {
+	const char format = FORMAT_OCTET;
+	if (series->writer.count() == 0)
+		return 0;
+	forgetStream(series->stream_id);
+	int slot = insertTokenEntry(CREATE_DROPLET);
+	if (slot < 0)
+		return TOKEN_TABLE_FULL;
+	
 	packet.begin();
 	packet.addHeader(TYPE_CON, COAP_POST, messageID++);
-	packet.addTokens(TOKENID_LENGTH, &current_token_id);
+	addToken(slot);
 	packet.addOption(OPT_URI_PATH, 7, "droplet");
-	packet.addOption(OPT_URI_QUERY, url.length(), url.c_str());
-	packet.addOption(OPT_URI_QUERY, body.length(), body.c_str());
-	packet.addOption(OPT_URI_QUERY, cookie.length(), cookie.c_str());
+	packet.addOption(OPT_URI_PATH, 6, "series");
+	packet.addOption(OPT_CONTENT_FORMAT, 1, &format);
+	addStreamQuery(series->stream_id);
+	packet.addOption(OPT_URI_QUERY, cookieLength, cookie);
+	packet.addPayload(series->writer.length(), (const char*)series->buffer);
+	
+	int result = sendRequest(slot);
+	if (result != -1)
+		series->writer.clear();
+	return result;
+}
 
-	insertTokenEntry(CREATE_DROPLET);
-	return CoapProtocol::addToTX(packet.getPacket(), packet.getPacketLength());	
+
+////////////////////////////////////////////////////////
+////			Transaction Window				 	////
+////////////////////////////////////////////////////////
+
+/*	Sets how many exchanges may be outstanding, 1 to TOKENID_BUFFER_SIZE	*/
+void CoapDatapond::setWindow(uns16 size) {
+	if (size < 1)
+		size = 1;
+	if (size > TOKENID_BUFFER_SIZE)
+		size = TOKENID_BUFFER_SIZE;
+	window = size;
 }
 
-/*	Get last created droplet in stream_id	*/
-int CoapDatapond::getLastDroplet(int stream_id) {
-	url = "stream=" + (String)stream_id;
+/*	Returns how many more requests can go out before the window is full	*/
+int CoapDatapond::getCredits() {
+	int outstanding = TOKENID_BUFFER_SIZE - freeCount - observeCount;
+	int credits = window - outstanding;
+	//Observations hold slots too
+	if (credits > freeCount)
+		credits = freeCount;
+	return (credits > 0) ? credits : 0;
+}
+
+bool CoapDatapond::readyToSend() {
+	return getCredits() > 0;
+}
+
+
+////////////////////////////////////////////////////////
+////			Delivery Policies				 	////
+////////////////////////////////////////////////////////
+
+/*	Sets how createDroplet sends to stream_id. Returns false if every policy is taken	*/
+bool CoapDatapond::setDeliveryPolicy(int stream_id, uns8 mode, uns8 probeInterval) {
+	pond_delivery* policy = findDelivery(stream_id);
+	if (policy == NULL) {
+		if (mode == DELIVERY_CON)
+			return true;
+		if (deliveryCount == DELIVERY_POLICY_SIZE)
+			return false;
+		policy = &delivery[deliveryCount++];
+		memset(policy, 0, sizeof(pond_delivery));
+		policy->stream_id = stream_id;
+		policy->probe_time = millis();
+	}
+	else if (mode == DELIVERY_CON) {
+		//Confirmable is the default, so the entry goes
+		*policy = delivery[--deliveryCount];
+		return true;
+	}
+	policy->mode = mode;
+	policy->probe_interval = probeInterval;
+	return true;
+}
+
+const pond_delivery* CoapDatapond::getDelivery(int stream_id) {
+	return findDelivery(stream_id);
+}
+
+/*	Returns the share of probes acknowledged on stream_id, 1 before any have been settled	*/
+float CoapDatapond::getDeliveryRatio(int stream_id) {
+	pond_delivery* policy = findDelivery(stream_id);
+	if ((policy == NULL) || (policy->probes == 0))
+		return 1.0;
+	return (float)policy->probes_acked / policy->probes;
+}
+
+pond_delivery* CoapDatapond::findDelivery(int stream_id) {
+	for (int i = 0; i < deliveryCount; i++) {
+		if (delivery[i].stream_id == stream_id)
+			return &delivery[i];
+	}
+	return NULL;
+}
+
+/*	Decides whether the next droplet under policy is confirmable. Without a policy they all are	*/
+bool CoapDatapond::sendConfirmable(pond_delivery* policy) {
+	if ((policy == NULL) || (policy->mode == DELIVERY_CON))
+		return true;
+	
+	unsigned long now = millis();
+	if (policy->probe_interval != 0) {
+		policy->since_probe++;
+		if ((policy->since_probe >= policy->probe_interval) || ((now - policy->probe_time) > PROBE_PERIOD)) {
+			//Probes fall back to NON when the window is full
+			if (readyToSend()) {
+				policy->since_probe = 0;
+				policy->probe_time = now;
+				return true;
+			}
+		}
+	}
+	policy->sent++;
+	return false;
+}
+
+/*	Writes a token no slot will be holding, so a response to a NON droplet is dropped	*/
+void CoapDatapond::writeNonToken(uns8* dst) {
+	pond_token value = (current_token_id++ * TOKENID_BUFFER_SIZE) & TOKENID_MASK;
+	for (int i = TOKENID_LENGTH - 1; i >= 0; i--) {
+		dst[i] = value & 0xFF;
+		value >>= 8;
+	}
+}
+
+/*	Counts a probe as delivered or lost	*/
+void CoapDatapond::settleProbe(int slot, bool status) {
+	pond_delivery* policy = findDelivery(tokenBuffer[slot].stream_id);
+	tokenBuffer[slot].probe = false;
+	if (policy == NULL)
+		return;
+	policy->probes++;
+	if (status)
+		policy->probes_acked++;
+}
+
+
+////////////////////////////////////////////////////////
+////			Timeout Estimation				 	////
+////////////////////////////////////////////////////////
+
+/*	Notes the send time of the oldest queued packet. The protocol sends one per pass, in queue order	*/
+void CoapDatapond::markSent() {
+	if (txCount == 0)
+		return;
+	pond_tx_pending sent = txPending[txHead];
+	txHead = (txHead + 1) % TX_PENDING_SIZE;
+	txCount--;
+	//The slot may have been released and taken by another request since
+	if ((sent.slot < 0) || !tokenBuffer[sent.slot].in_use || (tokenBuffer[sent.slot].token_id != sent.token))
+		return;
+	if (tokenBuffer[sent.slot].timing == TIMING_QUEUED) {
+		tokenBuffer[sent.slot].timing = TIMING_SENT;
+		tokenBuffer[sent.slot].sent_time = millis();
+	}
+}
+
+/*	Times the request an empty ACK acknowledges. Its response comes separately	*/
+void CoapDatapond::sampleAck(uns16 messageID) {
+	for (int i = 0; i < TOKENID_BUFFER_SIZE; i++) {
+		if (!tokenBuffer[i].in_use || (tokenBuffer[i].timing != TIMING_SENT) || (tokenBuffer[i].message_id != messageID))
+			continue;
+		sampleRtt(i);
+		tokenBuffer[i].timing = TIMING_ACKED;
+		return;
+	}
+}
+
+/*	Feeds the round trip to the slot's ACK to the estimator. An ACK that may answer a resend is a weak sample	*/
+void CoapDatapond::sampleRtt(int slot) {
+	unsigned long now = millis();
+	uns32 rtt = now - tokenBuffer[slot].sent_time;
+	uns8 retransmits = pondCoapRetransmissions(rtt);
+	pondRtoSample(&rtoEstimator, rtt, retransmits > 0, now);
+	exchangeRetransmits += retransmits;
+	if (retransmits > 0)
+		POND_METRIC(retransmit(retransmits));
+}
+
+/*	Records the latency of a response. A piggybacked one also times the request	*/
+void CoapDatapond::sampleExchange(int slot, bool piggybacked) {
+	uns8 timing = tokenBuffer[slot].timing;
+	if ((timing != TIMING_SENT) && (timing != TIMING_ACKED))
+		return;
+	if (piggybacked && (timing == TIMING_SENT))
+		sampleRtt(slot);
+	POND_METRIC(latency(metricOp(tokenBuffer[slot].callback_code), millis() - tokenBuffer[slot].sent_time));
+	//Further notifications on the token aren't round trips
+	tokenBuffer[slot].timing = TIMING_NONE;
+}
+
+/*	Releases a slot whose request got no answer. Droplets go back to the log	*/
+void CoapDatapond::failExchange(int slot) {
+	//Observations stay registered and are retried once they lapse
+	if (tokenBuffer[slot].observe)
+		return;
+	POND_METRIC(failure(metricOp(tokenBuffer[slot].callback_code)));
+	abortBlocks(slot);
+	if (tokenBuffer[slot].callback_code == CREATE_DROPLET)
+		settleDroplet(slot, false, 0);
+	if (tokenBuffer[slot].callback_code == LOGIN_CODE)
+		loginInFlight = false;
+	completeRequest(slot, false, 0);
+	endUpload(slot);
+	removeTokenEntry(slot);
+}
+
+const pond_rto* CoapDatapond::getRtoEstimator() {
+	return &rtoEstimator;
+}
+
+/*	Returns how many exchanges failed for want of a response	*/
+uns32 CoapDatapond::getExchangeTimeouts() {
+	return exchangeTimeouts;
+}
+
+/*	Returns how many resends the protocol made for acknowledged or failed requests	*/
+uns32 CoapDatapond::getRetransmissions() {
+	return exchangeRetransmits;
+}
+
+#if POND_METRICS
+PondMetrics* CoapDatapond::getMetrics() {
+	return &metrics;
+}
+
+/*	Posts the metrics summary as a text droplet in stream_id	*/
+int CoapDatapond::sendMetrics(int stream_id) {
+	char text[METRICS_SUMMARY_SIZE];
+	metrics.summary(text, sizeof(text));
+	return createDroplet(stream_id, text);
+}
+#endif
+
+
+////////////////////////////////////////////////////////
+////			Observed Streams				 	////
+////////////////////////////////////////////////////////
+
+/*	Registers for the last droplet of stream_id. Notifications go to the read handlers	*/
+int CoapDatapond::observeStream(int stream_id) {
+	int slot = insertTokenEntry(READ_DROPLET);
+	if (slot < 0)
+		return TOKEN_TABLE_FULL;
+	tokenBuffer[slot].stream_id = stream_id;
+	tokenBuffer[slot].observe = true;
+	observeCount++;
+	
+	int result = sendObserve(slot, false);
+	if (result == -1) {
+		tokenBuffer[slot].observe = false;
+		observeCount--;
+		removeTokenEntry(slot);
+	}
+	return result;
+}
+
+/*	Deregisters the observation started with tkn. Its response is delivered as a normal read	*/
+int CoapDatapond::cancelObserve(pond_token tkn) {
+	int slot = tkn & (TOKENID_BUFFER_SIZE - 1);
+	if (!tokenBuffer[slot].in_use || (tokenBuffer[slot].token_id != tkn) || !tokenBuffer[slot].observe)
+		return -1;
+	tokenBuffer[slot].observe = false;
+	observeCount--;
+	
+	//Without the slot, the next notification is rejected and that ends it on the server
+	int result = sendObserve(slot, true);
+	if (result == -1)
+		removeTokenEntry(slot);
+	return result;
+}
+
+/*	Sends the GET that registers or deregisters the slot's observation, on the slot's token	*/
+int CoapDatapond::sendObserve(int slot, bool deregister) {
+	const char deregisterValue = 1;
 	
 	packet.begin();
 	packet.addHeader(TYPE_CON, COAP_GET, messageID++);
-	packet.addTokens(TOKENID_LENGTH, &current_token_id);
+	addToken(slot);
+	if (deregister)
+		packet.addOption(OPT_OBSERVE, 1, &deregisterValue);
+	else
+		packet.addOption(OPT_OBSERVE, 0, "");
 	packet.addOption(OPT_URI_PATH, 7, "droplet");
 	packet.addOption(OPT_URI_PATH, 4, "last");
-	packet.addOption(OPT_URI_QUERY, url.length(), url.c_str());
-	packet.addOption(OPT_URI_QUERY, cookie.length(), cookie.c_str());
+	addStreamQuery(tokenBuffer[slot].stream_id);
+	packet.addOption(OPT_URI_QUERY, cookieLength, cookie);
+	addAccept();
 	
-	insertTokenEntry(READ_DROPLET);
-	return CoapProtocol::addToTX(packet.getPacket(), packet.getPacketLength());
+	//A new registration may restart the server's sequence numbers
+	tokenBuffer[slot].observe_seen = false;
+	tokenBuffer[slot].observe_time = millis();
+	tokenBuffer[slot].max_age = OBSERVE_MAX_AGE;
+	return transmit(packet.getPacket(), packet.getPacketLength(), slot);
+}
+
+/*	Drops notifications older than the last one delivered, and notes when the next is due	*/
+bool CoapDatapond::acceptNotification(int slot, uns32 seq, const uns8* pkt, int pktLen) {
+	const uns8* option;
+	uns16 optionLength;
+	unsigned long now = millis();
 	
+	if (tokenBuffer[slot].observe_seen &&
+		!pondCoapObserveFresh(tokenBuffer[slot].observe_seq, tokenBuffer[slot].observe_time, seq, now))
+		return false;
+	
+	tokenBuffer[slot].observe_seen = true;
+	tokenBuffer[slot].observe_seq = seq;
+	tokenBuffer[slot].observe_time = now;
+	if (pondCoapFindOption(pkt, pktLen, OPT_MAX_AGE, &option, &optionLength))
+		tokenBuffer[slot].max_age = pondCoapUint(option, optionLength);
+	else
+		tokenBuffer[slot].max_age = OBSERVE_MAX_AGE;
+	return true;
 }
 
-/*	Get stats of the day from stream stream_id	*/
-int CoapDatapond::getStatsToday(int stream_id) {
-	url = (String)stream_id;
+/*	Registers again any observation that has gone quiet past its Max-Age	*/
+void CoapDatapond::refreshObservations() {
+	if (observeCount == 0)
+		return;
+	unsigned long now = millis();
+	for (int i = 0; i < TOKENID_BUFFER_SIZE; i++) {
+		if (!tokenBuffer[i].in_use || !tokenBuffer[i].observe)
+			continue;
+		if ((now - tokenBuffer[i].observe_time) > (tokenBuffer[i].max_age * 1000UL + OBSERVE_GRACE))
+			sendObserve(i, false);
+	}
+}
+
+/*	Adds the stream=N query option, formatted in place	*/
+void CoapDatapond::addStreamQuery(int stream_id) {
+	int len = pondAppend(url, 0, URL_BUFFER_SIZE, "stream=");
+	len += pondFormatInt(url + len, stream_id);
+	packet.addOption(OPT_URI_QUERY, len, url);
+}
+
+/*	Marks the payload as CBOR	*/
+void CoapDatapond::addContentFormat() {
+	const char format = FORMAT_CBOR;
+	packet.addOption(OPT_CONTENT_FORMAT, 1, &format);
+}
+
+/*	Asks for a CBOR response when CBOR is selected	*/
+void CoapDatapond::addAccept() {
+	const char format = FORMAT_CBOR;
+	if (contentFormat == FORMAT_CBOR)
+		packet.addOption(OPT_ACCEPT, 1, &format);
+}
+
+/*	Queues the packet built for slot. The slot is released if the TX queue is full	*/
+int CoapDatapond::sendRequest(int slot) {
+	int result = transmit(packet.getPacket(), packet.getPacketLength(), slot);
+	if (result == -1)
+		removeTokenEntry(slot);
+	return result;
+}
+
+/*	Hands a packet to the protocol's TX queue, counting it on the way. slot is the request
+	it belongs to, timed from when run() sees it go out, or -1	*/
+int CoapDatapond::transmit(uns8* buf, int len, int slot) {
+	//Every queued packet is followed until it's sent, a full list would lose track of the order
+	if (txCount == TX_PENDING_SIZE)
+		return -1;
+	int result = CoapProtocol::addToTX(buf, len);
+	if (result == -1)
+		return -1;
 	
-	packet.begin();
-	packet.addHeader(TYPE_CON, COAP_GET, messageID++);
-	packet.addTokens(TOKENID_LENGTH, &current_token_id);
-	packet.addOption(OPT_URI_PATH, 6, "stream");
-	packet.addOption(OPT_URI_PATH, 5, "stats");
-	packet.addOption(OPT_URI_PATH, 5, "today");
-	packet.addOption(OPT_URI_PATH, url.length(), url.c_str());
-	packet.addOption(OPT_URI_QUERY, cookie.length(), cookie.c_str());
+	pond_tx_pending* pending = &txPending[(txHead + txCount++) % TX_PENDING_SIZE];
+	pending->slot = slot;
+	pending->token = 0;
+	if (slot >= 0) {
+		pending->token = tokenBuffer[slot].token_id;
+		tokenBuffer[slot].timing = TIMING_QUEUED;
+		tokenBuffer[slot].message_id = (buf[2] << 8) | buf[3];
+	}
+	POND_METRIC(sent(len));
+	POND_METRIC(queue(txCount));
+	return result;
+}
+
+
+////////////////////////////////////////////////////////
+////			Prepared Requests				 	////
+////////////////////////////////////////////////////////
+
+/*	Prepares a createDroplet request for stream_id	*/
+bool CoapDatapond::prepareDroplet(CoapPreparedRequest* prep, int stream_id) {
+	prep->stream_id = stream_id;
+	prep->callback_code = CREATE_DROPLET;
+	return buildPrepared(prep);
+}
+
+/*	Prepares a getLastDroplet request for stream_id	*/
+bool CoapDatapond::prepareLastDroplet(CoapPreparedRequest* prep, int stream_id) {
+	prep->stream_id = stream_id;
+	prep->callback_code = READ_DROPLET;
+	return buildPrepared(prep);
+}
+
+/*	Encodes everything but the message ID, token and value into the template	*/
+bool CoapDatapond::buildPrepared(CoapPreparedRequest* prep) {
+	uns8 tkn[TOKENID_LENGTH];
+	uns8* buf = prep->buffer;
+	bool create = (prep->callback_code == CREATE_DROPLET);
+	bool cbor = (contentFormat == FORMAT_CBOR);
+	const uns8 format = FORMAT_CBOR;
+	
+	int queryLength = pondAppend(url, 0, URL_BUFFER_SIZE, "stream=");
+	queryLength += pondFormatInt(url + queryLength, prep->stream_id);
+	
+	int size = COAP_HEADER_SIZE + TOKENID_LENGTH;
+	size += pondCoapOptionSize(OPT_URI_PATH, 7);
+	if (!create)
+		size += pondCoapOptionSize(0, 4);
+	size += pondCoapOptionSize(OPT_URI_QUERY - OPT_URI_PATH, queryLength);
+	size += pondCoapOptionSize(0, cookieLength);
+	if (cbor)
+		size += pondCoapOptionSize(0, 1);
+	if (create)
+		size += pondCoapOptionSize(0, 6 + POND_NUMBER_SIZE);
+	prep->ready = (size <= PREPARED_BUFFER_SIZE);
+	if (!prep->ready)
+		return false;
+	
+	memset(tkn, 0, TOKENID_LENGTH);
+	int len = pondCoapHeader(buf, TYPE_CON, create ? COAP_POST : COAP_GET, 0, tkn, TOKENID_LENGTH);
+	len += pondCoapOption(buf + len, OPT_URI_PATH, 7, "droplet");
+	if (!create)
+		len += pondCoapOption(buf + len, 0, 4, "last");
+	if (create && cbor) {
+		len += pondCoapOption(buf + len, OPT_CONTENT_FORMAT - OPT_URI_PATH, 1, &format);
+		len += pondCoapOption(buf + len, OPT_URI_QUERY - OPT_CONTENT_FORMAT, queryLength, url);
+	}
+	else {
+		len += pondCoapOption(buf + len, OPT_URI_QUERY - OPT_URI_PATH, queryLength, url);
+	}
+	len += pondCoapOption(buf + len, 0, cookieLength, cookie);
+	if (!create && cbor)
+		len += pondCoapOption(buf + len, OPT_ACCEPT - OPT_URI_QUERY, 1, &format);
+	
+	prep->templateLength = len;
+	prep->session = sessionCount;
+	prep->format = contentFormat;
+	return true;
+}
+
+/*	Sends a prepared createDroplet. Returns like createDroplet(int, double)	*/
+int CoapDatapond::sendPrepared(CoapPreparedRequest* prep, double data, pond_done_fn done, void* context) {
+	char value[6 + POND_NUMBER_SIZE] = "value=";
+	uns8* buf = prep->buffer;
+	
+	//Not logged in yet, the server would reject it
+	if ((dropletLog != NULL) && (cookieLength == 0)) {
+		if (dropletLog->append(prep->stream_id, data))
+			return DROPLET_STORED;
+	}
+	forgetStream(prep->stream_id);
+	//Session or format changed since the template was built
+	if (!prep->ready || (prep->session != sessionCount) || (prep->format != contentFormat)) {
+		if (!buildPrepared(prep))
+			return -1;
+	}
+	
+	pond_delivery* policy = findDelivery(prep->stream_id);
+	bool confirm = (done != NULL) || sendConfirmable(policy);
+	int slot = -1;
+	if (confirm) {
+		slot = insertTokenEntry(CREATE_DROPLET, done, context);
+		if (slot < 0) {
+			if ((dropletLog != NULL) && dropletLog->append(prep->stream_id, data))
+				return DROPLET_STORED;
+			return TOKEN_TABLE_FULL;
+		}
+		tokenBuffer[slot].single_droplet = true;
+		tokenBuffer[slot].stream_id = prep->stream_id;
+		tokenBuffer[slot].value = data;
+		tokenBuffer[slot].probe = (policy != NULL);
+		writeToken(buf + COAP_HEADER_SIZE, slot);
+	}
+	else {
+		writeNonToken(buf + COAP_HEADER_SIZE);
+		POND_METRIC(request(METRIC_CREATE));
+	}
+	pondCoapType(buf, confirm ? TYPE_CON : TYPE_NON);
+	pondCoapMessageID(buf, messageID++);
+	int len = prep->templateLength;
+	if (prep->format == FORMAT_CBOR) {
+		buf[len++] = COAP_PAYLOAD_MARKER;
+		PondCborWriter cbor(buf + len, PREPARED_BUFFER_SIZE - len);
+		cbor.beginMap(1);
+		cbor.writeText("value");
+		cbor.writeDouble(data);
+		if (!cbor.ok()) {
+			if (slot >= 0)
+				removeTokenEntry(slot);
+			return -1;
+		}
+		len += cbor.length();
+	}
+	else {
+		//The value query follows the cookie query, so its delta is 0
+		int valueLength = 6 + pondFormatDouble(value + 6, data, 2);
+		len += pondCoapOption(buf + len, 0, valueLength, value);
+	}
+	
+	int result = transmit(buf, len, slot);
+	if (result == -1) {
+		if (slot >= 0)
+			removeTokenEntry(slot);
+		if ((dropletLog != NULL) && dropletLog->append(prep->stream_id, data))
+			return DROPLET_STORED;
+	}
+	return result;
+}
+
+/*	Sends a prepared read request	*/
+int CoapDatapond::sendPrepared(CoapPreparedRequest* prep, pond_done_fn done, void* context) {
+	uns8* buf = prep->buffer;
+	
+	if (!prep->ready || (prep->session != sessionCount) || (prep->format != contentFormat)) {
+		if (!buildPrepared(prep))
+			return -1;
+	}
+	
+	int slot = insertTokenEntry(prep->callback_code, done, context);
+	if (slot < 0)
+		return TOKEN_TABLE_FULL;
+	
+	pondCoapMessageID(buf, messageID++);
+	writeToken(buf + COAP_HEADER_SIZE, slot);
+	
+	int result = transmit(buf, prep->templateLength, slot);
+	if (result == -1)
+		removeTokenEntry(slot);
+	return result;
+}
+
+
+////////////////////////////////////////////////////////
+////			Batch Transactions				 	////
+////////////////////////////////////////////////////////
+
+/*	Starts a new batch, discarding droplets that were not committed	*/
+void CoapDatapond::beginBatch() {
+	batchLength = 0;
+	batchCount = 0;
+	batchFormat = contentFormat;
+}
+
+/*	Appends a droplet to the batch. The pending batch is sent first if the droplet won't fit	*/
+int CoapDatapond::addDroplet(int stream_id, double data) {
+	char entry[BATCH_ENTRY_SIZE];
+	int result = 1;
 	
-	insertTokenEntry(READ_STREAM);
-	return CoapProtocol::addToTX(packet.getPacket(), packet.getPacketLength());
+	if ((dropletLog != NULL) && (batchCount == 0))
+		return dropletLog->append(stream_id, data) ? 1 : -1;
+	int len = formatBatchEntry(entry, stream_id, data, 0);
+	//Room is needed for the separator and the closing bracket
+	if ((batchCount > 0) && (batchLength + len + 2 > BATCH_PAYLOAD_SIZE)) {
+		result = sendBatch(0, 0);
+		//TX queue or token table is full, keep the batch so the caller can retry
+		if (result < 0)
+			return result;
+	}
+	pushBatchEntry(entry, len);
+	return result;
+}
+
+/*	Sends whatever is left in the batch, or the oldest logged droplets. Returns 0 if there is nothing to send	*/
+int CoapDatapond::commitBatch(pond_done_fn done, void* context) {
+	if ((dropletLog != NULL) && (batchCount == 0))
+		return sendLogged(done, context);
+	return sendBatch(0, 0, done, context);
+}
+
+/*	Writes a single batch entry. A zero timestamp is left for the server to fill in	*/
+int CoapDatapond::formatBatchEntry(char* entry, int stream_id, double data, uint32_t timestamp) {
+	forgetStream(stream_id);
+	if (batchFormat == FORMAT_CBOR) {
+		PondCborWriter cbor((uns8*)entry, BATCH_ENTRY_SIZE);
+		cbor.beginMap((timestamp != 0) ? 3 : 2);
+		cbor.writeText("stream_id");
+		cbor.writeInt(stream_id);
+		cbor.writeText("value");
+		cbor.writeDouble(data);
+		if (timestamp != 0) {
+			cbor.writeText("timestamp");
+			cbor.writeUnsigned(timestamp);
+		}
+		return cbor.length();
+	}
+	
+	int len = pondAppend(entry, 0, BATCH_ENTRY_SIZE, "{\"stream_id\":");
+	len += pondFormatInt(entry + len, stream_id);
+	len = pondAppend(entry, len, BATCH_ENTRY_SIZE, ",\"value\":");
+	len += pondFormatDouble(entry + len, data, 2);
+	if (timestamp != 0) {
+		len = pondAppend(entry, len, BATCH_ENTRY_SIZE, ",\"timestamp\":");
+		len += pondFormatUnsigned(entry + len, timestamp);
+	}
+	return pondAppend(entry, len, BATCH_ENTRY_SIZE, "}");
+}
+
+/*	A CBOR batch is an indefinite length array, so entries need no separator	*/
+void CoapDatapond::pushBatchEntry(const char* entry, int len) {
+	if (batchFormat == FORMAT_CBOR) {
+		if (batchCount == 0)
+			batchBuffer[batchLength++] = 0x9F;
+	}
+	else {
+		batchBuffer[batchLength++] = (batchCount == 0) ? '[' : ',';
+	}
+	memcpy(batchBuffer + batchLength, entry, len);
+	batchLength += len;
+	batchCount++;
 }
 
-int CoapDatapond::getStream(int stream_id) {
-	url = (String)stream_id;
+/*	Packs the batch into a single packet under one token. Batches bigger than a block are uploaded block-wise	*/
+int CoapDatapond::sendBatch(uns32 logFirst, uns16 logRecords, pond_done_fn done, void* context) {
+	if (batchCount == 0)
+		return 0;
+	batchBuffer[batchLength] = (batchFormat == FORMAT_CBOR) ? CBOR_BREAK : ']';
 	
+	//Only one upload at a time, the batch waits as it would for a full TX queue
+	bool blockwise = (batchLength + 1 > BLOCK_SIZE);
+	if (blockwise && (uploadSlot >= 0))
+		return -1;
+	
+	int slot = insertTokenEntry(CREATE_DROPLET, done, context);
+	if (slot < 0)
+		return TOKEN_TABLE_FULL;
+	tokenBuffer[slot].log_count = logRecords;
+	tokenBuffer[slot].log_first = logFirst;
+	
+	if (blockwise) {
+		memcpy(uploadBuffer, batchBuffer, batchLength + 1);
+		uploadLength = batchLength + 1;
+		uploadFormat = batchFormat;
+		buildUploadBlock(slot);
+	}
+	else {
+		buildBatchRequest(slot, batchFormat);
+		packet.addPayload(batchLength + 1, batchBuffer);
+	}
+	
+	int result = sendRequest(slot);
+	if (result == -1)
+		return -1;
+	if (blockwise)
+		uploadSlot = slot;
+	
+	batchLength = 0;
+	batchCount = 0;
+	batchFormat = contentFormat;
+	return result;
+}
+
+/*	Starts the batch POST, up to the options that follow the cookie	*/
+void CoapDatapond::buildBatchRequest(int slot, uns8 format) {
 	packet.begin();
-	packet.addHeader(TYPE_CON, COAP_GET, messageID++);
-	packet.addTokens(TOKENID_LENGTH, &current_token_id);
-	packet.addOption(OPT_URI_PATH, 6, "stream");
-	packet.addOption(OPT_URI_PATH, url.length(), url.c_str());
-	packet.addOption(OPT_URI_QUERY, cookie.length(), cookie.c_str());
+	packet.addHeader(TYPE_CON, COAP_POST, messageID++);
+	addToken(slot);
+	packet.addOption(OPT_URI_PATH, 7, "droplet");
+	packet.addOption(OPT_URI_PATH, 5, "batch");
+	if (format == FORMAT_CBOR)
+		addContentFormat();
+	packet.addOption(OPT_URI_QUERY, cookieLength, cookie);
+}
+
+
+////////////////////////////////////////////////////////
+////			Block-wise Transfers			 	////
+////////////////////////////////////////////////////////
+
+/*	Hands one block of a response to the block handler, then asks for the next on the same token	*/
+void CoapDatapond::receiveBlock(int slot, uns32 block, bool piggybacked) {
+	pond_token tkn = tokenBuffer[slot].token_id;
+	uns8 szx = COAP_BLOCK_SZX(block);
+	uns32 offset = COAP_BLOCK_NUM(block) << (szx + 4);
+	bool last = !COAP_BLOCK_MORE(block);
+	
+	//Retransmitted and reordered blocks are dropped, only the offset asked for is taken
+	if (offset != (tokenBuffer[slot].block_num << (tokenBuffer[slot].block_szx + 4)))
+		return;
+	//Timed before the next block's request starts its own timing
+	sampleExchange(slot, piggybacked);
+	
+	//The payload points into the received message, which stays put while the next request is built
+	_blockFn(tkn, true, offset, payloadPtr, payloadLength, last);
+	if (last) {
+		completeRequest(slot, true, CODE_CONTENT);
+		removeTokenEntry(slot);
+		return;
+	}
+	
+	//The server may answer with smaller blocks than asked for, later requests use its size
+	tokenBuffer[slot].block_szx = szx;
+	tokenBuffer[slot].block_num = COAP_BLOCK_NUM(block) + 1;
+	buildRead(slot);
+	//Failed while the slot still holds the read, so the block handler, delegate and metrics all hear of it
+	if (transmit(packet.getPacket(), packet.getPacketLength(), slot) == -1)
+		failExchange(slot);
+}
+
+/*	Tells the block handler that a read it has been given blocks of won't finish	*/
+void CoapDatapond::abortBlocks(int slot) {
+	if ((_blockFn == NULL) || (tokenBuffer[slot].resource == 0) || (tokenBuffer[slot].block_num == 0))
+		return;
+	uns32 offset = tokenBuffer[slot].block_num << (tokenBuffer[slot].block_szx + 4);
+	_blockFn(tokenBuffer[slot].token_id, false, offset, NULL, 0, true);
+}
+
+/*	Builds the POST carrying the slot's block of the upload	*/
+void CoapDatapond::buildUploadBlock(int slot) {
+	uns8 block[3];
+	uns8 szx = tokenBuffer[slot].block_szx;
+	uns32 offset = tokenBuffer[slot].block_num << (szx + 4);
+	int len = uploadLength - offset;
+	bool more = (len > (16 << szx));
+	if (more)
+		len = 16 << szx;
+	
+	buildBatchRequest(slot, uploadFormat);
+	int blockLength = pondCoapBlockOption(block, tokenBuffer[slot].block_num, more, szx);
+	packet.addOption(OPT_BLOCK1, blockLength, (const char*)block);
+	packet.addPayload(len, uploadBuffer + offset);
+}
+
+/*	Sends the next block once the server has taken the last one	*/
+void CoapDatapond::continueUpload(int slot, uns32 block, bool piggybacked) {
+	//Only the acknowledgement for the block in flight moves the upload on
+	if (COAP_BLOCK_NUM(block) != tokenBuffer[slot].block_num)
+		return;
+	sampleExchange(slot, piggybacked);
+	
+	uns32 sent = (tokenBuffer[slot].block_num + 1) << (tokenBuffer[slot].block_szx + 4);
+	if (COAP_BLOCK_SZX(block) < tokenBuffer[slot].block_szx)
+		tokenBuffer[slot].block_szx = COAP_BLOCK_SZX(block);
+	tokenBuffer[slot].block_num = sent >> (tokenBuffer[slot].block_szx + 4);
+	
+	buildUploadBlock(slot);
+	if (transmit(packet.getPacket(), packet.getPacketLength(), slot) == -1) {
+		settleDroplet(slot, false, 0);
+		if (!completeRequest(slot, false, 0))
+			createDropletHandler(tokenBuffer[slot].token_id, false);
+		endUpload(slot);
+		removeTokenEntry(slot);
+	}
+}
+
+/*	Frees the upload buffer if slot was using it	*/
+void CoapDatapond::endUpload(int slot) {
+	if (slot == uploadSlot)
+		uploadSlot = -1;
+}
+
+
+////////////////////////////////////////////////////////
+////			Store and Forward				 	////
+////////////////////////////////////////////////////////
+
+/*	Drains the log once logged in	*/
+void CoapDatapond::drainLog() {
+	if ((dropletLog == NULL) || drainInFlight || (batchCount > 0) || (cookieLength == 0))
+		return;
+	sendLogged();
+}
+
+/*	Sends the oldest logged droplets as one batch. Only one drain batch is in flight at a time,
+	returns -1 while there is one	*/
+int CoapDatapond::sendLogged(pond_done_fn done, void* context) {
+	droplet_record rec;
+	char entry[BATCH_ENTRY_SIZE];
+	uns16 records = 0;
+	
+	if (drainInFlight)
+		return -1;
+	if (dropletLog->isEmpty())
+		return 0;
+	if (!draining) {
+		draining = true;
+		drainStart = millis();
+	}
 	
-	CoapProtocol::addToTX(packet.getPacket(), packet.getPacketLength());
+	uns32 first = dropletLog->tail();
+	while (dropletLog->peek(records, &rec)) {
+		int len = formatBatchEntry(entry, rec.stream_id, rec.value, rec.timestamp);
+		if ((batchCount > 0) && (batchLength + len + 2 > BATCH_PAYLOAD_SIZE))
+			break;
+		pushBatchEntry(entry, len);
+		records++;
+	}
+	//Oldest record is unreadable, skip past it
+	if (records == 0) {
+		dropletLog->discard(1);
+		return 0;
+	}
+	
+	int result = sendBatch(first, records, done, context);
+	if (result < 0)
+		beginBatch();
+	else
+		drainInFlight = true;
+	return result;
+}
+
+/*	Updates the log with the outcome of a droplet request	*/
+void CoapDatapond::settleDroplet(int index, bool status, uns8 code) {
+	if (tokenBuffer[index].probe)
+		settleProbe(index, status);
+	if (dropletLog == NULL)
+		return;
+	//Client errors other than an expired session won't succeed on retry
+	bool retry = !status && (((code >> 5) != 4) || (code == CODE_UNAUTHORIZED));
 	
-	insertTokenEntry(READ_STREAM);
+	if (tokenBuffer[index].log_count > 0) {
+		drainInFlight = false;
+		//Records overwritten while the batch was in flight are no longer at the tail and are left alone
+		if (status)
+			dropletLog->consume(tokenBuffer[index].log_first, tokenBuffer[index].log_count);
+		else if (!retry)
+			dropletLog->discard(tokenBuffer[index].log_first, tokenBuffer[index].log_count);
+		
+		if (draining && dropletLog->isEmpty()) {
+			recoveryTime = millis() - drainStart;
+			draining = false;
+		}
+	}
+	else if (tokenBuffer[index].single_droplet && retry) {
+		dropletLog->append(tokenBuffer[index].stream_id, tokenBuffer[index].value);
+	}
 }
 
 
@@ -196,84 +1397,212 @@ int CoapDatapond::getStream(int stream_id) {
 ////			Callback Functions				 	////
 ////////////////////////////////////////////////////////
 
+/*	Reads a message in place from the buffer it arrived in, nothing is copied out of it	*/
 void CoapDatapond::retrievePacket(uns8* pkt, int pktLen) {
+	const uns8* option;
+	uns16 optionLength;
+	uns32 format = FORMAT_TEXT;
+	
+	if (pktLen < COAP_HEADER_SIZE)
+		return;
+	uns8 code = pkt[1];
+	//Timed out requests come back here too, only responses were received
+	if ((code >> 5) != 0)
+		POND_METRIC(received(pktLen));
+	uns8 type = (pkt[0] >> 4) & 0x03;
+	uns16 id = (pkt[2] << 8) | pkt[3];
+	//Empty ACKs carry nothing for a handler, they only time the request they acknowledge
+	if (code == 0) {
+		if (type == TYPE_ACK)
+			sampleAck(id);
+		return;
+	}
 	
-	bool rStatus = false;
+	//The token leads straight to the pending entry, anything unmatched is dropped before it's parsed
+	int i = findTokenEntry(pkt, pktLen);
+	if (i < 0)
+		return;
+	uns8 callbackCode = tokenBuffer[i].callback_code;
+	bool rStatus = (code == CODE_CREATED) || (code == CODE_CONTENT);
+	collectPayload(pkt, pktLen);
+	if (pondCoapFindOption(pkt, pktLen, OPT_CONTENT_FORMAT, &option, &optionLength))
+		format = pondCoapUint(option, optionLength);
+	//Only an ACK to the request last sent on the slot is a round trip
+	bool piggybacked = (type == TYPE_ACK) && (tokenBuffer[i].message_id == id);
 	
-	packet.begin();
-	packet.copyPacket(pkt, pktLen);
-	packet.parsePacket();
-	collectPayload();
-
-	if ((packet.getResponseCode() == CODE_CREATED) ||(packet.getResponseCode() == CODE_CONTENT))
+	//Successful responses carrying Observe keep the registration open
+	bool notification = false;
+	if (tokenBuffer[i].observe) {
+		//A registration that timed out is sent again by refreshObservations()
+		if ((code >> 5) == 0)
+			return;
+		if (rStatus && pondCoapFindOption(pkt, pktLen, OPT_OBSERVE, &option, &optionLength)) {
+			if (!acceptNotification(i, pondCoapUint(option, optionLength), pkt, pktLen))
+				return;
+			notification = true;
+		}
+		else {
+			tokenBuffer[i].observe = false;
+			observeCount--;
+		}
+	}
+	
+	//Reads too big for one block go to the block handler a block at a time
+	if (rStatus && (tokenBuffer[i].resource != 0) && pondCoapFindOption(pkt, pktLen, OPT_BLOCK2, &option, &optionLength)) {
+		uns32 block = pondCoapUint(option, optionLength);
+		if (COAP_BLOCK_MORE(block) || (COAP_BLOCK_NUM(block) > 0)) {
+			//Without a block handler the document can't be taken in, so the read fails
+			if (_blockFn == NULL) {
+				rStatus = false;
+			}
+			else {
+				receiveBlock(i, block, piggybacked);
+				return;
+			}
+		}
+	}
+	
+	//Uploads carry on until the server stops asking for blocks
+	if (i == uploadSlot) {
+		if ((code == CODE_CONTINUE) && pondCoapFindOption(pkt, pktLen, OPT_BLOCK1, &option, &optionLength)) {
+			continueUpload(i, pondCoapUint(option, optionLength), piggybacked);
+			return;
+		}
+		endUpload(i);
+	}
+	
+	//Unchanged reads are answered from the cache, new ones kept for next time
+	pond_cache_entry* entry = cachedEntry(i);
+	if ((entry != NULL) && (code == CODE_VALID)) {
+		cache->validated(entry, millis());
+		payloadPtr = entry->body;
+		payloadLength = entry->bodyLength;
+		format = entry->format;
 		rStatus = true;
+	}
+	else if (rStatus && tokenBuffer[i].cached) {
+		uns8 request[READ_REQUEST_SIZE];
+		if (!pondCoapFindOption(pkt, pktLen, OPT_ETAG, &option, &optionLength)) {
+			option = NULL;
+			optionLength = 0;
+		}
+		cache->store(request, cacheRequest(i, request), option, optionLength, payloadPtr, payloadLength, format, millis());
+		cache->miss();
+	}
 	
-	for (int i = 0; i < TOKENID_BUFFER_SIZE; i++) {
-		printTokenEntry(i);
-		//If it's not in use, it doesn't have an entry
-		if (!tokenBuffer[i].in_use) 
-			continue;
-		
-		if (tokenBuffer[i].token_id == *packet.getTokens()) {
-			switch (tokenBuffer[i].callback_code) {
-				case LOGIN_CODE:
-					printTokenEntry(i);
-					loginHandler(rStatus);
-					break;
-				case CREATE_DROPLET: 
-					printTokenEntry(i);
-					createDropletHandler(tokenBuffer[i].token_id, rStatus);
-					break;
-				case READ_DROPLET:
-					printTokenEntry(i);
-					readDropletHandler(tokenBuffer[i].token_id, rStatus, payload);
-					break;
-				case READ_STREAM:
-					printTokenEntry(i);
-					readStreamHandler(tokenBuffer[i].token_id, rStatus, payload);
-					break;
+	//Timed out requests come back as themselves, their method code isn't a response
+	if ((code >> 5) != 0)
+		sampleExchange(i, piggybacked);
+	else
+		abortBlocks(i);
+	deliverResponse(i, rStatus, format, ((code >> 5) != 0) ? code : 0);
+	if (!notification)
+		removeTokenEntry(i);
+	
+	//The server no longer knows the session
+	if ((code == CODE_UNAUTHORIZED) && (callbackCode != LOGIN_CODE))
+		expireSession();
+}
+
+/*	Hands a response to the slot's delegate, or to the handler of its request	*/
+void CoapDatapond::deliverResponse(int i, bool rStatus, uns32 format, uns8 code) {
+	printTokenEntry(i);
+	payloadFormat = format;
+	if (!rStatus)
+		POND_METRIC(failure(metricOp(tokenBuffer[i].callback_code)));
+	if (tokenBuffer[i].done != NULL) {
+		//The session and the log are kept up to date either way
+		if (tokenBuffer[i].callback_code == LOGIN_CODE) {
+			loginInFlight = false;
+			if (rStatus)
+				collectCookie();
+		}
+		if (tokenBuffer[i].callback_code == CREATE_DROPLET)
+			settleDroplet(i, rStatus, code);
+		completeRequest(i, rStatus, code);
+		return;
+	}
+	
+	switch (tokenBuffer[i].callback_code) {
+		case LOGIN_CODE:
+			loginHandler(rStatus);
+			break;
+		case CREATE_DROPLET: 
+			settleDroplet(i, rStatus, code);
+			createDropletHandler(tokenBuffer[i].token_id, rStatus);
+			break;
+		case READ_DROPLET:
+			readValueHandler(tokenBuffer[i].token_id, rStatus, format);
+			//Only the String handler needs a copy of the payload
+			if ((format != FORMAT_CBOR) && (_readDropletFn != NULL))
+				readDropletHandler(tokenBuffer[i].token_id, rStatus, getPayload());
+			break;
+		case READ_STREAM:
+			readValueHandler(tokenBuffer[i].token_id, rStatus, format);
+			if ((format != FORMAT_CBOR) && (_readStreamFn != NULL))
+				readStreamHandler(tokenBuffer[i].token_id, rStatus, getPayload());
+			break;
+		case READ_SERIES:
+			if (_readSeriesFn != NULL) {
+				PondSeriesReader series((const uns8*)payloadPtr, payloadLength);
+				_readSeriesFn(tokenBuffer[i].token_id, rStatus && (format == FORMAT_OCTET), &series);
 			}
-			tokenBuffer[i].in_use = false;
-			printTokenEntry(i);
 			break;
-		}
-	}	
+	}
+}
+
+/*	Calls the slot's delegate, at most once. Returns false if it has none	*/
+bool CoapDatapond::completeRequest(int slot, bool status, uns8 code) {
+	pond_done_fn done = tokenBuffer[slot].done;
+	if (done == NULL)
+		return false;
+	tokenBuffer[slot].done = NULL;
+	done(tokenBuffer[slot].context, tokenBuffer[slot].token_id, status, code);
+	return true;
 }
 
 void CoapDatapond::loginHandler(bool rstatus) {
-	if (rstatus) {
+	loginInFlight = false;
+	if (rstatus)
 		collectCookie();
-		_loggedIn(true);
-	}
-	else {
-		_loggedIn(false);
-	}
+	if (_loggedIn != NULL)
+		_loggedIn(rstatus);
 }
 
-void CoapDatapond::createDropletHandler(uns8 tkn, bool status) {
+void CoapDatapond::createDropletHandler(pond_token tkn, bool status) {
 	if (_createDropletFn != NULL) {
 		_createDropletFn(tkn, status);
 	}
 }
 
-void CoapDatapond::readDropletHandler(uns8 tkn, bool status, String data) {
+void CoapDatapond::readDropletHandler(pond_token tkn, bool status, String data) {
 	if (_readDropletFn != NULL) {
 		_readDropletFn(tkn, status, data);
 	}
 }
 
-void CoapDatapond::createStreamhandler(uns8 tkn, bool status) {
+void CoapDatapond::createStreamhandler(pond_token tkn, bool status) {
 	if (_createStreamFn != NULL) {
 		_createStreamFn(tkn, status);
 	}
 }
 
-void CoapDatapond::readStreamHandler(uns8 tkn, bool status, String data) {
+void CoapDatapond::readStreamHandler(pond_token tkn, bool status, String data) {
 	if (_readStreamFn != NULL) {
 		_readStreamFn(tkn, status, data);
 	}
 }
 
+/*	Decodes a JSON or CBOR droplet or stats response in place	*/
+void CoapDatapond::readValueHandler(pond_token tkn, bool status, uns32 format) {
+	pond_reading reading;
+	if (_readValueFn == NULL)
+		return;
+	payloadFormat = format;
+	bool decoded = getReading(&reading);
+	_readValueFn(tkn, status && decoded, &reading);
+}
+
 void CoapDatapond::txSuccessHandler(uns8* pkt, int pktLen) {
 	if (_txSuccess != NULL) {
 		CoapProtocol::txSuccessHandler(pkt, pktLen);
@@ -288,15 +1617,18 @@ void CoapDatapond::txFailureHandler(uns8* pkt, int pktLen) {
 		CoapProtocol::txFailureHandler(pkt, pktLen);
 	}
 	else {
-		packet.begin();
-		packet.copyPacket(pkt, pktLen);
-		packet.parsePacket();
 		//Remove entry from token_buffer
-		for (int i = 0; i < TOKENID_BUFFER_SIZE; i++) {
-			if (tokenBuffer[i].token_id == *packet.getTokens()) {
-				tokenBuffer[i].in_use = false;
-				break;
+		int i = findTokenEntry(pkt, pktLen);
+		//The protocol has given up after its last resend, or the server reset the exchange
+		if (i >= 0) {
+			if (tokenBuffer[i].timing == TIMING_SENT) {
+				uns8 retransmits = pondCoapRetransmissions(millis() - tokenBuffer[i].sent_time);
+				exchangeRetransmits += retransmits;
+				POND_METRIC(retransmit(retransmits));
 			}
+			exchangeTimeouts++;
+			POND_METRIC(timeout());
+			failExchange(i);
 		}
 	}
 }
@@ -315,6 +1647,10 @@ void CoapDatapond::responseTimeoutHandler(uns8* pkt, int pktLen) {
 		CoapProtocol::responseTimeoutHandler(pkt, pktLen);
 	}
 	else {
+		//The request was acknowledged but its separate response never came
+		if (findTokenEntry(pkt, pktLen) >= 0)
+			exchangeTimeouts++;
+		POND_METRIC(timeout());
 		retrievePacket(pkt, pktLen);
 	}
 }
@@ -344,6 +1680,22 @@ void CoapDatapond::setReadStreamHandler(read_request_ptr handler) {
 	_readStreamFn = handler;
 }
 
+void CoapDatapond::setReadValueHandler(read_value_ptr handler) {
+	_readValueFn = handler;
+}
+
+void CoapDatapond::setBlockHandler(block_data_ptr handler) {
+	_blockFn = handler;
+}
+
+void CoapDatapond::setReadyHandler(ready_fnPtr handler) {
+	_readyFn = handler;
+}
+
+void CoapDatapond::setReadSeriesHandler(read_series_ptr handler) {
+	_readSeriesFn = handler;
+}
+
 void CoapDatapond::setHandlers(create_request_ptr handler1, 
 					read_request_ptr handler2, create_request_ptr handler3,
 					read_request_ptr handler4) {
@@ -355,6 +1707,11 @@ void CoapDatapond::setHandlers(create_request_ptr handler1,
 }
 
 
+void CoapDatapond::setDropletLog(DropletLog* log) {
+	dropletLog = log;
+}
+
+
 void CoapDatapond::setProtocolHandlers(packetReturn_callback packetAvailable, 
 					packetReturn_callback txSuccess, packetReturn_callback txFailure,
 					packetReturn_callback responseTimeout)
@@ -370,16 +1727,63 @@ void CoapDatapond::setProtocolHandlers(packetReturn_callback packetAvailable,
 ////			Data Accessor Functions				 	////
 ////////////////////////////////////////////////////////////	
 
-/*	Returns the current payload data  */
+/*	Returns a copy of the last response payload. Only valid from a handler	*/
 String CoapDatapond::getPayload() {
-	return this->payload;
+	String data;
+	data.reserve(payloadLength);
+	for (int i = 0; i < payloadLength; i++)
+		data += payloadPtr[i];
+	return data;
 }
 
+/*	Returns the last response payload in place. Only valid from the handler it was delivered to	*/
+pond_view CoapDatapond::getPayloadView() {
+	pond_view view = {payloadPtr, (uns16)payloadLength};
+	return view;
+}
+
+/*	Decodes the droplet or stats fields of the last response, JSON or CBOR	*/
+bool CoapDatapond::getReading(pond_reading* reading) {
+	if (payloadFormat == FORMAT_CBOR)
+		return pondCborReading((const uns8*)payloadPtr, payloadLength, reading);
+	return pondJsonReading(payloadPtr, payloadLength, reading);
+}
 
-String CoapDatapond::getCookie() {
+
+const char* CoapDatapond::getCookie() {
 	return cookie;
 }
 
+/*	Adds up the client and everything attached to it. The total is also returned	*/
+uns32 CoapDatapond::memoryFootprint(pond_footprint* report) {
+	pond_footprint footprint;
+	footprint.client = sizeof(*this);
+	footprint.requests = sizeof(tokenBuffer) + sizeof(freeSlots);
+	footprint.buffers = sizeof(packet) + sizeof(body) + sizeof(url) + sizeof(batchBuffer) + sizeof(uploadBuffer)
+						+ sizeof(cookie) + sizeof(pondUsername) + sizeof(pondPassword);
+	footprint.attached = 0;
+	if (cache != NULL)
+		footprint.attached += sizeof(PondCache);
+	if (dropletLog != NULL)
+		footprint.attached += sizeof(DropletLog);
+	for (PondAggregator* agg = aggregators; agg != NULL; agg = agg->next)
+		footprint.attached += sizeof(PondAggregator);
+	footprint.total = footprint.client + footprint.attached;
+	if (report != NULL)
+		*report = footprint;
+	return footprint.total;
+}
+
+/*	Returns the token of the most recently queued request	*/
+pond_token CoapDatapond::getLastToken() {
+	return lastToken;
+}
+
+/*	Returns how long the last drain took to empty the log, in ms	*/
+unsigned long CoapDatapond::getRecoveryTime() {
+	return recoveryTime;
+}
+
 /*	Returns address of first byte in packet	*/
 uns8* CoapDatapond::getPacket() {
 	return packet.getPacket();
@@ -395,33 +1799,85 @@ int CoapDatapond::getPacketLength() {
 ////			Token Buffer Functions				 	////
 ////////////////////////////////////////////////////////////	
 	
-void CoapDatapond::insertTokenEntry(uns8 callbackCode) {
-	int tokenCursor = 0;
-	for (int tokenCursor = 0; tokenCursor < TOKENID_BUFFER_SIZE; tokenCursor++) {
-		if (tokenBuffer[tokenCursor].in_use)
-			continue;
-		else {
-			tokenBuffer[tokenCursor].token_id = current_token_id;
-			tokenBuffer[tokenCursor].callback_code = callbackCode;
-			tokenBuffer[tokenCursor].in_use = true;
-			break;
-		}
-		printTokenEntry(tokenCursor);
+/*	Takes a free slot and gives it a new token. Returns -1 if every slot is in use	*/
+int CoapDatapond::insertTokenEntry(uns8 callbackCode, pond_done_fn done, void* context) {
+	if (!readyToSend()) {
+		windowBlocked = true;
+		return -1;
 	}
-
-	if (current_token_id <= 0xFF)
-		current_token_id++;
-	else
-		current_token_id = 0x01;
+	int slot = freeSlots[--freeCount];
+	
+	//The low bits of a token are its slot, the rest keep stale responses from aliasing
+	tokenBuffer[slot].token_id = ((current_token_id++ * TOKENID_BUFFER_SIZE) + slot) & TOKENID_MASK;
+	lastToken = tokenBuffer[slot].token_id;
+	tokenBuffer[slot].callback_code = callbackCode;
+	tokenBuffer[slot].response_code = 0x00;
+	tokenBuffer[slot].in_use = true;
+	tokenBuffer[slot].single_droplet = false;
+	tokenBuffer[slot].log_count = 0;
+	tokenBuffer[slot].log_first = 0;
+	tokenBuffer[slot].observe = false;
+	tokenBuffer[slot].resource = 0;
+	tokenBuffer[slot].block_num = 0;
+	tokenBuffer[slot].block_szx = BLOCK_SZX;
+	tokenBuffer[slot].probe = false;
+	tokenBuffer[slot].cached = false;
+	tokenBuffer[slot].from_cache = false;
+	tokenBuffer[slot].done = done;
+	tokenBuffer[slot].context = context;
+	tokenBuffer[slot].timing = TIMING_NONE;
+	POND_METRIC(request(metricOp(callbackCode)));
+	POND_METRIC(slots(TOKENID_BUFFER_SIZE - freeCount));
+	return slot;
 }    
 
-void CoapDatapond::markEntryResponse(uns8 tokenID, uns8 response) {
-	for (int i = 0; i < TOKENID_BUFFER_SIZE; i++) {
-		if (tokenID == tokenBuffer[i].token_id) {
-			tokenBuffer[i].response_code = response;
-			break;
-		}
+void CoapDatapond::removeTokenEntry(int slot) {
+	if (!tokenBuffer[slot].in_use)
+		return;
+	if (tokenBuffer[slot].from_cache) {
+		tokenBuffer[slot].from_cache = false;
+		cachedCount--;
 	}
+	tokenBuffer[slot].in_use = false;
+	freeSlots[freeCount++] = slot;
 }
 
+/*	Returns the slot waiting on the token in pkt, or -1 if nothing is	*/
+int CoapDatapond::findTokenEntry(const uns8* pkt, int pktLen) {
+	if (pktLen < 4)
+		return -1;
+	int tokenLength = pkt[0] & 0x0F;
+	if ((tokenLength != TOKENID_LENGTH) || (pktLen < 4 + tokenLength))
+		return -1;
+	
+	pond_token tkn = 0;
+	for (int i = 0; i < TOKENID_LENGTH; i++)
+		tkn = (tkn << 8) | pkt[4 + i];
+	
+	int slot = tkn & (TOKENID_BUFFER_SIZE - 1);
+	if (!tokenBuffer[slot].in_use || (tokenBuffer[slot].token_id != tkn))
+		return -1;
+	return slot;
+}
 
+/*	Writes the slot's token into the packet	*/
+void CoapDatapond::addToken(int slot) {
+	uns8 tkn[TOKENID_LENGTH];
+	writeToken(tkn, slot);
+	packet.addTokens(TOKENID_LENGTH, tkn);
+}
+
+/*	Writes the slot's token to dst, most significant byte first	*/
+void CoapDatapond::writeToken(uns8* dst, int slot) {
+	pond_token value = tokenBuffer[slot].token_id;
+	for (int i = TOKENID_LENGTH - 1; i >= 0; i--) {
+		dst[i] = value & 0xFF;
+		value >>= 8;
+	}
+}
+
+void CoapDatapond::markEntryResponse(pond_token tokenID, uns8 response) {
+	int slot = tokenID & (TOKENID_BUFFER_SIZE - 1);
+	if (tokenBuffer[slot].in_use && (tokenBuffer[slot].token_id == tokenID))
+		tokenBuffer[slot].response_code = response;
+}
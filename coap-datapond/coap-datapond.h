@@ -33,13 +33,73 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef __coap-datapond_h
 #define __coap-datapond_h
 
+#include "datapond-config.h"
 #include "ESP8266WiFi.h"
 #include "coap-packet.h"
 #include "coap-protocol.h"
 #include "WiFiUdp.h"
+#include "datapond-log.h"
+#include "datapond-coap.h"
+#include "datapond-cbor.h"
+#include "datapond-json.h"
+#include "datapond-session.h"
+#include "datapond-aggregate.h"
+#include "datapond-series.h"
+#include "datapond-cache.h"
+#include "datapond-metrics.h"
+#include "datapond-footprint.h"
 
-#define		TOKENID_LENGTH		1
-#define		TOKENID_BUFFER_SIZE	10
+#if (TOKENID_LENGTH < 1) || (TOKENID_LENGTH > 8)
+#error "TOKENID_LENGTH must be between 1 and 8"
+#endif
+#if (TOKENID_BUFFER_SIZE & (TOKENID_BUFFER_SIZE - 1)) || (TOKENID_BUFFER_SIZE > 32768)
+#error "TOKENID_BUFFER_SIZE must be a power of two"
+#endif
+#if (TOKENID_LENGTH == 1) && (TOKENID_BUFFER_SIZE > 256)
+#error "TOKENID_BUFFER_SIZE doesn't fit in a 1 byte token"
+#endif
+
+#if TOKENID_LENGTH > 4
+typedef uint64_t	pond_token;
+#else
+typedef uint32_t	pond_token;
+#endif
+
+#if (TOKENID_LENGTH == 4) || (TOKENID_LENGTH == 8)
+#define		TOKENID_MASK		((pond_token)~0)
+#else
+#define		TOKENID_MASK		(((pond_token)1 << (8 * TOKENID_LENGTH)) - 1)
+#endif
+
+#define		BATCH_ENTRY_SIZE	96
+
+#if BLOCK_SZX > 6
+#error "BLOCK_SZX must be between 0 and 6"
+#endif
+#define		BLOCK_SIZE			(16 << BLOCK_SZX)
+
+#if SERIES_BUFFER_SIZE > BLOCK_SIZE
+#error "SERIES_BUFFER_SIZE must fit in one block"
+#endif
+
+//Batches bigger than a block are copied here while their blocks go out
+#if BATCH_PAYLOAD_SIZE > BLOCK_SIZE
+#define		UPLOAD_BUFFER_SIZE	BATCH_PAYLOAD_SIZE
+#else
+#define		UPLOAD_BUFFER_SIZE	1
+#endif
+
+//What a read is cached under, its resource, stream and format
+#define		READ_REQUEST_SIZE	(2 + sizeof(int))
+
+//Scratch space requests are serialized from. The body holds a metrics summary as a text droplet
+#define		URL_BUFFER_SIZE		32
+#define		BODY_BUFFER_SIZE	(METRICS_SUMMARY_SIZE + 16)
+
+#define		COOKIE_SIZE			SESSION_COOKIE_SIZE
+
+//Largest cached request template, header to end of value
+#define		PREPARED_BUFFER_SIZE	192
 
 //Callback codes
 #define		LOGIN_CODE			0x01
@@ -49,6 +109,7 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #define		DELETE_DROPLET		0x40
 #define		CREATE_STREAM		0x11
 #define		READ_STREAM			0x21
+#define		READ_SERIES			0x23
 #define		UPDATE_STREAM		0x31
 #define		DELETE_STREAM		0x41
 #define		CREATE_POND			0x12
@@ -56,46 +117,303 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #define		UPDATE_POND			0x32
 #define		DELETE_POND			0x42			
 
+//Content formats. FORMAT_TEXT sends droplet values as Uri-Query text
+#define		FORMAT_TEXT			0
+#define		FORMAT_OCTET		42		//Packed series, see datapond-series.h
+#define		FORMAT_JSON			50
+#define		FORMAT_CBOR			60
+
+#ifndef OPT_ETAG
+#define		OPT_ETAG			4
+#endif
+#ifndef OPT_CONTENT_FORMAT
+#define		OPT_CONTENT_FORMAT	12
+#endif
+#ifndef OPT_ACCEPT
+#define		OPT_ACCEPT			17
+#endif
+#ifndef OPT_OBSERVE
+#define		OPT_OBSERVE			6
+#endif
+#ifndef OPT_MAX_AGE
+#define		OPT_MAX_AGE			14
+#endif
+#ifndef OPT_BLOCK2
+#define		OPT_BLOCK2			23
+#endif
+#ifndef OPT_BLOCK1
+#define		OPT_BLOCK1			27
+#endif
+
+//Seconds a notification stays current when the server sends no Max-Age
+#define		OBSERVE_MAX_AGE		60
+//ms past Max-Age without a notification before registering again
+#define		OBSERVE_GRACE		5000
+
+#ifndef CODE_UNAUTHORIZED
+#define		CODE_UNAUTHORIZED	0x81
+#endif
+#ifndef CODE_VALID
+#define		CODE_VALID			0x43
+#endif
+#ifndef CODE_CONTINUE
+#define		CODE_CONTINUE		0x5F
+#endif
+
+//Resources a read is rebuilt from when asking for its next block
+#define		RESOURCE_LAST_DROPLET	1
+#define		RESOURCE_STREAM			2
+#define		RESOURCE_STATS_TODAY	3
+#define		RESOURCE_SERIES			4
+
+//Exchanges that may be waiting on a response at once, registered observations aside. setWindow()
+//takes it up to TOKENID_BUFFER_SIZE, but each confirmable request also holds an entry in the
+//protocol's TX queue until it's acknowledged, so the real ceiling is the smaller of the two.
+//Hundreds in flight need both raised
+#ifndef TX_WINDOW
+#define		TX_WINDOW			4
+#endif
+
+//Round trip timing of a slot's request
+#define		TIMING_NONE			0		//Nothing to time, or already timed
+#define		TIMING_QUEUED		1		//Waiting in the protocol's TX queue
+#define		TIMING_SENT			2		//Sent at sent_time
+#define		TIMING_ACKED		3		//Empty ACK came back, the response follows separately
+//Packets handed to the protocol that run() hasn't seen go out yet, one per slot the window can use
+#define		TX_PENDING_SIZE		TOKENID_BUFFER_SIZE
+
+//Delivery policies of createDroplet, see setDeliveryPolicy()
+#define		DELIVERY_CON		0
+#define		DELIVERY_NON		1
+//NON droplets between confirmable probes, and the longest time in ms without one
+#define		PROBE_INTERVAL		16
+#define		PROBE_PERIOD		30000
+
+//Request result when every pending request slot is taken, or the window is full
+#define		TOKEN_TABLE_FULL	-2
+//createDroplet result when the droplet went to the log instead of the TX queue. Negative,
+//as queued requests return their TX queue index and that can be 0
+#define		DROPLET_STORED		-3
+
 typedef	void (*login_fnPtr)(bool i);	
-typedef void (*create_request_ptr)(uns8 tkn, bool status);
-typedef void (*read_request_ptr)(uns8 tkn, bool status, String data);
+typedef void (*create_request_ptr)(pond_token tkn, bool status);
+typedef void (*read_request_ptr)(pond_token tkn, bool status, String data);
+typedef void (*read_value_ptr)(pond_token tkn, bool status, const pond_reading* reading);
+typedef void (*read_series_ptr)(pond_token tkn, bool status, PondSeriesReader* series);
+typedef void (*ready_fnPtr)(int credits);
+typedef void (*block_data_ptr)(pond_token tkn, bool status, uns32 offset, const char* data, int len, bool last);
+//Completion delegate of one request. Called once with the context it was given, code is 0 when nothing came back
+typedef void (*pond_done_fn)(void* context, pond_token tkn, bool status, uns8 code);
 
 
 typedef struct {
-	uns8 	token_id = 0;
+	pond_token	token_id = 0;
 	uns8	callback_code = 0;
 	uns8	response_code = 0x00;
 	bool	in_use = false;
+	bool	single_droplet = false;	//stream_id and value can be logged again on failure
+	uns16	log_count = 0;			//Records from the droplet log carried by this request
+	uns32	log_first = 0;			//Sequence of the first of them
+	int		stream_id = 0;
+	double	value = 0;
+	bool	observe = false;		//Slot stays in use for notifications until cancelled
+	bool	observe_seen = false;	//observe_seq holds a delivered notification
+	uns32	observe_seq = 0;
+	unsigned long	observe_time = 0;	//Last registration or delivered notification
+	uns32	max_age = 0;
+	uns8	resource = 0;			//RESOURCE_ code of a read, 0 for anything else
+	uns32	block_num = 0;			//Block expected next, or being uploaded
+	uns8	block_szx = BLOCK_SZX;
+	uns8	timing = TIMING_NONE;
+	uns16	message_id = 0;			//Of the request last queued, its ACK is the one timed
+	unsigned long	sent_time = 0;	//When run() saw the request go out
+	bool	probe = false;			//Confirmable droplet of a NON stream
+	bool	cached = false;			//Read answered through the cache
+	uns8	accept = FORMAT_TEXT;	//Format the read asked for, its cache entry is kept per format
+	bool	from_cache = false;		//Answered from the cache by run(), nothing was sent
+	pond_done_fn	done = NULL;	//Stands in for the handler set for callback_code
+	void*	context = NULL;
 } token_buffer_struct; 
 
+//A packet in the protocol's TX queue, slot is -1 for NON droplets
+typedef struct {
+	int			slot;
+	pond_token	token;
+} pond_tx_pending;
+
+//Delivery policy of one stream, and what its probes found
+typedef struct {
+	int		stream_id;
+	uns8	mode;
+	uns8	probe_interval;			//NON droplets between probes, 0 to never probe
+	uns8	since_probe;
+	unsigned long	probe_time;
+	uns32	sent;					//Droplets sent NON
+	uns32	probes;					//Probes answered or given up on
+	uns32	probes_acked;
+} pond_delivery;
+
+//Request for one stream and operation, encoded once and patched on every send
+class CoapPreparedRequest {
+	friend class CoapDatapond;
+private:
+	uns8	buffer[PREPARED_BUFFER_SIZE];
+	int		templateLength;
+	int		stream_id;
+	uns8	callback_code;
+	uns16	session;
+	uns8	format;
+	bool	ready = false;
+};
+
 class CoapDatapond : public CoapProtocol{
 	
 private:
 	CoapPacket 			packet;
 	
-	String				pondUsername;
-	String				pondPassword;
+	char				pondUsername[CREDENTIAL_SIZE];
+	char				pondPassword[CREDENTIAL_SIZE];
 	const char*			pondIPAddress;	
 	int					serverPort;
 	int					localPort;
 	
 	uns16				messageID;
-	String				cookie = "";
-	String				payload;
-	String				body;
-	String				url;
+	char				cookie[COOKIE_SIZE];
+	uns8				cookieLength = 0;
+	uns16				sessionCount = 0;	//Bumped whenever the cookie changes
+	bool				loginInFlight = false;
+	bool				loginArmed = false;	//run() logs in again only after the first login() or a rejected session
+	unsigned long		loginTime = 0;		//When the last login went out
+	uns32				loginBackoff = SESSION_RETRY_MIN;
+	uns8				contentFormat = FORMAT_TEXT;
+	const char*			payloadPtr = NULL;	//Points into the received message, see getPayloadView()
+	uns32				payloadFormat = FORMAT_TEXT;
+	int					payloadLength = 0;
+	char				body[BODY_BUFFER_SIZE];
+	char				url[URL_BUFFER_SIZE];
 	
 	//Token buffer variables
 	token_buffer_struct	tokenBuffer[TOKENID_BUFFER_SIZE];
-	uns8				current_token_id;
+	uns16				freeSlots[TOKENID_BUFFER_SIZE];
+	uns16				freeCount;
+	pond_token			current_token_id;
+	pond_token			lastToken;
+	uns8				observeCount = 0;
+	uns16				window = TX_WINDOW;
+	bool				windowBlocked = false;	//A request was turned away since credits last ran out
+	
+	//Delivery policies
+	pond_delivery		delivery[DELIVERY_POLICY_SIZE];
+	uns8				deliveryCount = 0;
+	
+	//Retransmission timeout estimation
+	pond_rto			rtoEstimator;
+	uns32				exchangeTimeouts = 0;
+	uns32				exchangeRetransmits = 0;
+	
+	//Packets in the protocol's TX queue, oldest first, as it sends them in order
+	pond_tx_pending		txPending[TX_PENDING_SIZE];
+	uns16				txHead = 0;
+	uns16				txCount = 0;
+	
+	//Batch upload variables
+	char				batchBuffer[BATCH_PAYLOAD_SIZE];
+	int					batchLength;
+	uns8				batchCount;
+	uns8				batchFormat = FORMAT_TEXT;
+	
+	//Block-wise upload variables, one upload runs at a time
+	char				uploadBuffer[UPLOAD_BUFFER_SIZE];
+	int					uploadLength = 0;
+	uns8				uploadFormat = FORMAT_TEXT;
+	int					uploadSlot = -1;
+	
+	PondAggregator*		aggregators = NULL;
+	PondCache*			cache = NULL;
+	uns8				cachedCount = 0;	//Slots waiting to be answered from the cache
+	
+#if POND_METRICS
+	PondMetrics			metrics;
+#endif
+	
+	//Store-and-forward variables
+	DropletLog*			dropletLog = NULL;
+	bool				drainInFlight = false;
+	bool				draining = false;
+	unsigned long		drainStart;
+	unsigned long		recoveryTime = 0;
 	
 	//Token buffer functions
-	void	insertTokenEntry(uns8 callbackCode);
-	void	markEntryResponse(uns8 tokenID, uns8 response);
+	int		insertTokenEntry(uns8 callbackCode, pond_done_fn done = NULL, void* context = NULL);
+	void	removeTokenEntry(int slot);
+	int		findTokenEntry(const uns8* pkt, int pktLen);
+	void	addToken(int slot);
+	void	writeToken(uns8* dst, int slot);
+	int		sendRequest(int slot);
+	int		transmit(uns8* buf, int len, int slot);
+	void	markSent();
+	void	addStreamQuery(int stream_id);
+	void	addContentFormat();
+	void	addAccept();
+	void	markEntryResponse(pond_token tokenID, uns8 response);
+	int		sendDroplet(int stream_id, const char* text, double value, bool loggable, pond_done_fn done, void* context);
+	int		readResource(uns8 resource, uns8 callbackCode, int stream_id, pond_done_fn done, void* context);
+	void	buildRead(int slot);
+	void	deliverResponse(int slot, bool rStatus, uns32 format, uns8 code);
+	bool	completeRequest(int slot, bool status, uns8 code);
+	
+	//Read cache functions
+	pond_cache_entry*	cachedEntry(int slot);
+	uns8	cacheRequest(int slot, uns8* request);
+	void	forgetStream(int stream_id);
+	void	deliverCached();
+	
+	//Batch functions
+	int		formatBatchEntry(char* entry, int stream_id, double data, uint32_t timestamp);
+	void	pushBatchEntry(const char* entry, int len);
+	int		sendBatch(uns32 logFirst, uns16 logRecords, pond_done_fn done = NULL, void* context = NULL);
+	void	buildBatchRequest(int slot, uns8 format);
+	
+	//Block-wise transfer functions
+	void	receiveBlock(int slot, uns32 block, bool piggybacked);
+	void	abortBlocks(int slot);
+	void	buildUploadBlock(int slot);
+	void	continueUpload(int slot, uns32 block, bool piggybacked);
+	void	endUpload(int slot);
+	
+	//Prepared request functions
+	bool	buildPrepared(CoapPreparedRequest* prep);
+	
+	//Delivery policy functions
+	pond_delivery*	findDelivery(int stream_id);
+	bool	sendConfirmable(pond_delivery* policy);
+	void	writeNonToken(uns8* dst);
+	void	settleProbe(int slot, bool status);
+	
+	//Timeout estimation functions
+	void	sampleAck(uns16 messageID);
+	void	sampleRtt(int slot);
+	void	sampleExchange(int slot, bool piggybacked);
+	void	failExchange(int slot);
+	
+	//Observe functions
+	int		sendObserve(int slot, bool deregister);
+	bool	acceptNotification(int slot, uns32 seq, const uns8* pkt, int pktLen);
+	void	refreshObservations();
+	
+	//Aggregation functions
+	void	flushAggregator(PondAggregator* agg, uns32 now);
+	
+	//Store-and-forward functions
+	void	drainLog();
+	int		sendLogged(pond_done_fn done = NULL, void* context = NULL);
+	void	settleDroplet(int index, bool status, uns8 code);
 	
 	//Packet info collection
 	void	collectCookie();
-	void	collectPayload();
+	void	expireSession();
+	void	retryLogin();
+	void	collectPayload(const uns8* pkt, int pktLen);
 	
 	//Callback handling
 	void 	retrievePacket(uns8* pkt, int pktLen);
@@ -105,10 +423,11 @@ private:
 	
 	//Datapond callback handling
 	inline void	loginHandler(bool rstatus);
-	inline void	createDropletHandler(uns8 tkn, bool status);
-	inline void	readDropletHandler(uns8 tkn, bool status, String data);
-	inline void	createStreamhandler(uns8 tkn, bool status);
-	inline void	readStreamHandler(uns8 tkn, bool status, String data);
+	inline void	createDropletHandler(pond_token tkn, bool status);
+	inline void	readDropletHandler(pond_token tkn, bool status, String data);
+	inline void	createStreamhandler(pond_token tkn, bool status);
+	inline void	readStreamHandler(pond_token tkn, bool status, String data);
+	void		readValueHandler(pond_token tkn, bool status, uns32 format);
 	
 	//Coap Protocol Callback functions
 	packetReturn_callback	_txSuccess = NULL;
@@ -117,34 +436,110 @@ private:
 	packetReturn_callback 	_responseTimeout = NULL;
 	
 	//Datapond callback functions
-	login_fnPtr				_loggedIn;
+	login_fnPtr				_loggedIn = NULL;
 	create_request_ptr		_createDropletFn = NULL;
 	create_request_ptr		_createStreamFn = NULL;
 	read_request_ptr		_readDropletFn = NULL;
 	read_request_ptr		_readStreamFn = NULL;
+	read_value_ptr			_readValueFn = NULL;
+	block_data_ptr			_blockFn = NULL;
+	ready_fnPtr				_readyFn = NULL;
+	read_series_ptr			_readSeriesFn = NULL;
 
 public:
 	CoapDatapond(const char* ip, int thisport, int remoteport);
-	void	begin(String user, String pass, uns16 id);
+	void	begin(const char* user, const char* pass, uns16 id);
+	void	setContentFormat(uns8 format);
 	
 	//Internal admin functions
 	void	run();
 	void	emptyQueue();
 	void	processed(int x);
 
-	//Packet data accessors
-	String	getPayload();
+	//Packet data accessors. getPayload() and the String handlers copy to the heap, the rest don't.
+	//Responses are read where they arrived, so only from a handler. getPacket() is the last request built
+	String		getPayload();
+	pond_view	getPayloadView();
+	bool		getReading(pond_reading* reading);
 	uns8*	getPacket();
 	int		getPacketLength();
-	String	getCookie();
+	const char*	getCookie();
+	pond_token	getLastToken();
+	
+	//Exact RAM used by the client and what's attached to it
+	uns32	memoryFootprint(pond_footprint* report = NULL);
+	
+	//Session kept over deep sleep. Restore after begin(), the first request can go out straight away
+	bool	exportSession(pond_session* session);
+	bool	restoreSession(const pond_session* session);
+	
+	//Datapond server transactions. A request given a delegate completes through it instead of the
+	//handlers, on response, timeout or emptyQueue(). Droplets with a delegate always go confirmable
+	int	login(pond_done_fn done = NULL, void* context = NULL);
+	int	createDroplet(int stream_id, double data, pond_done_fn done = NULL, void* context = NULL);
+	int	createDroplet(int stream_id, const String& data, pond_done_fn done = NULL, void* context = NULL);
+	int	createDroplet(int stream_id, const char* data, pond_done_fn done = NULL, void* context = NULL);
+	int	getLastDroplet(int stream_id, pond_done_fn done = NULL, void* context = NULL);
+	int	getStatsToday(int stream_id, pond_done_fn done = NULL, void* context = NULL);
+	int	getStream(int stream_id, pond_done_fn done = NULL, void* context = NULL);
+	
+	//Observed streams, every new droplet arrives on the registration's token
+	int	observeStream(int stream_id);
+	int	cancelObserve(pond_token tkn);
+	
+	//Prepared requests, only the message ID, token and value change per send
+	bool	prepareDroplet(CoapPreparedRequest* prep, int stream_id);
+	bool	prepareLastDroplet(CoapPreparedRequest* prep, int stream_id);
+	int		sendPrepared(CoapPreparedRequest* prep, double data, pond_done_fn done = NULL, void* context = NULL);
+	int		sendPrepared(CoapPreparedRequest* prep, pond_done_fn done = NULL, void* context = NULL);
+	
+	//Batched droplet upload, one token and callback per packet. With a droplet log attached,
+	//added droplets go into the log and leave it only once the server acknowledges their batch
+	void	beginBatch();
+	int		addDroplet(int stream_id, double data);
+	int		commitBatch(pond_done_fn done = NULL, void* context = NULL);
+	
+	//NON droplets take no slot and get no callback. Every probeInterval-th one, and one
+	//every PROBE_PERIOD, goes out confirmable so the delivery ratio can be measured
+	bool	setDeliveryPolicy(int stream_id, uns8 mode, uns8 probeInterval = PROBE_INTERVAL);
+	const pond_delivery*	getDelivery(int stream_id);
+	float	getDeliveryRatio(int stream_id);
+	
+	//Round trips to each request's ACK feed the estimator. Retransmission and giving up are
+	//left to the protocol, an exchange ends when it gives up on it
+	const pond_rto*	getRtoEstimator();
+	uns32			getExchangeTimeouts();
+	uns32			getRetransmissions();
+	
+#if POND_METRICS
+	//Requests, failures, timeouts, bytes and latency per operation. sendMetrics() posts the summary as a droplet
+	PondMetrics*	getMetrics();
+	int				sendMetrics(int stream_id);
+#endif
+	
+	//At most window exchanges are outstanding, each credit is one more request that can go out.
+	//Requests beyond it return TOKEN_TABLE_FULL, and the ready handler runs once credits are back
+	void	setWindow(uns16 size);
+	int		getCredits();
+	bool	readyToSend();
+	
+	//Samples are summarised on the device, only the summaries go out as droplets.
+	//Windows that close between samples are sent from run()
+	void	addAggregator(PondAggregator* agg);
+	void	sample(PondAggregator* agg, double value);
+	
+	//Reads are answered from the cache while fresh, then revalidated with their ETag.
+	//The cache's stats count hits, 2.03 replies, misses and bytes saved
+	void	setCache(PondCache* responseCache);
+	
+	//Packed series, many timestamped samples of a stream in one droplet payload
+	int		sample(PondSeries* series, uns32 timestamp, double value);
+	int		sendSeries(PondSeries* series);
+	int		getSeries(int stream_id, pond_done_fn done = NULL, void* context = NULL);
 	
-	//Datapond server transactions
-	int	login();
-	int	createDroplet(int stream_id, double data);
-	int	createDroplet(int stream_id, String data);
-	int	getLastDroplet(int stream_id);
-	int	getStatsToday(int stream_id);
-	int	getStream(int stream_id);
+	//Unsent droplets are kept in the log and drained once logged in
+	void			setDropletLog(DropletLog* log);
+	unsigned long	getRecoveryTime();
 
 	//Callback sets/handlers
 	void	setProtocolHandlers(packetReturn_callback packetAvailable = NULL, 
@@ -161,6 +556,10 @@ public:
 	void	setReadDropletHandler(read_request_ptr handler);
 	void	setCreateStreamHandler(create_request_ptr handler);
 	void	setReadStreamHandler(read_request_ptr handler);
+	void	setReadValueHandler(read_value_ptr handler);
+	void	setBlockHandler(block_data_ptr handler);
+	void	setReadyHandler(ready_fnPtr handler);
+	void	setReadSeriesHandler(read_series_ptr handler);
 	void	setHandlers(create_request_ptr handler1, 
 					read_request_ptr handler2, create_request_ptr handler3,
 					read_request_ptr handler4);
@@ -0,0 +1,80 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// CoAP transport of the generic DatapondClient
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_coap_client_h
+#define __datapond_coap_client_h
+
+#include "coap-datapond.h"
+#include "datapond-client.h"
+
+//Use as DatapondClient<PondCoapTransport>, constructed with the server address, local and server port
+class PondCoapTransport {
+public:
+	typedef pond_token		token_type;
+	typedef CoapDatapond	client_type;
+	static constexpr uint8_t	tokenLength = TOKENID_LENGTH;
+	static constexpr uint16_t	maxWindow = TOKENID_BUFFER_SIZE;
+	static constexpr bool		binary = true;
+	static constexpr int		busyResult = TOKEN_TABLE_FULL;
+	
+	//Request results that mean try again later, every slot is taken or the TX queue is full
+	static bool	busy(int result) { return (result == TOKEN_TABLE_FULL) || (result == -1); }
+	
+private:
+	CoapDatapond	pond;
+	
+public:
+	PondCoapTransport(const char* server, int localPort, int serverPort) : pond(server, localPort, serverPort) { }
+	
+	void	begin(const char* username, const char* password, uint8_t format, uint16_t window) {
+		pond.begin(username, password, 0);
+		pond.setContentFormat(format);
+		pond.setWindow(window);
+	}
+	void	setHandlers(login_fnPtr loggedIn, create_request_ptr created, read_value_ptr read) {
+		pond.setLoginHandler(loggedIn);
+		pond.setCreateDropletHandler(created);
+		pond.setReadValueHandler(read);
+	}
+	void	run() { pond.run(); }
+	
+	int		login() { return pond.login(); }
+	int		createDroplet(int stream_id, double value) { return pond.createDroplet(stream_id, value); }
+	int		getLastDroplet(int stream_id) { return pond.getLastDroplet(stream_id); }
+	int		getStatsToday(int stream_id) { return pond.getStatsToday(stream_id); }
+	int		getStream(int stream_id) { return pond.getStream(stream_id); }
+	
+	pond_token		getLastToken() { return pond.getLastToken(); }
+	CoapDatapond*	client() { return &pond; }
+};
+
+#endif
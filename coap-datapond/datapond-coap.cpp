@@ -0,0 +1,265 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// CoAP message encoding used by the datapond client for cached request templates
+// Written originally by Embedded Adventures
+
+#include <string.h>
+#include "datapond-coap.h"
+
+int pondCoapHeader(uint8_t* buf, uint8_t type, uint8_t code, uint16_t id,
+					const uint8_t* token, uint8_t tokenLength) {
+	buf[0] = COAP_VERSION_BITS | ((type & 0x03) << 4) | (tokenLength & 0x0F);
+	buf[1] = code;
+	pondCoapMessageID(buf, id);
+	memcpy(buf + COAP_HEADER_SIZE, token, tokenLength);
+	return COAP_HEADER_SIZE + tokenLength;
+}
+
+void pondCoapMessageID(uint8_t* buf, uint16_t id) {
+	buf[2] = id >> 8;
+	buf[3] = id & 0xFF;
+}
+
+void pondCoapType(uint8_t* buf, uint8_t type) {
+	buf[0] = (buf[0] & 0xCF) | ((type & 0x03) << 4);
+}
+
+/*	Splits a delta or length into its 4 bit nibble and extended bytes	*/
+static uint8_t optionNibble(uint16_t value, uint8_t* ext, int* extLength) {
+	if (value < 13) {
+		*extLength = 0;
+		return value;
+	}
+	if (value < 269) {
+		ext[0] = value - 13;
+		*extLength = 1;
+		return 13;
+	}
+	value -= 269;
+	ext[0] = value >> 8;
+	ext[1] = value & 0xFF;
+	*extLength = 2;
+	return 14;
+}
+
+int pondCoapOption(uint8_t* buf, uint16_t delta, uint16_t len, const void* value) {
+	uint8_t deltaExt[2], lenExt[2];
+	int deltaExtLength, lenExtLength;
+	int pos = 1;
+	
+	uint8_t d = optionNibble(delta, deltaExt, &deltaExtLength);
+	uint8_t l = optionNibble(len, lenExt, &lenExtLength);
+	buf[0] = (d << 4) | l;
+	memcpy(buf + pos, deltaExt, deltaExtLength);
+	pos += deltaExtLength;
+	memcpy(buf + pos, lenExt, lenExtLength);
+	pos += lenExtLength;
+	memcpy(buf + pos, value, len);
+	return pos + len;
+}
+
+int pondCoapOptionSize(uint16_t delta, uint16_t len) {
+	int size = 1 + len;
+	size += (delta < 13) ? 0 : ((delta < 269) ? 1 : 2);
+	size += (len < 13) ? 0 : ((len < 269) ? 1 : 2);
+	return size;
+}
+
+
+/*	Reads a 4 bit option nibble and its extended bytes. Returns false on a bad nibble	*/
+static bool readNibble(const uint8_t* data, int length, int* pos, uint8_t nibble, uint16_t* value) {
+	if (nibble < 13) {
+		*value = nibble;
+		return true;
+	}
+	if (nibble == 13) {
+		if (*pos + 1 > length)
+			return false;
+		*value = data[(*pos)++] + 13;
+		return true;
+	}
+	if (nibble == 14) {
+		if (*pos + 2 > length)
+			return false;
+		*value = ((data[*pos] << 8) | data[*pos + 1]) + 269;
+		*pos += 2;
+		return true;
+	}
+	return false;
+}
+
+bool pondCoapFirstOption(pond_coap_options* it, const uint8_t* pkt, int len) {
+	it->data = pkt;
+	it->length = len;
+	it->number = 0;
+	it->pos = len;
+	if (len < COAP_HEADER_SIZE)
+		return false;
+	it->pos = COAP_HEADER_SIZE + (pkt[0] & 0x0F);
+	return pondCoapNextOption(it);
+}
+
+bool pondCoapNextOption(pond_coap_options* it) {
+	uint16_t delta, len;
+	
+	if ((it->pos >= it->length) || (it->data[it->pos] == COAP_PAYLOAD_MARKER))
+		return false;
+	uint8_t head = it->data[it->pos++];
+	if (!readNibble(it->data, it->length, &it->pos, head >> 4, &delta))
+		return false;
+	if (!readNibble(it->data, it->length, &it->pos, head & 0x0F, &len))
+		return false;
+	if (it->pos + len > it->length)
+		return false;
+	
+	it->number += delta;
+	it->value = it->data + it->pos;
+	it->valueLength = len;
+	it->pos += len;
+	return true;
+}
+
+bool pondCoapFindOption(const uint8_t* pkt, int len, uint16_t number,
+						const uint8_t** value, uint16_t* valueLength) {
+	pond_coap_options it;
+	bool more = pondCoapFirstOption(&it, pkt, len);
+	while (more && (it.number <= number)) {
+		if (it.number == number) {
+			*value = it.value;
+			*valueLength = it.valueLength;
+			return true;
+		}
+		more = pondCoapNextOption(&it);
+	}
+	return false;
+}
+
+int pondCoapPayload(const uint8_t* pkt, int len, const uint8_t** payload) {
+	pond_coap_options it;
+	bool more = pondCoapFirstOption(&it, pkt, len);
+	while (more)
+		more = pondCoapNextOption(&it);
+	//Options end at the marker or the end of the message
+	if ((it.pos >= len) || (pkt[it.pos] != COAP_PAYLOAD_MARKER))
+		return 0;
+	*payload = pkt + it.pos + 1;
+	return len - it.pos - 1;
+}
+
+uint32_t pondCoapUint(const uint8_t* value, uint16_t len) {
+	uint32_t result = 0;
+	for (uint16_t i = 0; (i < len) && (i < 4); i++)
+		result = (result << 8) | value[i];
+	return result;
+}
+
+bool pondCoapObserveFresh(uint32_t v1, uint32_t t1, uint32_t v2, uint32_t t2) {
+	//RFC 7641 section 3.4, sequence numbers compared modulo 2^24
+	if ((v1 < v2) && ((v2 - v1) < COAP_OBSERVE_WRAP))
+		return true;
+	if ((v1 > v2) && ((v1 - v2) > COAP_OBSERVE_WRAP))
+		return true;
+	return (t2 - t1) > COAP_OBSERVE_EXPIRY;
+}
+
+int pondCoapBlockOption(uint8_t* buf, uint32_t num, bool more, uint8_t szx) {
+	uint32_t value = (num << 4) | (more ? 0x08 : 0x00) | (szx & 0x07);
+	int len = 0;
+	if (value > 0xFFFF)
+		buf[len++] = (value >> 16) & 0xFF;
+	if (value > 0xFF)
+		buf[len++] = (value >> 8) & 0xFF;
+	if (value > 0)
+		buf[len++] = value & 0xFF;
+	return len;
+}
+
+void pondRtoInit(pond_rto* est, uint32_t now) {
+	memset(est, 0, sizeof(pond_rto));
+	est->rto = COAP_RTO_INITIAL;
+	est->updated = now;
+}
+
+/*	One estimator update. K is 4 for the strong estimator and 1 for the weak one	*/
+static void rtoUpdate(uint32_t* srtt, uint32_t* rttvar, uint32_t* rto, uint32_t rtt, bool first, uint8_t k) {
+	if (first) {
+		*srtt = rtt;
+		*rttvar = rtt / 2;
+	}
+	else {
+		uint32_t delta = (*srtt > rtt) ? (*srtt - rtt) : (rtt - *srtt);
+		*rttvar = *rttvar - (*rttvar / 4) + (delta / 4);
+		*srtt = *srtt - (*srtt / 8) + (rtt / 8);
+	}
+	*rto = *srtt + k * *rttvar;
+}
+
+void pondRtoSample(pond_rto* est, uint32_t rtt, bool weak, uint32_t now) {
+	//The overall estimate moves half way to a strong estimate, a quarter way to a weak one
+	if (weak) {
+		rtoUpdate(&est->weakSrtt, &est->weakRttvar, &est->weakRto, rtt, est->weakSamples == 0, 1);
+		est->weakSamples++;
+		est->rto = (est->weakRto / 4) + (est->rto - est->rto / 4);
+	}
+	else {
+		rtoUpdate(&est->strongSrtt, &est->strongRttvar, &est->strongRto, rtt, est->strongSamples == 0, 4);
+		est->strongSamples++;
+		est->rto = (est->strongRto / 2) + (est->rto / 2);
+	}
+	
+	if (est->rto < COAP_RTO_MIN)
+		est->rto = COAP_RTO_MIN;
+	if (est->rto > COAP_RTO_MAX)
+		est->rto = COAP_RTO_MAX;
+	est->updated = now;
+}
+
+void pondRtoAge(pond_rto* est, uint32_t now) {
+	uint32_t idle = now - est->updated;
+	if ((est->rto < 1000) && (idle > 16 * est->rto)) {
+		est->rto *= 2;
+		est->updated = now;
+	}
+	else if ((est->rto > 3000) && (idle > 4 * est->rto)) {
+		est->rto = (est->rto + COAP_RTO_INITIAL) / 2;
+		est->updated = now;
+	}
+}
+
+uint8_t pondCoapRetransmissions(uint32_t elapsed) {
+	//Resend n goes out COAP_ACK_TIMEOUT * (2^n - 1) after the first transmission
+	uint8_t count = 0;
+	uint32_t due = COAP_ACK_TIMEOUT;
+	while ((count < COAP_MAX_RETRANSMIT) && (elapsed >= due)) {
+		count++;
+		due += (uint32_t)COAP_ACK_TIMEOUT << count;
+	}
+	return count;
+}
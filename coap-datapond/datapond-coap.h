@@ -0,0 +1,120 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// CoAP message encoding used by the datapond client for cached request templates
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_coap_h
+#define __datapond_coap_h
+
+#include <stdint.h>
+
+#define		COAP_VERSION_BITS	0x40
+#define		COAP_HEADER_SIZE	4
+#define		COAP_PAYLOAD_MARKER	0xFF
+
+//Observe sequence numbers are 24 bits, and go stale after 128 seconds
+#define		COAP_OBSERVE_WRAP	0x00800000UL
+#define		COAP_OBSERVE_EXPIRY	128000UL
+
+//Block1 and Block2 option fields, blocks are 16 << szx bytes
+#define		COAP_BLOCK_NUM(v)	((v) >> 4)
+#define		COAP_BLOCK_MORE(v)	(((v) >> 3) & 0x01)
+#define		COAP_BLOCK_SZX(v)	((v) & 0x07)
+
+//CoCoA retransmission timeout estimation, all times in ms
+#define		COAP_RTO_INITIAL	2000
+#define		COAP_RTO_MIN		100
+#define		COAP_RTO_MAX		60000
+//The protocol's own schedule: first ACK timeout, doubled on each of up to COAP_MAX_RETRANSMIT resends
+#ifndef COAP_ACK_TIMEOUT
+#define		COAP_ACK_TIMEOUT	2000
+#endif
+#ifndef COAP_MAX_RETRANSMIT
+#define		COAP_MAX_RETRANSMIT	4
+#endif
+
+//Walks the options of a received message in place
+typedef struct {
+	const uint8_t*	data;
+	int				length;
+	int				pos;
+	uint16_t		number;
+	const uint8_t*	value;
+	uint16_t		valueLength;
+} pond_coap_options;
+
+//Strong estimates come from exchanges answered before their first retransmission, weak ones after
+typedef struct {
+	uint32_t	rto;			//Overall estimate new exchanges start from
+	uint32_t	strongSrtt;
+	uint32_t	strongRttvar;
+	uint32_t	strongRto;
+	uint32_t	weakSrtt;
+	uint32_t	weakRttvar;
+	uint32_t	weakRto;
+	uint32_t	strongSamples;
+	uint32_t	weakSamples;
+	uint32_t	updated;		//When rto last changed, for aging
+} pond_rto;
+
+//Writes the fixed header and token. Returns the bytes written
+int		pondCoapHeader(uint8_t* buf, uint8_t type, uint8_t code, uint16_t id,
+						const uint8_t* token, uint8_t tokenLength);
+//Writes the message ID into an encoded header
+void	pondCoapMessageID(uint8_t* buf, uint16_t id);
+//Writes the message type into an encoded header
+void	pondCoapType(uint8_t* buf, uint8_t type);
+//Writes one option. delta is the option number minus the previous one
+int		pondCoapOption(uint8_t* buf, uint16_t delta, uint16_t len, const void* value);
+//Bytes pondCoapOption() will need for the option
+int		pondCoapOptionSize(uint16_t delta, uint16_t len);
+
+//Option iteration. Each call leaves the current option in it
+bool	pondCoapFirstOption(pond_coap_options* it, const uint8_t* pkt, int len);
+bool	pondCoapNextOption(pond_coap_options* it);
+bool	pondCoapFindOption(const uint8_t* pkt, int len, uint16_t number,
+							const uint8_t** value, uint16_t* valueLength);
+//Points payload at the payload in pkt and returns its length, 0 if there is none
+int		pondCoapPayload(const uint8_t* pkt, int len, const uint8_t** payload);
+//Decodes an unsigned integer option value
+uint32_t	pondCoapUint(const uint8_t* value, uint16_t len);
+//Encodes a Block1 or Block2 option value into buf. Returns its length, 0 to 3 bytes
+int		pondCoapBlockOption(uint8_t* buf, uint32_t num, bool more, uint8_t szx);
+//CoCoA estimator
+void		pondRtoInit(pond_rto* est, uint32_t now);
+void		pondRtoSample(pond_rto* est, uint32_t rtt, bool weak, uint32_t now);
+//Drifts an estimate that hasn't been updated in a while back towards the initial RTO
+void		pondRtoAge(pond_rto* est, uint32_t now);
+//Retransmissions the protocol has sent by elapsed ms after the first transmission
+uint8_t		pondCoapRetransmissions(uint32_t elapsed);
+//True if notification (v2, t2 in ms) is newer than the last one delivered (v1, t1)
+bool	pondCoapObserveFresh(uint32_t v1, uint32_t t1, uint32_t v2, uint32_t t2);
+
+#endif
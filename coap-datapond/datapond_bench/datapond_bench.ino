@@ -0,0 +1,239 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*
+ * Datapond client benchmark
+ * Using: ESP12
+ * Runs a fixed number of requests against a datapond server with CoapDatapond, then with HttpDatapond
+ * without connection reuse, with it, and pipelined,
+ * and prints requests/s, p50/p99 latency and heap use per request for each call
+ * Point server at a local datapond instance to keep the WAN out of the numbers
+ * Embedded Adventures (embeddedadventures.com)
+ */
+
+#include <ESP8266WiFi.h>
+#include <coap-packet.h>
+#include <coap-protocol.h>
+#include <coap-datapond.h>
+#include <http-datapond.h>
+
+#define BENCH_REQUESTS  200   //Requests per call type
+#define BENCH_WINDOW    4     //CoAP requests kept in flight
+#define BENCH_TIMEOUT   10000 //Give up on a CoAP run after this many ms
+#define BENCH_STREAM    60971
+
+const char* ssid = "ssid";
+const char* password = "password";
+const char* server = "192.168.1.10";
+
+CoapDatapond coapPond(server, 1000, 5683);  //IPAddress, localPort, serverPort
+HttpDatapond httpPond(server, 80);
+
+unsigned long sendTime[TOKENID_BUFFER_SIZE];
+unsigned long latency[BENCH_REQUESTS];
+int completed, failed;
+bool loggedIn;
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  Serial.println("Datapond benchmark");
+
+  WiFi.begin(ssid, password);
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(500);
+    Serial.print(".");
+  }
+  Serial.println();
+
+  coapPond.begin("username", "password", 0x12);
+  coapPond.setLoginHandler(loginCallback);
+  coapPond.setCreateDropletHandler(createCallback);
+  coapPond.setReadValueHandler(readCallback);
+  coapPond.setWindow(BENCH_WINDOW);
+
+  loggedIn = false;
+  coapPond.login();
+  unsigned long start = millis();
+  while (!loggedIn && (millis() - start < BENCH_TIMEOUT))
+    coapPond.run();
+  if (!loggedIn) {
+    Serial.println("CoAP login failed");
+    return;
+  }
+
+  Serial.println("call\t\treq/s\tp50 us\tp99 us\tfailed\theap B/req");
+  runCoap("coap create", true);
+  runCoap("coap read", false);
+
+  httpPond.login("username", "password");
+  httpPond.collectCookie();
+  httpPond.setReuse(false);
+  runHttp("http no reuse", false);
+  httpPond.setReuse(true);
+  runHttp("http create", true);
+  runHttp("http read", false);
+  runHttpPipelined("http pipeline");
+  Serial.print("HTTP connections: ");
+  Serial.println(httpPond.getConnects());
+}
+
+void loop() { }
+
+/////////////////////////////////////
+//        Benchmark runs          ///
+/////////////////////////////////////
+
+void runCoap(const char* name, bool create) {
+  int sent = 0;
+  completed = 0;
+  failed = 0;
+  uint32_t heapBefore = ESP.getFreeHeap();
+  unsigned long start = micros();
+  unsigned long lastProgress = millis();
+
+  while ((completed + failed < BENCH_REQUESTS) && (millis() - lastProgress < BENCH_TIMEOUT)) {
+    if ((sent < BENCH_REQUESTS) && coapPond.readyToSend()) {
+      unsigned long now = micros();
+      int result = create ? coapPond.createDroplet(BENCH_STREAM, (double)sent) : coapPond.getLastDroplet(BENCH_STREAM);
+      if (result >= 0) {
+        //The low bits of a token are its slot, so send times can be kept per slot
+        sendTime[coapPond.getLastToken() & (TOKENID_BUFFER_SIZE - 1)] = now;
+        sent++;
+      }
+    }
+    int before = completed + failed;
+    coapPond.run();
+    if (completed + failed != before)
+      lastProgress = millis();
+  }
+  report(name, micros() - start, heapBefore);
+}
+
+void runHttp(const char* name, bool create) {
+  completed = 0;
+  failed = 0;
+  uint32_t heapBefore = ESP.getFreeHeap();
+  unsigned long start = micros();
+
+  for (int i = 0; i < BENCH_REQUESTS; i++) {
+    unsigned long now = micros();
+    int code = create ? httpPond.createDroplet(BENCH_STREAM, (double)i) : httpPond.getLastDroplet(BENCH_STREAM);
+    if ((code >= 200) && (code < 300))
+      latency[completed++] = micros() - now;
+    else
+      failed++;
+  }
+  report(name, micros() - start, heapBefore);
+}
+
+//Reads go out HTTP_PIPELINE_DEPTH at a time, latency is from the write of the pipeline
+unsigned long pipelineStart;
+
+void runHttpPipelined(const char* name) {
+  completed = 0;
+  failed = 0;
+  uint32_t heapBefore = ESP.getFreeHeap();
+  unsigned long start = micros();
+
+  for (int i = 0; i < BENCH_REQUESTS; i += HTTP_PIPELINE_DEPTH) {
+    for (int j = 0; (j < HTTP_PIPELINE_DEPTH) && (i + j < BENCH_REQUESTS); j++)
+      httpPond.queueLastDroplet(BENCH_STREAM);
+    pipelineStart = micros();
+    httpPond.sendPipeline(pipelineCallback);
+  }
+  report(name, micros() - start, heapBefore);
+}
+
+/////////////////////////////////////
+//        Reporting               ///
+/////////////////////////////////////
+
+void report(const char* name, unsigned long elapsed, uint32_t heapBefore) {
+  sortLatency();
+  long heapUsed = (long)heapBefore - (long)ESP.getFreeHeap();
+  Serial.print(name);
+  Serial.print("\t");
+  Serial.print(completed * 1000000.0 / elapsed, 1);
+  Serial.print("\t");
+  Serial.print(percentile(50));
+  Serial.print("\t");
+  Serial.print(percentile(99));
+  Serial.print("\t");
+  Serial.print(failed);
+  Serial.print("\t");
+  Serial.println(completed ? (double)heapUsed / completed : 0.0, 1);
+}
+
+void sortLatency() {
+  for (int i = 1; i < completed; i++) {
+    unsigned long key = latency[i];
+    int j = i - 1;
+    while ((j >= 0) && (latency[j] > key)) {
+      latency[j + 1] = latency[j];
+      j--;
+    }
+    latency[j + 1] = key;
+  }
+}
+
+unsigned long percentile(int p) {
+  if (completed == 0)
+    return 0;
+  return latency[(completed - 1) * p / 100];
+}
+
+/////////////////////////////////////
+//        Callback Functions      ///
+/////////////////////////////////////
+
+void finish(pond_token tkn, bool success) {
+  if (success)
+    latency[completed++] = micros() - sendTime[tkn & (TOKENID_BUFFER_SIZE - 1)];
+  else
+    failed++;
+}
+
+void pipelineCallback(uint8_t index, int code, pond_view body) {
+  if ((code >= 200) && (code < 300))
+    latency[completed++] = micros() - pipelineStart;
+  else
+    failed++;
+}
+
+void loginCallback(bool success) {
+  loggedIn = success;
+}
+
+void createCallback(pond_token tkn, bool success) {
+  finish(tkn, success);
+}
+
+void readCallback(pond_token tkn, bool success, const pond_reading* reading) {
+  finish(tkn, success);
+}
@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Transport generic client
+ * Using: ESP12
+ * Sends the A0 reading to stream 60971 every 10 seconds and reads it back.
+ * The same code runs over CoAP or HTTP, uncomment USE_HTTP to switch
+ * Embedded Adventures (embeddedadventures.com)
+ */
+
+//#define USE_HTTP
+
+#include <ESP8266WiFi.h>
+#ifdef USE_HTTP
+#include <datapond-http-client.h>
+#else
+#include <coap-packet.h>
+#include <coap-protocol.h>
+#include <datapond-coap-client.h>
+#endif
+
+#define STREAM_ID  60971
+
+#ifdef USE_HTTP
+typedef DatapondClient<PondHttpTransport> Client;
+Client pond("192.168.1.10", 80);  //IPAddress, serverPort
+#else
+typedef DatapondClient<PondCoapTransport, PondCborEncoding> Client;
+Client pond("192.168.1.10", 1000, 5683);  //IPAddress, localPort, serverPort
+#endif
+
+const char* ssid = "ssid";
+const char* password = "password";
+bool loggedIn = false;
+unsigned long lastSend;
+
+void setup() {
+  Serial.begin(115200);
+  WiFi.begin(ssid, password);
+  while (WiFi.status() != WL_CONNECTED)
+  delay(10);
+
+  pond.begin("username", "password");
+  pond.setHandlers(loginCallback, createCallback, readCallback);
+  pond.login();
+  lastSend = millis();
+}
+
+void loop() {
+  pond.run();
+  if (loggedIn && (millis() - lastSend > 10000)) {
+    lastSend = millis();
+    pond.createDroplet(STREAM_ID, (double)analogRead(A0));
+  }
+}
+
+/////////////////////////////////////
+//        Callback Functions      ///
+/////////////////////////////////////
+
+void loginCallback(bool success) {
+  loggedIn = success;
+  Serial.println(success ? "Logged in" : "Login failed");
+}
+
+void createCallback(Client::token_type tkn, bool success) {
+  if (success)
+    pond.getLastDroplet(STREAM_ID);
+}
+
+void readCallback(Client::token_type tkn, bool success, const pond_reading* reading) {
+  if (success && (reading->fields & READING_VALUE)) {
+    Serial.print("Last droplet: ");
+    Serial.println(reading->value);
+  }
+}
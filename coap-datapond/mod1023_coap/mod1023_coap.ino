@@ -31,7 +31,7 @@ THE POSSIBILITY OF SUCH DAMAGE.
  * Using: MOD1023, ESP12
  * I2C Protocol - GPIO5 = SDA, GPIO4 = SCK
  * Sends measurement data to datapond on stream 60971-60975, with power event 60981
- * Updates every 11 seconds
+ * Updates every 11 seconds, all five readings in one batch
  * Embedded Adventures (embeddedadventures.com)
  */
 
@@ -62,7 +62,7 @@ CoapDatapond datapond("api.datapond.io", 1000, 5683); //IPAddress, localPort, se
 float measurement[5]; //Temperature, humidity, pressure, tvoc, prediction
 int streams[6] = {60971, 60972, 60973, 60974, 60975, 60981}; 
 int reboot; //-1, 0, 1 == waiting for response, no need to send reboot, need to send reboot
-int loginState, nextState, secondCounter, nextStream;
+int loginState, nextState, secondCounter;
 static int loginAttempts = 0; //Max = 3
 bool updateData = false;
 long current, past;
@@ -167,7 +167,8 @@ void connectWifi() {
 void datapondTransmission() {
   //Reboot = 1 -> need to send reboot event droplet
   if (reboot == 1) {
-    if (datapond.createDroplet(streams[5], "reboot event") == -1) {
+    //The reboot droplet completes through its own delegate, not createDropletCallback
+    if (datapond.createDroplet(streams[5], "reboot event", rebootSent, &reboot) < 0) {
       nextState = CREATE_DATA;
       reboot = 1;  
     }
@@ -180,12 +181,12 @@ void datapondTransmission() {
     if (!updateData) 
       return;
     else {
-      if (datapond.createDroplet(streams[nextStream], measurement[nextStream]) == 1) {
-        TEST1("create Droplet added to txQueue");
-        nextStream++;
-        if (nextStream == 5)
-          nextStream = 0;
-      }
+      //All five readings go out in a single packet
+      datapond.beginBatch();
+      for (int i = 0; i < 5; i++)
+        datapond.addDroplet(streams[i], measurement[i]);
+      if (datapond.commitBatch() == 1)
+        TEST1("droplet batch added to txQueue");
       nextState = CREATE_DATA;
     }
   }
@@ -240,26 +241,29 @@ void loggedIn(bool login) {
     loginState = 1;
 }
 
-void createDropletCallback(uns8 tkn, bool success) {
-  if ((reboot == -1) && success) {
-    reboot = 0;
+void rebootSent(void* context, pond_token tkn, bool success, uns8 code) {
+  int* state = (int*)context;
+  if (success) {
+    *state = 0;
     nextState = CREATE_DATA;
-    nextStream = 0;
   }
-  else if ((reboot == -1) && !success) {
-    reboot = 1;
+  else {
+    *state = 1;
   }
+}
+
+void createDropletCallback(pond_token tkn, bool success) {
   if (!success) {
     Serial.println(datapond.getPayload());
     Serial.println(datapond.getCookie());
   }
 }
 
-void readDropletCallback(uns8 tkn, bool success, String data) { }
+void readDropletCallback(pond_token tkn, bool success, String data) { }
 
-void createStreamCallback(uns8 tkn, bool success) { }
+void createStreamCallback(pond_token tkn, bool success) { }
 
-void readStreamCallback(uns8 tkn, bool success, String data) {  }
+void readStreamCallback(pond_token tkn, bool success, String data) {  }
 
 
 
@@ -0,0 +1,98 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*
+ * Deep sleep node
+ * Using: ESP12, GPIO16 wired to RST
+ * Sends one droplet to stream 60971 per wake, then deep sleeps for a minute
+ * The session is kept in RTC memory, so only the first wake logs in
+ * Prints the time from boot to the droplet being acknowledged
+ * Embedded Adventures (embeddedadventures.com)
+ */
+
+#include <ESP8266WiFi.h>
+#include <coap-packet.h>
+#include <coap-protocol.h>
+#include <coap-datapond.h>
+
+#define SLEEP_TIME      60000000  //us
+#define SESSION_OFFSET  0         //RTC user memory block the session is kept at
+#define WAKE_TIMEOUT    10000
+
+const char* ssid = "ssid";
+const char* password = "password";
+
+CoapDatapond pond("192.168.1.10", 1000, 5683);  //IPAddress, localPort, serverPort
+pond_session session;
+bool sent;
+
+void setup() {
+  Serial.begin(115200);
+
+  WiFi.begin(ssid, password);
+  while (WiFi.status() != WL_CONNECTED)
+    delay(10);
+
+  pond.begin("username", "password", 0x12);
+  pond.setLoginHandler(loginCallback);
+  pond.setCreateDropletHandler(createCallback);
+
+  //A restored session sends straight away. A rejected one logs in again by itself
+  sent = false;
+  if (pondSessionLoadRtc(&session, SESSION_OFFSET) && pond.restoreSession(&session))
+    pond.createDroplet(60971, (double)analogRead(A0));
+  else
+    pond.login();
+
+  unsigned long start = millis();
+  while (!sent && (millis() - start < WAKE_TIMEOUT))
+    pond.run();
+
+  if (pond.exportSession(&session))
+    pondSessionSaveRtc(&session, SESSION_OFFSET);
+  ESP.deepSleep(SLEEP_TIME);
+}
+
+void loop() { }
+
+/////////////////////////////////////
+//        Callback Functions      ///
+/////////////////////////////////////
+
+void loginCallback(bool success) {
+  if (success)
+    pond.createDroplet(60971, (double)analogRead(A0));
+}
+
+void createCallback(pond_token tkn, bool success) {
+  sent = success;
+  Serial.print("Droplet ");
+  Serial.print(success ? "sent " : "failed ");
+  Serial.print(millis());
+  Serial.println(" ms after boot");
+}
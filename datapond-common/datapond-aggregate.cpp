@@ -0,0 +1,210 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Fixed memory windowed aggregation of samples into summary droplets
+// Written originally by Embedded Adventures
+
+#include <string.h>
+#include "datapond-aggregate.h"
+
+/*	Returns the streams[] index of a READING_ field, -1 if it can't be sent	*/
+static int fieldIndex(uint8_t field) {
+	switch (field) {
+		case READING_VALUE: return 0;
+		case READING_MIN: return 1;
+		case READING_MAX: return 2;
+		case READING_AVG: return 3;
+		case READING_COUNT: return 4;
+	}
+	return -1;
+}
+
+PondAggregator::PondAggregator(uint8_t windowKind, uint32_t windowLength, uint32_t windowStep) {
+	kind = windowKind;
+	length = windowLength;
+	step = (windowStep != 0) ? windowStep : windowLength;
+	deadband = 0;
+	memset(streams, 0, sizeof(streams));
+	next = NULL;
+	reset();
+}
+
+void PondAggregator::setStream(uint8_t field, int stream_id) {
+	int i = fieldIndex(field);
+	if (i >= 0)
+		streams[i] = stream_id;
+}
+
+int PondAggregator::getStream(uint8_t field) {
+	int i = fieldIndex(field);
+	return (i >= 0) ? streams[i] : 0;
+}
+
+void PondAggregator::setDeadband(double band) {
+	deadband = band;
+}
+
+/*	Drops every sample and forgets the last summary sent	*/
+void PondAggregator::reset() {
+	count = 0;
+	sum = 0;
+	head = 0;
+	used = 0;
+	lastEmit = 0;
+	emitted = false;
+	emittedMean = 0;
+	suppressed = 0;
+}
+
+void PondAggregator::add(double value, uint32_t now) {
+	if (kind == AGG_SLIDING) {
+		//The first step is timed from the first sample
+		if (lastEmit == 0)
+			lastEmit = now;
+		if (used == 0)
+			openStep(now);
+		pond_step* s = &steps[(head + used - 1) % AGG_SLIDING_SIZE];
+		if ((s->count == 0) || (value < s->min))
+			s->min = value;
+		if ((s->count == 0) || (value > s->max))
+			s->max = value;
+		s->sum += value;
+		s->count++;
+		last = value;
+		return;
+	}
+	
+	if (count == 0) {
+		start = now;
+		min = value;
+		max = value;
+		sum = 0;
+	}
+	if (value < min)
+		min = value;
+	if (value > max)
+		max = value;
+	sum += value;
+	last = value;
+	count++;
+}
+
+/*	Drops sliding steps that opened before the window did	*/
+void PondAggregator::expire(uint32_t now) {
+	while ((used > 0) && ((now - steps[head].start) > length)) {
+		head = (head + 1) % AGG_SLIDING_SIZE;
+		used--;
+	}
+}
+
+/*	Starts an empty step for the samples that follow. The oldest goes when the ring is full	*/
+void PondAggregator::openStep(uint32_t now) {
+	if (used == AGG_SLIDING_SIZE) {
+		head = (head + 1) % AGG_SLIDING_SIZE;
+		used--;
+	}
+	pond_step* s = &steps[(head + used) % AGG_SLIDING_SIZE];
+	memset(s, 0, sizeof(pond_step));
+	s->start = now;
+	used++;
+}
+
+bool PondAggregator::poll(uint32_t now, pond_reading* summary) {
+	if (kind == AGG_SLIDING) {
+		if ((now - lastEmit) < step)
+			return false;
+		lastEmit = now;
+		expire(now);
+		
+		count = 0;
+		sum = 0;
+		for (int i = 0; i < used; i++) {
+			pond_step* s = &steps[(head + i) % AGG_SLIDING_SIZE];
+			if (s->count == 0)
+				continue;
+			if ((count == 0) || (s->min < min))
+				min = s->min;
+			if ((count == 0) || (s->max > max))
+				max = s->max;
+			sum += s->sum;
+			count += s->count;
+		}
+		//Samples from here on belong to the next step
+		openStep(now);
+		if (count == 0)
+			return false;
+	}
+	else if ((count == 0) || ((now - start) < length)) {
+		return false;
+	}
+	
+	summary->timestamp = now;
+	bool send = summarise(summary);
+	count = 0;
+	return send;
+}
+
+/*	Fills summary from the window totals, false if the deadband holds it back	*/
+bool PondAggregator::summarise(pond_reading* summary) {
+	summary->value = last;
+	summary->min = min;
+	summary->max = max;
+	summary->avg = sum / count;
+	summary->count = count;
+	summary->fields = READING_VALUE | READING_TIMESTAMP | READING_MIN | READING_MAX | READING_AVG | READING_COUNT;
+	
+	if (emitted && (deadband > 0)) {
+		double change = summary->avg - emittedMean;
+		if ((change <= deadband) && (change >= -deadband)) {
+			suppressed++;
+			return false;
+		}
+	}
+	emitted = true;
+	emittedMean = summary->avg;
+	return true;
+}
+
+/*	Returns the stream the index-th summary field goes to, and its value. 0 if it isn't sent	*/
+int PondAggregator::output(uint8_t index, const pond_reading* summary, double* value) {
+	switch (index) {
+		case 0: *value = summary->value; break;
+		case 1: *value = summary->min; break;
+		case 2: *value = summary->max; break;
+		case 3: *value = summary->avg; break;
+		case 4: *value = summary->count; break;
+		default: return 0;
+	}
+	return streams[index];
+}
+
+/*	Returns how many windows the deadband held back	*/
+uint32_t PondAggregator::getSuppressed() {
+	return suppressed;
+}
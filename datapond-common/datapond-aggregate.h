@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Fixed memory windowed aggregation of samples into summary droplets
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_aggregate_h
+#define __datapond_aggregate_h
+
+#include <stdint.h>
+#include "datapond-config.h"
+#include "datapond-reading.h"
+
+//Window kinds
+#define		AGG_TUMBLING		0
+#define		AGG_SLIDING			1
+
+//Summary fields that can be sent, value is the last sample
+#define		AGG_FIELDS			5
+
+//Totals of the samples that arrived during one step of a sliding window
+typedef struct {
+	double		min;
+	double		max;
+	double		sum;
+	uint32_t	count;
+	uint32_t	start;		//When the step opened
+} pond_step;
+
+//Summarises samples into min/max/mean/count/last per window. A tumbling window opens on its
+//first sample and closes length ms later, a sliding one covers the last length ms every step ms.
+//Sliding windows keep totals per step rather than samples, so memory doesn't grow with the rate
+class PondAggregator {
+	friend class CoapDatapond;
+	friend class HttpDatapond;
+private:
+	uint8_t		kind;
+	uint32_t	length;
+	uint32_t	step;
+	double		deadband;
+	int			streams[AGG_FIELDS];	//Stream each summary field is sent to, 0 for none
+	
+	//Tumbling window totals
+	uint32_t	start;
+	uint32_t	count;
+	double		sum;
+	double		min;
+	double		max;
+	double		last;
+	
+	//Sliding window steps, oldest first from head. Samples go into the newest
+	pond_step	steps[AGG_SLIDING_SIZE];
+	uint8_t		head;
+	uint8_t		used;
+	uint32_t	lastEmit;
+	
+	bool		emitted;
+	double		emittedMean;
+	uint32_t	suppressed;
+	PondAggregator* next;		//Clients keep their aggregators in a list
+	
+	bool	summarise(pond_reading* summary);
+	void	expire(uint32_t now);
+	void	openStep(uint32_t now);
+	
+public:
+	PondAggregator(uint8_t windowKind, uint32_t windowLength, uint32_t windowStep = 0);
+	//Sends the READING_ field to stream_id
+	void	setStream(uint8_t field, int stream_id);
+	int		getStream(uint8_t field);
+	//Windows whose mean is within band of the last one sent are dropped, 0 sends them all
+	void	setDeadband(double band);
+	
+	void	add(double value, uint32_t now);
+	//Fills summary and returns true when a window has closed and passed the deadband
+	bool	poll(uint32_t now, pond_reading* summary);
+	void	reset();
+	//Summary fields by index, 0 to AGG_FIELDS - 1
+	int		output(uint8_t index, const pond_reading* summary, double* value);
+	uint32_t	getSuppressed();
+};
+
+#endif
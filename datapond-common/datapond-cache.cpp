@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Fixed size cache of read responses, revalidated with their ETag once stale
+// Written originally by Embedded Adventures
+
+#include <string.h>
+#include "datapond-cache.h"
+
+uint32_t pondCacheKey(const void* data, uint16_t len, uint32_t seed) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint32_t hash = (seed != 0) ? seed : 2166136261UL;
+	for (uint16_t i = 0; i < len; i++)
+		hash = (hash ^ bytes[i]) * 16777619UL;
+	return (hash != 0) ? hash : 1;
+}
+
+PondCache::PondCache() {
+	ttl = CACHE_TTL;
+	clear();
+}
+
+void PondCache::setTtl(uint32_t ms) {
+	ttl = ms;
+}
+
+/*	Drops every entry and zeroes the counters	*/
+void PondCache::clear() {
+	for (int i = 0; i < CACHE_ENTRIES; i++)
+		entries[i].key = 0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+pond_cache_entry* PondCache::find(const void* request, uint8_t length) {
+	if (length > CACHE_REQUEST_SIZE)
+		return NULL;
+	uint32_t key = pondCacheKey(request, length);
+	for (int i = 0; i < CACHE_ENTRIES; i++) {
+		if ((entries[i].key == key) && (entries[i].requestLength == length)
+				&& (memcmp(entries[i].request, request, length) == 0))
+			return &entries[i];
+	}
+	return NULL;
+}
+
+bool PondCache::isFresh(const pond_cache_entry* entry, uint32_t now) {
+	return (now - entry->stored) < ttl;
+}
+
+void PondCache::hit(pond_cache_entry* entry, uint32_t now) {
+	entry->used = now;
+	stats.hits++;
+	stats.bytesSaved += entry->bodyLength;
+}
+
+void PondCache::validated(pond_cache_entry* entry, uint32_t now) {
+	entry->stored = now;
+	entry->used = now;
+	stats.validated++;
+	stats.bytesSaved += entry->bodyLength;
+}
+
+void PondCache::miss() {
+	stats.misses++;
+}
+
+void PondCache::store(const void* request, uint8_t length, const uint8_t* etag, uint8_t etagLength,
+					const char* body, uint16_t bodyLength, uint8_t format, uint32_t now) {
+	if (length > CACHE_REQUEST_SIZE)
+		return;
+	pond_cache_entry* entry = find(request, length);
+	if (bodyLength > CACHE_BODY_SIZE) {
+		if (entry != NULL)
+			entry->key = 0;
+		return;
+	}
+	//An ETag too long to keep can't be sent back, so the entry lives for the TTL only
+	if ((etag == NULL) || (etagLength > CACHE_ETAG_SIZE))
+		etagLength = 0;
+	
+	//A free entry, or else the one least recently used
+	if (entry == NULL) {
+		entry = &entries[0];
+		for (int i = 0; i < CACHE_ENTRIES; i++) {
+			if (entries[i].key == 0) {
+				entry = &entries[i];
+				break;
+			}
+			if ((now - entries[i].used) > (now - entry->used))
+				entry = &entries[i];
+		}
+	}
+	entry->key = pondCacheKey(request, length);
+	entry->requestLength = length;
+	memcpy(entry->request, request, length);
+	entry->stored = now;
+	entry->used = now;
+	entry->format = format;
+	entry->etagLength = etagLength;
+	entry->bodyLength = bodyLength;
+	if (etagLength > 0)
+		memcpy(entry->etag, etag, etagLength);
+	memcpy(entry->body, body, bodyLength);
+}
+
+void PondCache::invalidate(const void* request, uint8_t length) {
+	pond_cache_entry* entry = find(request, length);
+	if (entry != NULL)
+		entry->key = 0;
+}
+
+/*	Drops every entry whose request starts with prefix	*/
+void PondCache::invalidatePrefix(const void* prefix, uint8_t length) {
+	for (int i = 0; i < CACHE_ENTRIES; i++) {
+		if ((entries[i].key != 0) && (entries[i].requestLength >= length) && (memcmp(entries[i].request, prefix, length) == 0))
+			entries[i].key = 0;
+	}
+}
+
+const pond_cache_stats* PondCache::getStats() {
+	return &stats;
+}
@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Fixed size cache of read responses, revalidated with their ETag once stale
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_cache_h
+#define __datapond_cache_h
+
+#include <stdint.h>
+#include "datapond-config.h"
+
+//Longest ETag kept. CoAP ETags are at most 8 bytes, HTTP ones are quoted text
+#define		CACHE_ETAG_SIZE		48
+//Longest request kept with its response, longer requests aren't cached
+#define		CACHE_REQUEST_SIZE	64
+//ms a response is used without asking the server
+#define		CACHE_TTL			60000
+
+typedef struct {
+	uint32_t	key;			//pondCacheKey() of the request, 0 when the entry is free
+	uint8_t		requestLength;
+	uint8_t		request[CACHE_REQUEST_SIZE];	//Compared on a key match, as different requests can share a key
+	uint32_t	stored;			//When the server last sent or confirmed it
+	uint32_t	used;
+	uint8_t		format;
+	uint8_t		etagLength;		//0 when the server sent none, the entry then lives for the TTL only
+	uint16_t	bodyLength;
+	uint8_t		etag[CACHE_ETAG_SIZE];
+	char		body[CACHE_BODY_SIZE];
+} pond_cache_entry;
+
+typedef struct {
+	uint32_t	hits;			//Served without asking the server
+	uint32_t	validated;		//Server confirmed the entry with a header-only reply
+	uint32_t	misses;
+	uint32_t	bytesSaved;		//Body bytes not sent by the server
+} pond_cache_stats;
+
+class PondCache {
+private:
+	pond_cache_entry	entries[CACHE_ENTRIES];
+	pond_cache_stats	stats;
+	uint32_t			ttl;
+	
+public:
+	PondCache();
+	void	setTtl(uint32_t ms);
+	void	clear();
+	
+	//Entry for the request, or NULL. A fresh entry can be served as is, a stale one revalidated with its ETag.
+	//A request is its URI, or whatever else identifies it
+	pond_cache_entry*	find(const void* request, uint8_t length);
+	bool	isFresh(const pond_cache_entry* entry, uint32_t now);
+	//Serves a fresh entry, or one the server confirmed, and counts it
+	void	hit(pond_cache_entry* entry, uint32_t now);
+	void	validated(pond_cache_entry* entry, uint32_t now);
+	//Keeps a full response. Bodies too big to keep drop the request's entry instead
+	void	store(const void* request, uint8_t length, const uint8_t* etag, uint8_t etagLength,
+					const char* body, uint16_t bodyLength, uint8_t format, uint32_t now);
+	void	miss();
+	void	invalidate(const void* request, uint8_t length);
+	void	invalidatePrefix(const void* prefix, uint8_t length);
+	
+	const pond_cache_stats* getStats();
+};
+
+//Key entries are looked up by, FNV-1a over the request. Never 0
+uint32_t	pondCacheKey(const void* data, uint16_t len, uint32_t seed = 0);
+
+#endif
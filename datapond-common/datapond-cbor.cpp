@@ -0,0 +1,384 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Compact CBOR encoder and decoder working directly on packet buffers
+// Written originally by Embedded Adventures
+
+#include <string.h>
+#include <math.h>
+#include "datapond-cbor.h"
+
+////////////////////////////////////////////////////////
+////                Encoder                         ////
+////////////////////////////////////////////////////////
+
+PondCborWriter::PondCborWriter(uint8_t* buffer, uint16_t capacity) {
+	buf = buffer;
+	size = capacity;
+	len = 0;
+	overflow = false;
+}
+
+void PondCborWriter::writeByte(uint8_t b) {
+	if (len < size)
+		buf[len++] = b;
+	else
+		overflow = true;
+}
+
+/*	Writes a major type with its argument in the shortest form	*/
+void PondCborWriter::writeHead(uint8_t major, uint32_t value) {
+	major <<= 5;
+	if (value < 24) {
+		writeByte(major | value);
+	}
+	else if (value <= 0xFF) {
+		writeByte(major | 24);
+		writeByte(value);
+	}
+	else if (value <= 0xFFFF) {
+		writeByte(major | 25);
+		writeByte(value >> 8);
+		writeByte(value);
+	}
+	else {
+		writeByte(major | 26);
+		writeByte(value >> 24);
+		writeByte(value >> 16);
+		writeByte(value >> 8);
+		writeByte(value);
+	}
+}
+
+void PondCborWriter::beginArray(uint16_t count) {
+	writeHead(CBOR_ARRAY, count);
+}
+
+void PondCborWriter::beginArray() {
+	writeByte((CBOR_ARRAY << 5) | 31);
+}
+
+void PondCborWriter::beginMap(uint16_t pairs) {
+	writeHead(CBOR_MAP, pairs);
+}
+
+void PondCborWriter::end() {
+	writeByte(CBOR_BREAK);
+}
+
+void PondCborWriter::writeUnsigned(uint32_t value) {
+	writeHead(CBOR_UNSIGNED, value);
+}
+
+void PondCborWriter::writeInt(int32_t value) {
+	if (value < 0)
+		writeHead(CBOR_NEGATIVE, (uint32_t)(-(value + 1)));
+	else
+		writeHead(CBOR_UNSIGNED, value);
+}
+
+void PondCborWriter::writeDouble(double value) {
+	float single = (float)value;
+	uint8_t bytes[8];
+	
+	if ((double)single == value || isnan(value)) {
+		memcpy(bytes, &single, 4);
+		writeByte(0xFA);
+		for (int i = 3; i >= 0; i--)
+			writeByte(bytes[i]);
+	}
+	else {
+		memcpy(bytes, &value, 8);
+		writeByte(0xFB);
+		for (int i = 7; i >= 0; i--)
+			writeByte(bytes[i]);
+	}
+}
+
+void PondCborWriter::writeText(const char* text) {
+	writeText(text, strlen(text));
+}
+
+void PondCborWriter::writeText(const char* text, uint16_t textLength) {
+	writeHead(CBOR_TEXT, textLength);
+	if (len + textLength > size) {
+		overflow = true;
+		return;
+	}
+	memcpy(buf + len, text, textLength);
+	len += textLength;
+}
+
+uint16_t PondCborWriter::length() {
+	return len;
+}
+
+/*	False if anything was cut off for lack of space	*/
+bool PondCborWriter::ok() {
+	return !overflow;
+}
+
+
+////////////////////////////////////////////////////////
+////                Decoder                         ////
+////////////////////////////////////////////////////////
+
+PondCborReader::PondCborReader(const uint8_t* buffer, uint16_t length) {
+	data = buffer;
+	len = length;
+	pos = 0;
+}
+
+/*	Reads a head byte and its argument. Indefinite lengths give info 31	*/
+bool PondCborReader::readHead(uint8_t* major, uint8_t* info, uint32_t* value) {
+	if (pos >= len)
+		return false;
+	*major = data[pos] >> 5;
+	*info = data[pos] & 0x1F;
+	pos++;
+	
+	int extra = 0;
+	if (*info < 24) {
+		*value = *info;
+		return true;
+	}
+	if (*info == 31) {
+		*value = 0;
+		return true;
+	}
+	switch (*info) {
+		case 24: extra = 1; break;
+		case 25: extra = 2; break;
+		case 26: extra = 4; break;
+		case 27: extra = 8; break;
+		default: return false;
+	}
+	if (pos + extra > len)
+		return false;
+	//Only the low 32 bits of an 8 byte argument are kept
+	*value = 0;
+	for (int i = 0; i < extra; i++)
+		*value = (*value << 8) | data[pos++];
+	return true;
+}
+
+int PondCborReader::peekType() {
+	if (pos >= len)
+		return -1;
+	return data[pos] >> 5;
+}
+
+bool PondCborReader::atBreak() {
+	if ((pos < len) && (data[pos] == CBOR_BREAK)) {
+		pos++;
+		return true;
+	}
+	return false;
+}
+
+bool PondCborReader::readArray(uint16_t* count) {
+	uint8_t major, info;
+	uint32_t value;
+	if (!readHead(&major, &info, &value) || (major != CBOR_ARRAY))
+		return false;
+	*count = (info == 31) ? CBOR_INDEFINITE : value;
+	return true;
+}
+
+bool PondCborReader::readMap(uint16_t* pairs) {
+	uint8_t major, info;
+	uint32_t value;
+	if (!readHead(&major, &info, &value) || (major != CBOR_MAP))
+		return false;
+	*pairs = (info == 31) ? CBOR_INDEFINITE : value;
+	return true;
+}
+
+/*	Points text at the string inside the buffer, nothing is copied	*/
+bool PondCborReader::readText(const char** text, uint16_t* textLength) {
+	uint8_t major, info;
+	uint32_t value;
+	if (!readHead(&major, &info, &value) || (major != CBOR_TEXT) || (info == 31))
+		return false;
+	if (pos + value > len)
+		return false;
+	*text = (const char*)(data + pos);
+	*textLength = value;
+	pos += value;
+	return true;
+}
+
+/*	Reads any integer or float as a double	*/
+bool PondCborReader::readNumber(double* number) {
+	uint8_t major, info;
+	uint32_t value;
+	uint16_t start = pos;
+	
+	if (pos >= len)
+		return false;
+	if (data[pos] == 0xF9) {
+		if (pos + 3 > len)
+			return false;
+		uint16_t half = (data[pos + 1] << 8) | data[pos + 2];
+		int exponent = (half >> 10) & 0x1F;
+		double mantissa = half & 0x3FF;
+		if (exponent == 0)
+			*number = ldexp(mantissa, -24);
+		else if (exponent == 31)
+			*number = (mantissa == 0) ? INFINITY : NAN;
+		else
+			*number = ldexp(mantissa + 1024, exponent - 25);
+		if (half & 0x8000)
+			*number = -*number;
+		pos += 3;
+		return true;
+	}
+	if (data[pos] == 0xFA) {
+		uint8_t bytes[4];
+		float single;
+		if (pos + 5 > len)
+			return false;
+		for (int i = 0; i < 4; i++)
+			bytes[i] = data[pos + 4 - i];
+		memcpy(&single, bytes, 4);
+		*number = single;
+		pos += 5;
+		return true;
+	}
+	if (data[pos] == 0xFB) {
+		uint8_t bytes[8];
+		if (pos + 9 > len)
+			return false;
+		for (int i = 0; i < 8; i++)
+			bytes[i] = data[pos + 8 - i];
+		memcpy(number, bytes, 8);
+		pos += 9;
+		return true;
+	}
+	if (!readHead(&major, &info, &value))
+		return false;
+	if (major == CBOR_UNSIGNED)
+		*number = value;
+	else if (major == CBOR_NEGATIVE)
+		*number = -1.0 - value;
+	else {
+		pos = start;
+		return false;
+	}
+	return true;
+}
+
+bool PondCborReader::readUnsigned(uint32_t* value) {
+	uint8_t major, info;
+	uint16_t start = pos;
+	if (!readHead(&major, &info, value) || (major != CBOR_UNSIGNED)) {
+		pos = start;
+		return false;
+	}
+	return true;
+}
+
+/*	Steps over one complete item, including everything nested in it	*/
+bool PondCborReader::skip() {
+	uint8_t major, info;
+	uint32_t value;
+	
+	if (!readHead(&major, &info, &value))
+		return false;
+	switch (major) {
+		case CBOR_BYTES:
+		case CBOR_TEXT:
+			if (info == 31) {
+				while (!atBreak()) {
+					if (!skip())
+						return false;
+				}
+				return true;
+			}
+			if (pos + value > len)
+				return false;
+			pos += value;
+			return true;
+		case CBOR_ARRAY:
+		case CBOR_MAP: {
+			uint32_t items = (major == CBOR_MAP) ? value * 2 : value;
+			if (info == 31) {
+				while (!atBreak()) {
+					if (!skip())
+						return false;
+				}
+				return true;
+			}
+			for (uint32_t i = 0; i < items; i++) {
+				if (!skip())
+					return false;
+			}
+			return true;
+		}
+		case CBOR_TAG:
+			return skip();
+		default:
+			return true;
+	}
+}
+
+uint16_t PondCborReader::position() {
+	return pos;
+}
+
+bool pondCborReading(const uint8_t* data, uint16_t len, pond_reading* reading) {
+	PondCborReader reader(data, len);
+	uint16_t pairs;
+	
+	memset(reading, 0, sizeof(pond_reading));
+	if (reader.peekType() == CBOR_ARRAY) {
+		uint16_t count;
+		if (!reader.readArray(&count) || (count == 0))
+			return false;
+	}
+	if (!reader.readMap(&pairs))
+		return false;
+	
+	for (uint16_t i = 0; (pairs == CBOR_INDEFINITE) || (i < pairs); i++) {
+		const char* key;
+		uint16_t keyLength;
+		double number;
+		
+		if ((pairs == CBOR_INDEFINITE) && reader.atBreak())
+			break;
+		if (!reader.readText(&key, &keyLength))
+			return false;
+		uint8_t field = pondReadingField(key, keyLength);
+		if ((field != 0) && reader.readNumber(&number))
+			pondReadingSet(reading, field, number);
+		else if (!reader.skip())
+			return false;
+	}
+	return (reading->fields != 0);
+}
@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Compact CBOR encoder and decoder working directly on packet buffers
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_cbor_h
+#define __datapond_cbor_h
+
+#include <stdint.h>
+#include "datapond-reading.h"
+
+//Major types
+#define		CBOR_UNSIGNED		0
+#define		CBOR_NEGATIVE		1
+#define		CBOR_BYTES			2
+#define		CBOR_TEXT			3
+#define		CBOR_ARRAY			4
+#define		CBOR_MAP			5
+#define		CBOR_TAG			6
+#define		CBOR_SIMPLE			7
+
+#define		CBOR_BREAK			0xFF
+//Count returned for indefinite length arrays and maps
+#define		CBOR_INDEFINITE		0xFFFF
+
+class PondCborWriter {
+private:
+	uint8_t*	buf;
+	uint16_t	size;
+	uint16_t	len;
+	bool		overflow;
+	
+	void	writeHead(uint8_t major, uint32_t value);
+	void	writeByte(uint8_t b);
+	
+public:
+	PondCborWriter(uint8_t* buffer, uint16_t capacity);
+	
+	void	beginArray(uint16_t count);
+	void	beginArray();				//Indefinite, closed by end()
+	void	beginMap(uint16_t pairs);
+	void	end();
+	void	writeUnsigned(uint32_t value);
+	void	writeInt(int32_t value);
+	void	writeDouble(double value);	//Single precision when no precision is lost
+	void	writeText(const char* text);
+	void	writeText(const char* text, uint16_t textLength);
+	
+	uint16_t	length();
+	bool		ok();
+};
+
+class PondCborReader {
+private:
+	const uint8_t*	data;
+	uint16_t		len;
+	uint16_t		pos;
+	
+	bool	readHead(uint8_t* major, uint8_t* info, uint32_t* value);
+	
+public:
+	PondCborReader(const uint8_t* buffer, uint16_t length);
+	
+	int		peekType();					//-1 at the end of the data
+	bool	atBreak();					//Consumes the break if there is one
+	bool	readArray(uint16_t* count);
+	bool	readMap(uint16_t* pairs);
+	bool	readText(const char** text, uint16_t* textLength);
+	bool	readNumber(double* number);
+	bool	readUnsigned(uint32_t* value);
+	bool	skip();
+	
+	uint16_t	position();
+};
+
+//Decodes a droplet or stats map. An array is read from its first element
+bool	pondCborReading(const uint8_t* data, uint16_t len, pond_reading* reading);
+
+#endif
@@ -0,0 +1,147 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Transport generic datapond client, resolved at compile time
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_client_h
+#define __datapond_client_h
+
+#include <stdint.h>
+#include "datapond-reading.h"
+
+//createDroplet result when the transport was busy and the droplet waits in the outbox.
+//run() sends it once there is room, its token reaches the handlers as usual
+#define		DROPLET_DEFERRED	-20
+
+//Payload encodings. format is the CoAP content format the transport is set to.
+//Text values go as text/plain over CoAP, HTTP bodies are JSON either way
+struct PondTextEncoding {
+	static constexpr uint8_t	format = 0;
+	static constexpr bool		binary = false;
+};
+
+struct PondCborEncoding {
+	static constexpr uint8_t	format = 60;
+	static constexpr bool		binary = true;
+};
+
+//Sizes a deployment is built for. Derive from it and override what differs
+struct PondDefaultConfig {
+	static constexpr uint8_t	tokenLength = 4;		//Bytes, must match the transport's build
+	static constexpr uint16_t	window = 4;				//Requests in flight at once
+	static constexpr uint8_t	outbox = 4;				//Droplets held while the transport is busy
+};
+
+//One client API over any transport. Transport, Encoding and Config are resolved at
+//compile time, so calls go straight to the transport and nothing else is linked in.
+//Every request is asynchronous: it returns >= 0 once queued, and completes through
+//the handlers from run(). Config sets the window and sizes the outbox droplets wait in
+//while the transport is busy. Transports are PondCoapTransport and PondHttpTransport
+template <class Transport, class Encoding = PondTextEncoding, class Config = PondDefaultConfig>
+class DatapondClient {
+	static_assert(Config::tokenLength == Transport::tokenLength, "Config::tokenLength doesn't match the transport's token width");
+	static_assert(Config::window <= Transport::maxWindow, "Config::window is bigger than the transport can keep in flight");
+	static_assert(!Encoding::binary || Transport::binary, "The transport has no binary encoding");
+	static_assert(Config::outbox > 0, "Config::outbox must hold at least one droplet");
+	
+public:
+	typedef typename Transport::token_type	token_type;
+	typedef void (*login_fn)(bool status);
+	typedef void (*result_fn)(token_type tkn, bool status);
+	typedef void (*reading_fn)(token_type tkn, bool status, const pond_reading* reading);
+	
+private:
+	Transport	transport;
+	
+	//Droplets the transport turned away, oldest first
+	struct outbox_droplet {
+		int		stream_id;
+		double	value;
+	};
+	outbox_droplet	outbox[Config::outbox];
+	uint8_t			outboxHead = 0;
+	uint8_t			outboxCount = 0;
+	
+	void	flushOutbox() {
+		while (outboxCount > 0) {
+			outbox_droplet* droplet = &outbox[outboxHead];
+			if (Transport::busy(transport.createDroplet(droplet->stream_id, droplet->value)))
+				return;
+			outboxHead = (outboxHead + 1) % Config::outbox;
+			outboxCount--;
+		}
+	}
+	
+public:
+	//Arguments are the transport's own, server address and ports
+	template <typename... Args>
+	DatapondClient(Args... args) : transport(args...) { }
+	
+	void	begin(const char* username, const char* password) {
+		transport.begin(username, password, Encoding::format, Config::window);
+	}
+	void	setHandlers(login_fn loggedIn, result_fn created, reading_fn read) {
+		transport.setHandlers(loggedIn, created, read);
+	}
+	void	run() {
+		transport.run();
+		flushOutbox();
+	}
+	
+	int		login() { return transport.login(); }
+	//Returns DROPLET_DEFERRED if it waits in the outbox, and the transport's busy result once that's full
+	int		createDroplet(int stream_id, double value) {
+		//Droplets keep their order, nothing overtakes the outbox
+		if (outboxCount == 0) {
+			int result = transport.createDroplet(stream_id, value);
+			if (!Transport::busy(result))
+				return result;
+		}
+		if (outboxCount == Config::outbox)
+			return Transport::busyResult;
+		outbox_droplet* droplet = &outbox[(outboxHead + outboxCount) % Config::outbox];
+		droplet->stream_id = stream_id;
+		droplet->value = value;
+		outboxCount++;
+		return DROPLET_DEFERRED;
+	}
+	int		getLastDroplet(int stream_id) { return transport.getLastDroplet(stream_id); }
+	int		getStatsToday(int stream_id) { return transport.getStatsToday(stream_id); }
+	int		getStream(int stream_id) { return transport.getStream(stream_id); }
+	
+	//Token of the request just queued, as handed to the handlers
+	token_type	getLastToken() { return transport.getLastToken(); }
+	//Droplets waiting in the outbox
+	uint8_t		getDeferred() { return outboxCount; }
+	//The client underneath, for what only one transport offers
+	typename Transport::client_type*	getTransport() { return transport.client(); }
+};
+
+#endif
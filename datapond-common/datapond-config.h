@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Build sizes of the datapond library, shared by the library and every sketch using it
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_config_h
+#define __datapond_config_h
+
+//These set the layout of the client classes. The library is compiled apart from the sketch,
+//so they are changed here and nowhere else. A sketch defining one of them would see the
+//classes laid out differently from the library it links against
+
+////////////////////////////////////////////////////////
+////			CoAP client						 	////
+////////////////////////////////////////////////////////
+
+//Token width in bytes, 1 to 8
+#define		TOKENID_LENGTH		4
+//Pending request slots, must be a power of two
+#define		TOKENID_BUFFER_SIZE	16
+//Largest batch payload, sent block-wise if it's bigger than BLOCK_SIZE
+#define		BATCH_PAYLOAD_SIZE	256
+//Block size asked of the server and used for uploads, blocks are 16 << BLOCK_SZX bytes
+#define		BLOCK_SZX			4
+//Longest username or password kept by begin(), and the session cookie
+#define		CREDENTIAL_SIZE		48
+//Streams that can have a delivery policy of their own, the rest are sent confirmable
+#define		DELIVERY_POLICY_SIZE	4
+
+////////////////////////////////////////////////////////
+////			HTTP client						 	////
+////////////////////////////////////////////////////////
+
+//Requests that can be written ahead of their responses
+#define		HTTP_PIPELINE_DEPTH		4
+//Space for the queued requests, headers and body
+#define		HTTP_REQUEST_BUFFER_SIZE	768
+//Longest request path and body. Longer ones are cut short
+#define		HTTP_URL_SIZE			96
+#define		HTTP_BODY_SIZE			160
+
+////////////////////////////////////////////////////////
+////			Shared							 	////
+////////////////////////////////////////////////////////
+
+//Steps a sliding aggregation window holds totals for, so it can be up to this many steps long
+#define		AGG_SLIDING_SIZE	16
+//Cached responses, and the largest body kept
+#define		CACHE_ENTRIES		4
+#define		CACHE_BODY_SIZE		192
+//Bytes a packed series is built in
+#define		SERIES_BUFFER_SIZE	128
+//Set to 0 to compile the metrics out of both clients
+#define		POND_METRICS		1
+
+#endif
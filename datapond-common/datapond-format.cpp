@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Number formatting for datapond requests without heap allocation
+// Written originally by Embedded Adventures
+
+#include <math.h>
+#include <string.h>
+#include "datapond-format.h"
+
+/*	Writes digits of value right to left, then moves them to the front of buf	*/
+static int formatDigits(char* buf, uint64_t value, int minDigits) {
+	char digits[24];
+	int count = 0;
+	do {
+		digits[count++] = '0' + (value % 10);
+		value /= 10;
+	} while ((value > 0) || (count < minDigits));
+	for (int i = 0; i < count; i++)
+		buf[i] = digits[count - 1 - i];
+	buf[count] = '\0';
+	return count;
+}
+
+int pondFormatInt(char* buf, int32_t value) {
+	if (value < 0) {
+		buf[0] = '-';
+		return 1 + formatDigits(buf + 1, (uint64_t)(-(int64_t)value), 1);
+	}
+	return formatDigits(buf, value, 1);
+}
+
+int pondFormatUnsigned(char* buf, uint32_t value) {
+	return formatDigits(buf, value, 1);
+}
+
+/*	Same output as String(double, decimals). Very large values fall back to exponent form	*/
+int pondFormatDouble(char* buf, double value, uint8_t decimals) {
+	int len = 0;
+	uint64_t scale = 1;
+	
+	if (decimals > 9)
+		decimals = 9;
+	if (isnan(value)) {
+		strcpy(buf, "nan");
+		return 3;
+	}
+	if (value < 0) {
+		buf[len++] = '-';
+		value = -value;
+	}
+	if (isinf(value)) {
+		strcpy(buf + len, "inf");
+		return len + 3;
+	}
+	
+	for (uint8_t i = 0; i < decimals; i++)
+		scale *= 10;
+	
+	if (value * scale >= 1.8e19) {
+		int exponent = (int)floor(log10(value));
+		len += pondFormatDouble(buf + len, value / pow(10, exponent), decimals);
+		buf[len++] = 'e';
+		return len + pondFormatInt(buf + len, exponent);
+	}
+	
+	uint64_t scaled = (uint64_t)(value * scale + 0.5);
+	len += formatDigits(buf + len, scaled / scale, 1);
+	if (decimals > 0) {
+		buf[len++] = '.';
+		len += formatDigits(buf + len, scaled % scale, decimals);
+	}
+	return len;
+}
+
+int pondAppend(char* buf, int len, int size, const char* text) {
+	while ((*text != '\0') && (len < size - 1))
+		buf[len++] = *text++;
+	buf[len] = '\0';
+	return len;
+}
@@ -0,0 +1,199 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// In place JSON tokenizer for datapond responses
+// Written originally by Embedded Adventures
+
+#include <string.h>
+#include <math.h>
+#include "datapond-json.h"
+
+PondJsonReader::PondJsonReader(const char* buffer, uint16_t length) {
+	data = buffer;
+	len = length;
+	pos = 0;
+	depth = 0;
+	inObject[0] = false;
+}
+
+void PondJsonReader::skipSpace() {
+	while ((pos < len) && ((data[pos] == ' ') || (data[pos] == '\t') ||
+			(data[pos] == '\r') || (data[pos] == '\n') || (data[pos] == ',')))
+		pos++;
+}
+
+/*	Reads a quoted string. Escapes are stepped over, not decoded	*/
+bool PondJsonReader::readString(pond_view* view) {
+	if ((pos >= len) || (data[pos] != '"'))
+		return false;
+	uint16_t start = ++pos;
+	while ((pos < len) && (data[pos] != '"')) {
+		if (data[pos] == '\\')
+			pos++;
+		pos++;
+	}
+	if (pos >= len)
+		return false;
+	view->ptr = data + start;
+	view->len = pos - start;
+	pos++;
+	return true;
+}
+
+/*	Returns the type of the next token and fills in token. JSON_END when the buffer is used up	*/
+uint8_t PondJsonReader::next(pond_json_token* token) {
+	token->key.ptr = NULL;
+	token->key.len = 0;
+	token->value.ptr = NULL;
+	token->value.len = 0;
+	token->type = JSON_ERROR;
+	
+	skipSpace();
+	//A null terminator ends the document too
+	if ((pos >= len) || (data[pos] == '\0')) {
+		token->type = JSON_END;
+		token->depth = depth;
+		return JSON_END;
+	}
+	
+	if (inObject[depth] && (data[pos] != '}')) {
+		if (!readString(&token->key))
+			return JSON_ERROR;
+		skipSpace();
+		if ((pos >= len) || (data[pos] != ':'))
+			return JSON_ERROR;
+		pos++;
+		skipSpace();
+		if (pos >= len)
+			return JSON_ERROR;
+	}
+	token->depth = depth;
+	
+	char c = data[pos];
+	if ((c == '{') || (c == '[')) {
+		if (depth + 1 >= JSON_MAX_DEPTH)
+			return JSON_ERROR;
+		pos++;
+		inObject[++depth] = (c == '{');
+		token->type = (c == '{') ? JSON_OBJECT : JSON_ARRAY;
+	}
+	else if ((c == '}') || (c == ']')) {
+		if (depth == 0)
+			return JSON_ERROR;
+		pos++;
+		depth--;
+		token->depth = depth;
+		token->type = (c == '}') ? JSON_OBJECT_END : JSON_ARRAY_END;
+	}
+	else if (c == '"') {
+		if (!readString(&token->value))
+			return JSON_ERROR;
+		token->type = JSON_STRING;
+	}
+	else {
+		//Numbers and literals run to the next delimiter
+		uint16_t start = pos;
+		while ((pos < len) && (data[pos] != ',') && (data[pos] != '}') && (data[pos] != ']') &&
+				(data[pos] != ' ') && (data[pos] != '\r') && (data[pos] != '\n') && (data[pos] != '\0'))
+			pos++;
+		token->value.ptr = data + start;
+		token->value.len = pos - start;
+		if (pondViewEquals(token->value, "true"))
+			token->type = JSON_TRUE;
+		else if (pondViewEquals(token->value, "false"))
+			token->type = JSON_FALSE;
+		else if (pondViewEquals(token->value, "null"))
+			token->type = JSON_NULL;
+		else if ((c == '-') || ((c >= '0') && (c <= '9')))
+			token->type = JSON_NUMBER;
+		else
+			return JSON_ERROR;
+	}
+	return token->type;
+}
+
+bool pondViewEquals(pond_view view, const char* text) {
+	return (strlen(text) == view.len) && (memcmp(view.ptr, text, view.len) == 0);
+}
+
+/*	Parses number text without needing a terminator	*/
+double pondViewNumber(pond_view view) {
+	double result = 0;
+	double scale = 1;
+	bool negative = false;
+	uint16_t i = 0;
+	
+	if ((i < view.len) && ((view.ptr[i] == '-') || (view.ptr[i] == '+')))
+		negative = (view.ptr[i++] == '-');
+	while ((i < view.len) && (view.ptr[i] >= '0') && (view.ptr[i] <= '9'))
+		result = result * 10 + (view.ptr[i++] - '0');
+	if ((i < view.len) && (view.ptr[i] == '.')) {
+		i++;
+		while ((i < view.len) && (view.ptr[i] >= '0') && (view.ptr[i] <= '9')) {
+			scale /= 10;
+			result += (view.ptr[i++] - '0') * scale;
+		}
+	}
+	if ((i < view.len) && ((view.ptr[i] == 'e') || (view.ptr[i] == 'E'))) {
+		pond_view exponent = {view.ptr + i + 1, (uint16_t)(view.len - i - 1)};
+		result *= pow(10, pondViewNumber(exponent));
+	}
+	return negative ? -result : result;
+}
+
+bool pondJsonFind(const char* data, uint16_t len, const char* key, pond_view* value) {
+	PondJsonReader reader(data, len);
+	pond_json_token token;
+	uint8_t type;
+	
+	while (((type = reader.next(&token)) != JSON_END) && (type != JSON_ERROR)) {
+		if (((type == JSON_STRING) || (type == JSON_NUMBER)) && pondViewEquals(token.key, key)) {
+			*value = token.value;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*	Takes the first occurrence of each field. Numbers sent as strings are accepted	*/
+bool pondJsonReading(const char* data, uint16_t len, pond_reading* reading) {
+	PondJsonReader reader(data, len);
+	pond_json_token token;
+	uint8_t type;
+	
+	memset(reading, 0, sizeof(pond_reading));
+	while (((type = reader.next(&token)) != JSON_END) && (type != JSON_ERROR)) {
+		if ((type != JSON_NUMBER) && (type != JSON_STRING))
+			continue;
+		uint8_t field = pondReadingField(token.key.ptr, token.key.len);
+		if ((field != 0) && !(reading->fields & field))
+			pondReadingSet(reading, field, pondViewNumber(token.value));
+	}
+	return (reading->fields != 0);
+}
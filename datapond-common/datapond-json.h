@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// In place JSON tokenizer for datapond responses
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_json_h
+#define __datapond_json_h
+
+#include <stdint.h>
+#include "datapond-reading.h"
+
+//Token types
+#define		JSON_END			0
+#define		JSON_OBJECT			1
+#define		JSON_OBJECT_END		2
+#define		JSON_ARRAY			3
+#define		JSON_ARRAY_END		4
+#define		JSON_STRING			5
+#define		JSON_NUMBER			6
+#define		JSON_TRUE			7
+#define		JSON_FALSE			8
+#define		JSON_NULL			9
+#define		JSON_ERROR			0xFF
+
+#define		JSON_MAX_DEPTH		16
+
+//Non-owning view of part of the response buffer
+typedef struct {
+	const char* ptr;
+	uint16_t	len;
+} pond_view;
+
+typedef struct {
+	uint8_t		type;
+	uint8_t		depth;		//Nesting level the token sits at, 0 at the top
+	pond_view	key;		//Member name, empty outside objects
+	pond_view	value;		//String contents without quotes, or number text
+} pond_json_token;
+
+//Pull tokenizer. Nothing is copied, every view points into the buffer given
+class PondJsonReader {
+private:
+	const char* data;
+	uint16_t	len;
+	uint16_t	pos;
+	uint8_t		depth;
+	bool		inObject[JSON_MAX_DEPTH];
+	
+	void	skipSpace();
+	bool	readString(pond_view* view);
+	
+public:
+	PondJsonReader(const char* buffer, uint16_t length);
+	uint8_t		next(pond_json_token* token);
+};
+
+bool	pondViewEquals(pond_view view, const char* text);
+double	pondViewNumber(pond_view view);
+
+//Finds the first string or number member called key, at any depth
+bool	pondJsonFind(const char* data, uint16_t len, const char* key, pond_view* value);
+//Collects the reading fields of a droplet or stats response
+bool	pondJsonReading(const char* data, uint16_t len, pond_reading* reading);
+
+#endif
@@ -0,0 +1,270 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Store-and-forward log for droplets that could not be sent to the datapond server
+// Written originally by Embedded Adventures
+
+#include <string.h>
+#include "datapond-log.h"
+
+#ifdef ARDUINO
+FlashDropletStore::FlashDropletStore(const char* filename) {
+	path = filename;
+}
+
+bool FlashDropletStore::open() {
+	if (!SPIFFS.begin())
+		return false;
+	if (SPIFFS.exists(path))
+		file = SPIFFS.open(path, "r+");
+	else
+		file = SPIFFS.open(path, "w+");
+	return file;
+}
+
+bool FlashDropletStore::read(uint32_t offset, void* data, uint16_t len) {
+	if (!file.seek(offset))
+		return false;
+	return (file.read((uint8_t*)data, len) == len);
+}
+
+bool FlashDropletStore::write(uint32_t offset, const void* data, uint16_t len) {
+	if (!file.seek(offset))
+		return false;
+	bool ok = (file.write((const uint8_t*)data, len) == len);
+	file.flush();
+	return ok;
+}
+#else
+FileDropletStore::FileDropletStore(const char* filename) {
+	path = filename;
+	file = NULL;
+}
+
+FileDropletStore::~FileDropletStore() {
+	if (file != NULL)
+		fclose(file);
+}
+
+bool FileDropletStore::open() {
+	file = fopen(path, "r+b");
+	if (file == NULL)
+		file = fopen(path, "w+b");
+	return (file != NULL);
+}
+
+bool FileDropletStore::read(uint32_t offset, void* data, uint16_t len) {
+	if (fseek(file, offset, SEEK_SET) != 0)
+		return false;
+	return (fread(data, 1, len, file) == len);
+}
+
+bool FileDropletStore::write(uint32_t offset, const void* data, uint16_t len) {
+	if (fseek(file, offset, SEEK_SET) != 0)
+		return false;
+	bool ok = (fwrite(data, 1, len, file) == len);
+	fflush(file);
+	return ok;
+}
+#endif
+
+
+DropletLog::DropletLog(DropletStore* backend, uint16_t records) {
+	store = backend;
+	capacity = records;
+	headSeq = 1;
+	tailSeq = 1;
+	drained = 0;
+	dropped = 0;
+	clock = NULL;
+}
+
+/*	Opens the backend and recovers the unsent records left by a previous run	*/
+bool DropletLog::begin() {
+	uint32_t header[2];
+	droplet_record rec;
+	uint32_t maxSeq = 0;
+	
+	if (!store->open())
+		return false;
+	
+	if (!store->read(0, header, sizeof(header)) || (header[0] != LOG_MAGIC)) {
+		headSeq = 1;
+		tailSeq = 1;
+		return writeTail();
+	}
+	
+	//The newest valid record decides where appending continues
+	for (uint16_t i = 0; i < capacity; i++) {
+		uint32_t offset = LOG_HEADER_SIZE + (uint32_t)i * sizeof(droplet_record);
+		if (!store->read(offset, &rec, sizeof(rec)))
+			break;
+		if ((rec.sequence == 0) || (rec.check != recordCheck(&rec)))
+			continue;
+		if (recordOffset(rec.sequence) != offset)
+			continue;
+		if (rec.sequence > maxSeq)
+			maxSeq = rec.sequence;
+	}
+	headSeq = maxSeq + 1;
+	tailSeq = header[1];
+	if ((tailSeq == 0) || (tailSeq > headSeq))
+		tailSeq = headSeq;
+	if (headSeq - tailSeq > capacity)
+		tailSeq = headSeq - capacity;
+	return true;
+}
+
+/*	Sets the function used to timestamp appended droplets	*/
+void DropletLog::setClock(pond_clock_fn fn) {
+	clock = fn;
+}
+
+bool DropletLog::append(int stream_id, double value) {
+	uint32_t timestamp = 0;
+	if (clock != NULL)
+		timestamp = clock();
+	return append(stream_id, value, timestamp);
+}
+
+/*	Appends a droplet. Overwrites the oldest record if the log is full	*/
+bool DropletLog::append(int stream_id, double value, uint32_t timestamp) {
+	droplet_record rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.value = value;
+	rec.sequence = headSeq;
+	rec.timestamp = timestamp;
+	rec.stream_id = stream_id;
+	rec.check = recordCheck(&rec);
+	
+	if (!store->write(recordOffset(headSeq), &rec, sizeof(rec)))
+		return false;
+	headSeq++;
+	
+	if (headSeq - tailSeq > capacity) {
+		tailSeq++;
+		dropped++;
+		writeTail();
+	}
+	return true;
+}
+
+/*	Reads the record index places after the oldest unsent one	*/
+bool DropletLog::peek(uint16_t index, droplet_record* rec) {
+	if (index >= count())
+		return false;
+	uint32_t seq = tailSeq + index;
+	if (!store->read(recordOffset(seq), rec, sizeof(droplet_record)))
+		return false;
+	return ((rec->sequence == seq) && (rec->check == recordCheck(rec)));
+}
+
+/*	Marks the oldest records as delivered	*/
+void DropletLog::consume(uint16_t records) {
+	drained += settle(tailSeq, records);
+}
+
+/*	Drops the oldest records without delivering them	*/
+void DropletLog::discard(uint16_t records) {
+	dropped += settle(tailSeq, records);
+}
+
+/*	Marks the records sent starting at sequence first as delivered. Returns how many were still in the log	*/
+uint16_t DropletLog::consume(uint32_t first, uint16_t records) {
+	uint16_t settled = settle(first, records);
+	drained += settled;
+	return settled;
+}
+
+/*	Drops the records sent starting at sequence first. Returns how many were still in the log	*/
+uint16_t DropletLog::discard(uint32_t first, uint16_t records) {
+	uint16_t settled = settle(first, records);
+	dropped += settled;
+	return settled;
+}
+
+/*	Moves the tail past the records from first to first+records that are still unsent. Records
+	overwritten while they were in flight are already counted as dropped and are skipped	*/
+uint16_t DropletLog::settle(uint32_t first, uint16_t records) {
+	uint32_t end = first + records;
+	if ((int32_t)(tailSeq - first) < 0)
+		return 0;
+	if ((int32_t)(end - tailSeq) <= 0)
+		return 0;
+	uint16_t settled = end - tailSeq;
+	if (settled > count())
+		settled = count();
+	tailSeq += settled;
+	writeTail();
+	return settled;
+}
+
+/*	Discards every unsent record	*/
+void DropletLog::clear() {
+	tailSeq = headSeq;
+	writeTail();
+}
+
+/*	Returns the sequence of the oldest unsent record	*/
+uint32_t DropletLog::tail() {
+	return tailSeq;
+}
+
+uint16_t DropletLog::count() {
+	return headSeq - tailSeq;
+}
+
+bool DropletLog::isEmpty() {
+	return (headSeq == tailSeq);
+}
+
+/*	Returns the number of records delivered since begin()	*/
+uint32_t DropletLog::getDrained() {
+	return drained;
+}
+
+/*	Returns the number of records overwritten before they were delivered	*/
+uint32_t DropletLog::getDropped() {
+	return dropped;
+}
+
+uint32_t DropletLog::recordOffset(uint32_t seq) {
+	return LOG_HEADER_SIZE + ((seq - 1) % capacity) * sizeof(droplet_record);
+}
+
+uint32_t DropletLog::recordCheck(const droplet_record* rec) {
+	uint32_t words[2];
+	memcpy(words, &rec->value, sizeof(words));
+	return LOG_MAGIC ^ rec->sequence ^ (rec->timestamp * 31) ^ ((uint32_t)rec->stream_id * 17) ^ words[0] ^ words[1];
+}
+
+bool DropletLog::writeTail() {
+	uint32_t header[2] = {LOG_MAGIC, tailSeq};
+	return store->write(0, header, sizeof(header));
+}
@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Store-and-forward log for droplets that could not be sent to the datapond server
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_log_h
+#define __datapond_log_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+#include "FS.h"
+#else
+#include <stdio.h>
+#endif
+
+#define		LOG_MAGIC			0x444C4F47
+#define		LOG_HEADER_SIZE		8
+
+typedef uint32_t (*pond_clock_fn)();
+
+typedef struct {
+	double		value;
+	uint32_t	sequence;	//0 means the slot was never written
+	uint32_t	timestamp;	//0 means the server stamps it on arrival
+	int32_t		stream_id;
+	uint32_t	check;
+} droplet_record;
+
+//Storage backend. Offsets are bytes from the start of the log
+class DropletStore {
+public:
+	virtual bool	open() = 0;
+	virtual bool	read(uint32_t offset, void* data, uint16_t len) = 0;
+	virtual bool	write(uint32_t offset, const void* data, uint16_t len) = 0;
+};
+
+#ifdef ARDUINO
+//Log kept in a file on the SPIFFS flash filesystem
+class FlashDropletStore : public DropletStore {
+private:
+	const char*		path;
+	File			file;
+public:
+	FlashDropletStore(const char* filename);
+	bool	open();
+	bool	read(uint32_t offset, void* data, uint16_t len);
+	bool	write(uint32_t offset, const void* data, uint16_t len);
+};
+#else
+//Log kept in a plain file, for host builds
+class FileDropletStore : public DropletStore {
+private:
+	const char*		path;
+	FILE*			file;
+public:
+	FileDropletStore(const char* filename);
+	~FileDropletStore();
+	bool	open();
+	bool	read(uint32_t offset, void* data, uint16_t len);
+	bool	write(uint32_t offset, const void* data, uint16_t len);
+};
+#endif
+
+//Bounded ring of droplet records. When full, the oldest record is overwritten
+class DropletLog {
+private:
+	DropletStore*	store;
+	uint16_t		capacity;
+	uint32_t		headSeq;
+	uint32_t		tailSeq;
+	uint32_t		drained;
+	uint32_t		dropped;
+	pond_clock_fn	clock;
+	
+	uint32_t	recordOffset(uint32_t seq);
+	uint32_t	recordCheck(const droplet_record* rec);
+	bool		writeTail();
+	uint16_t	settle(uint32_t first, uint16_t records);
+	
+public:
+	DropletLog(DropletStore* backend, uint16_t records);
+	bool		begin();
+	void		setClock(pond_clock_fn fn);
+	
+	bool		append(int stream_id, double value);
+	bool		append(int stream_id, double value, uint32_t timestamp);
+	bool		peek(uint16_t index, droplet_record* rec);
+	void		consume(uint16_t records);
+	void		discard(uint16_t records);
+	uint16_t	consume(uint32_t first, uint16_t records);
+	uint16_t	discard(uint32_t first, uint16_t records);
+	void		clear();
+	
+	uint32_t	tail();
+	uint16_t	count();
+	bool		isEmpty();
+	uint32_t	getDrained();
+	uint32_t	getDropped();
+};
+
+#endif
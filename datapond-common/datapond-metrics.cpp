@@ -0,0 +1,133 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Request counters and latency histograms, kept at a few instructions per event
+// Written originally by Embedded Adventures
+
+#include <string.h>
+#include "datapond-metrics.h"
+#include "datapond-format.h"
+
+static int putUint(uint8_t* dst, uint32_t value, uint8_t bytes) {
+	for (uint8_t i = 0; i < bytes; i++) {
+		dst[i] = value & 0xFF;
+		value >>= 8;
+	}
+	return bytes;
+}
+
+static int appendCount(char* dst, int len, int size, const char* name, uint32_t value) {
+	char number[POND_NUMBER_SIZE];
+	pondFormatUnsigned(number, value);
+	len = pondAppend(dst, len, size, name);
+	return pondAppend(dst, len, size, number);
+}
+
+PondMetrics::PondMetrics() {
+	reset();
+}
+
+void PondMetrics::reset() {
+	memset(&counts, 0, sizeof(counts));
+}
+
+const pond_metrics* PondMetrics::get() {
+	return &counts;
+}
+
+uint32_t PondMetrics::percentile(uint8_t op, uint8_t p) {
+	uint8_t first = (op < METRIC_OPS) ? op : 0;
+	uint8_t last = (op < METRIC_OPS) ? op : METRIC_OPS - 1;
+	uint32_t total = 0;
+	uint32_t seen = 0;
+	
+	for (uint8_t i = first; i <= last; i++) {
+		for (uint8_t b = 0; b < METRIC_BUCKETS; b++)
+			total += counts.latency[i][b];
+	}
+	if (total == 0)
+		return 0;
+	//Rank of the sample the percentile falls on, counting from 1
+	uint32_t rank = (total * p + 99) / 100;
+	if (rank == 0)
+		rank = 1;
+	
+	for (uint8_t b = 0; b < METRIC_BUCKETS; b++) {
+		for (uint8_t i = first; i <= last; i++)
+			seen += counts.latency[i][b];
+		if (seen >= rank)
+			return (2UL << b) - 1;
+	}
+	return (2UL << (METRIC_BUCKETS - 1)) - 1;
+}
+
+/*	Writes the counters for sending off the device, see METRICS_SNAPSHOT_SIZE	*/
+int PondMetrics::snapshot(uint8_t* dst, int size) {
+	int len = 0;
+	if (size < METRICS_SNAPSHOT_SIZE)
+		return 0;
+	
+	dst[len++] = METRICS_VERSION;
+	for (uint8_t i = 0; i < METRIC_OPS; i++)
+		len += putUint(dst + len, counts.requests[i], 4);
+	for (uint8_t i = 0; i < METRIC_OPS; i++)
+		len += putUint(dst + len, counts.failures[i], 4);
+	len += putUint(dst + len, counts.retransmits, 4);
+	len += putUint(dst + len, counts.timeouts, 4);
+	len += putUint(dst + len, counts.bytesSent, 4);
+	len += putUint(dst + len, counts.bytesReceived, 4);
+	len += putUint(dst + len, counts.slotsHigh, 2);
+	len += putUint(dst + len, counts.queueHigh, 2);
+	for (uint8_t i = 0; i < METRIC_OPS; i++) {
+		for (uint8_t b = 0; b < METRIC_BUCKETS; b++)
+			len += putUint(dst + len, counts.latency[i][b], 2);
+	}
+	return len;
+}
+
+/*	Writes the totals as one line of text, short enough to go out as a droplet value	*/
+int PondMetrics::summary(char* dst, int size) {
+	uint32_t requests = 0;
+	uint32_t failures = 0;
+	if (size < METRICS_SUMMARY_SIZE)
+		return 0;
+	for (uint8_t i = 0; i < METRIC_OPS; i++) {
+		requests += counts.requests[i];
+		failures += counts.failures[i];
+	}
+	
+	int len = appendCount(dst, 0, size, "req:", requests);
+	len = appendCount(dst, len, size, ",fail:", failures);
+	len = appendCount(dst, len, size, ",rtx:", counts.retransmits);
+	len = appendCount(dst, len, size, ",to:", counts.timeouts);
+	len = appendCount(dst, len, size, ",p50:", percentile(METRIC_OPS, 50));
+	len = appendCount(dst, len, size, ",p99:", percentile(METRIC_OPS, 99));
+	len = appendCount(dst, len, size, ",tx:", counts.bytesSent);
+	return appendCount(dst, len, size, ",rx:", counts.bytesReceived);
+}
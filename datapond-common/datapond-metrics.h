@@ -0,0 +1,110 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Request counters and latency histograms, kept at a few instructions per event
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_metrics_h
+#define __datapond_metrics_h
+
+#include <stdint.h>
+#include "datapond-config.h"
+
+//Operations counted apart. Pipelined requests count as METRIC_OTHER
+#define		METRIC_LOGIN		0
+#define		METRIC_CREATE		1
+#define		METRIC_READ			2
+#define		METRIC_OTHER		3
+#define		METRIC_OPS			4
+
+//Latency buckets. Bucket n counts 2^n to 2^(n+1) - 1 ms, bucket 0 also counts 0 ms and the last one anything longer
+#define		METRIC_BUCKETS		16
+
+//Bytes written by snapshot(), a version byte then the counters little endian in pond_metrics order
+#define		METRICS_VERSION			1
+#define		METRICS_SNAPSHOT_SIZE	(1 + 4 * (2 * METRIC_OPS + 4) + 4 + 2 * METRIC_OPS * METRIC_BUCKETS)
+//Longest text written by summary()
+#define		METRICS_SUMMARY_SIZE	128
+
+//Records an event on the client's metrics, compiled out along with them
+#if POND_METRICS
+#define		POND_METRIC(event)	metrics.event
+#else
+#define		POND_METRIC(event)	((void)0)
+#endif
+
+typedef struct {
+	uint32_t	requests[METRIC_OPS];
+	uint32_t	failures[METRIC_OPS];
+	uint32_t	retransmits;		//CoAP resends by the protocol, or HTTP requests sent again on a new connection
+	uint32_t	timeouts;
+	uint32_t	bytesSent;
+	uint32_t	bytesReceived;
+	uint16_t	slotsHigh;			//Most requests waiting on a response at once
+	uint16_t	queueHigh;			//Most packets or requests queued ahead of the network
+	uint16_t	latency[METRIC_OPS][METRIC_BUCKETS];	//Stops counting at 65535
+} pond_metrics;
+
+class PondMetrics {
+private:
+	pond_metrics	counts;
+	
+public:
+	PondMetrics();
+	void	reset();
+	
+	//Events, inline so the clients pay a few instructions each
+	void	request(uint8_t op) { counts.requests[op]++; }
+	void	failure(uint8_t op) { counts.failures[op]++; }
+	void	retransmit(uint16_t count = 1) { counts.retransmits += count; }
+	void	timeout() { counts.timeouts++; }
+	void	sent(uint16_t bytes) { counts.bytesSent += bytes; }
+	void	received(uint16_t bytes) { counts.bytesReceived += bytes; }
+	void	slots(uint16_t used) { if (used > counts.slotsHigh) counts.slotsHigh = used; }
+	void	queue(uint16_t depth) { if (depth > counts.queueHigh) counts.queueHigh = depth; }
+	void	latency(uint8_t op, uint32_t ms);
+	
+	const pond_metrics* get();
+	//Upper bound in ms of the p-th percentile latency of op, or of every op with METRIC_OPS. 0 if none were timed
+	uint32_t	percentile(uint8_t op, uint8_t p);
+	//Both return the length written, 0 if size is too small
+	int		snapshot(uint8_t* dst, int size);
+	int		summary(char* dst, int size);
+};
+
+/*	Bucket n holds latencies from 2^n ms	*/
+inline void PondMetrics::latency(uint8_t op, uint32_t ms) {
+	uint8_t bucket = (ms < 2) ? 0 : 31 - __builtin_clz(ms);
+	if (bucket >= METRIC_BUCKETS)
+		bucket = METRIC_BUCKETS - 1;
+	if (counts.latency[op][bucket] != 0xFFFF)
+		counts.latency[op][bucket]++;
+}
+
+#endif
@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Typed droplet and stream statistics values decoded from datapond responses
+// Written originally by Embedded Adventures
+
+#include <string.h>
+#include "datapond-reading.h"
+
+static bool keyIs(const char* key, uint16_t len, const char* name) {
+	return (strlen(name) == len) && (memcmp(key, name, len) == 0);
+}
+
+uint8_t pondReadingField(const char* key, uint16_t len) {
+	if (keyIs(key, len, "value"))
+		return READING_VALUE;
+	if (keyIs(key, len, "timestamp"))
+		return READING_TIMESTAMP;
+	if (keyIs(key, len, "min"))
+		return READING_MIN;
+	if (keyIs(key, len, "max"))
+		return READING_MAX;
+	if (keyIs(key, len, "avg") || keyIs(key, len, "mean"))
+		return READING_AVG;
+	if (keyIs(key, len, "count"))
+		return READING_COUNT;
+	return 0;
+}
+
+void pondReadingSet(pond_reading* reading, uint8_t field, double number) {
+	switch (field) {
+		case READING_VALUE:		reading->value = number; break;
+		case READING_TIMESTAMP: reading->timestamp = (uint32_t)number; break;
+		case READING_MIN:		reading->min = number; break;
+		case READING_MAX:		reading->max = number; break;
+		case READING_AVG:		reading->avg = number; break;
+		case READING_COUNT:		reading->count = (uint32_t)number; break;
+		default:				return;
+	}
+	reading->fields |= field;
+}
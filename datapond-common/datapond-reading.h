@@ -0,0 +1,61 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Typed droplet and stream statistics values decoded from datapond responses
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_reading_h
+#define __datapond_reading_h
+
+#include <stdint.h>
+
+//Bits of pond_reading.fields
+#define		READING_VALUE		0x01
+#define		READING_TIMESTAMP	0x02
+#define		READING_MIN			0x04
+#define		READING_MAX			0x08
+#define		READING_AVG			0x10
+#define		READING_COUNT		0x20
+
+typedef struct {
+	double		value;
+	uint32_t	timestamp;
+	double		min;
+	double		max;
+	double		avg;
+	uint32_t	count;
+	uint8_t		fields;		//Which of the above were present
+} pond_reading;
+
+//Matches a response key to its field bit, 0 if the key isn't a reading field
+uint8_t		pondReadingField(const char* key, uint16_t len);
+//Stores a number under the field bit
+void		pondReadingSet(pond_reading* reading, uint8_t field, double number);
+
+#endif
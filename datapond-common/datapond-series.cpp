@@ -0,0 +1,297 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Packed time series of one stream, delta-of-delta timestamps and XOR compressed values
+// Written originally by Embedded Adventures
+
+#include <string.h>
+#include "datapond-series.h"
+
+//Value bits of the delta-of-delta buckets, by the number of 1s in their prefix
+static const uint8_t dodBits[5] = {0, 7, 9, 12, 32};
+
+/*	Values are packed by their IEEE 754 bits, double is 8 bytes on ESP8266 and hosts	*/
+static uint64_t doubleBits(double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static double bitsDouble(uint64_t bits) {
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+
+////////////////////////////////////////////////////////
+////                Encoder                         ////
+////////////////////////////////////////////////////////
+
+PondSeriesWriter::PondSeriesWriter(uint8_t* buffer, uint16_t capacity) {
+	buf = buffer;
+	size = capacity;
+	clear();
+}
+
+void PondSeriesWriter::clear() {
+	bits = 0;
+	samples = 0;
+	prevTime = 0;
+	prevDelta = 0;
+	prevValue = 0;
+	prevLeading = 0xFF;
+	prevTrailing = 0;
+	overflow = (size < SERIES_HEADER_SIZE);
+	if (!overflow)
+		buf[0] = buf[1] = 0;
+}
+
+/*	Writes the low n bits of value, most significant first	*/
+void PondSeriesWriter::writeBits(uint64_t value, uint8_t n) {
+	while (n > 0) {
+		n--;
+		uint32_t byte = SERIES_HEADER_SIZE + (bits >> 3);
+		if (byte >= size) {
+			overflow = true;
+			return;
+		}
+		uint8_t mask = 0x80 >> (bits & 7);
+		if ((value >> n) & 1)
+			buf[byte] |= mask;
+		else
+			buf[byte] &= ~mask;
+		bits++;
+	}
+}
+
+bool PondSeriesWriter::append(uint32_t timestamp, double value) {
+	if (size < SERIES_HEADER_SIZE)
+		return false;
+	
+	//Kept to take the sample back out if it doesn't fit
+	uint32_t startBits = bits;
+	int32_t startDelta = prevDelta;
+	uint8_t startLeading = prevLeading;
+	uint8_t startTrailing = prevTrailing;
+	uint64_t v = doubleBits(value);
+	overflow = false;
+	
+	if (samples == 0) {
+		writeBits(timestamp, 32);
+		writeBits(v, 64);
+	}
+	else {
+		int32_t delta = (int32_t)(timestamp - prevTime);
+		int32_t dod = delta - prevDelta;
+		if (dod == 0) {
+			writeBits(0, 1);
+		}
+		else if ((dod >= -64) && (dod <= 63)) {
+			writeBits(0x02, 2);
+			writeBits(dod, 7);
+		}
+		else if ((dod >= -256) && (dod <= 255)) {
+			writeBits(0x06, 3);
+			writeBits(dod, 9);
+		}
+		else if ((dod >= -2048) && (dod <= 2047)) {
+			writeBits(0x0E, 4);
+			writeBits(dod, 12);
+		}
+		else {
+			writeBits(0x0F, 4);
+			writeBits((uint32_t)dod, 32);
+		}
+		prevDelta = delta;
+		
+		uint64_t x = v ^ prevValue;
+		if (x == 0) {
+			writeBits(0, 1);
+		}
+		else {
+			uint8_t leading = __builtin_clzll(x);
+			uint8_t trailing = __builtin_ctzll(x);
+			//The leading count has 5 bits
+			if (leading > 31)
+				leading = 31;
+			if ((prevLeading != 0xFF) && (leading >= prevLeading) && (trailing >= prevTrailing)) {
+				writeBits(0x02, 2);
+				writeBits(x >> prevTrailing, 64 - prevLeading - prevTrailing);
+			}
+			else {
+				uint8_t meaningful = 64 - leading - trailing;
+				writeBits(0x03, 2);
+				writeBits(leading, 5);
+				//64 meaningful bits are written as 0
+				writeBits(meaningful & 0x3F, 6);
+				writeBits(x >> trailing, meaningful);
+				prevLeading = leading;
+				prevTrailing = trailing;
+			}
+		}
+	}
+	
+	if (overflow) {
+		bits = startBits;
+		prevDelta = startDelta;
+		prevLeading = startLeading;
+		prevTrailing = startTrailing;
+		return false;
+	}
+	prevTime = timestamp;
+	prevValue = v;
+	samples++;
+	buf[0] = samples >> 8;
+	buf[1] = samples & 0xFF;
+	return true;
+}
+
+/*	Returns the bytes used, header included	*/
+uint16_t PondSeriesWriter::length() {
+	return SERIES_HEADER_SIZE + ((bits + 7) >> 3);
+}
+
+uint16_t PondSeriesWriter::count() {
+	return samples;
+}
+
+
+////////////////////////////////////////////////////////
+////                Decoder                         ////
+////////////////////////////////////////////////////////
+
+PondSeriesReader::PondSeriesReader(const uint8_t* buffer, uint16_t length) {
+	data = buffer;
+	len = length;
+	pos = 0;
+	samples = 0;
+	if (len >= SERIES_HEADER_SIZE)
+		samples = ((uint16_t)data[0] << 8) | data[1];
+	remaining = samples;
+	prevTime = 0;
+	prevDelta = 0;
+	prevValue = 0;
+	prevLeading = 0;
+	prevTrailing = 0;
+}
+
+bool PondSeriesReader::readBits(uint8_t n, uint64_t* value) {
+	*value = 0;
+	while (n > 0) {
+		uint32_t byte = SERIES_HEADER_SIZE + (pos >> 3);
+		if (byte >= len)
+			return false;
+		*value = (*value << 1) | ((data[byte] >> (7 - (pos & 7))) & 1);
+		pos++;
+		n--;
+	}
+	return true;
+}
+
+/*	Reads an n bit two's complement number	*/
+bool PondSeriesReader::readSigned(uint8_t n, int32_t* value) {
+	uint64_t bits;
+	if (!readBits(n, &bits))
+		return false;
+	if ((n < 32) && (bits & ((uint64_t)1 << (n - 1))))
+		bits |= ~(((uint64_t)1 << n) - 1);
+	*value = (int32_t)bits;
+	return true;
+}
+
+bool PondSeriesReader::next(uint32_t* timestamp, double* value) {
+	uint64_t bits;
+	if (remaining == 0)
+		return false;
+	
+	if (remaining == samples) {
+		if (!readBits(32, &bits))
+			return false;
+		prevTime = bits;
+		if (!readBits(64, &prevValue))
+			return false;
+	}
+	else {
+		//Up to four 1s select the delta-of-delta bucket
+		int ones = 0;
+		while (ones < 4) {
+			if (!readBits(1, &bits))
+				return false;
+			if (bits == 0)
+				break;
+			ones++;
+		}
+		int32_t dod = 0;
+		if ((ones > 0) && !readSigned(dodBits[ones], &dod))
+			return false;
+		prevDelta += dod;
+		prevTime += prevDelta;
+		
+		if (!readBits(1, &bits))
+			return false;
+		if (bits != 0) {
+			uint64_t x;
+			if (!readBits(1, &bits))
+				return false;
+			if (bits != 0) {
+				uint64_t leading, meaningful;
+				if (!readBits(5, &leading) || !readBits(6, &meaningful))
+					return false;
+				if (meaningful == 0)
+					meaningful = 64;
+				prevLeading = leading;
+				prevTrailing = 64 - leading - meaningful;
+			}
+			if (!readBits(64 - prevLeading - prevTrailing, &x))
+				return false;
+			prevValue ^= x << prevTrailing;
+		}
+	}
+	
+	remaining--;
+	*timestamp = prevTime;
+	*value = bitsDouble(prevValue);
+	return true;
+}
+
+/*	Returns the number of samples in the series	*/
+uint16_t PondSeriesReader::count() {
+	return samples;
+}
+
+
+////////////////////////////////////////////////////////
+////                Collection                      ////
+////////////////////////////////////////////////////////
+
+PondSeries::PondSeries(int stream, uint16_t samples) : writer(buffer, SERIES_BUFFER_SIZE) {
+	stream_id = stream;
+	limit = samples;
+}
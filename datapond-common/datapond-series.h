@@ -0,0 +1,105 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Packed time series of one stream, delta-of-delta timestamps and XOR compressed values
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_series_h
+#define __datapond_series_h
+
+#include <stdint.h>
+#include "datapond-config.h"
+
+//Sample count ahead of the bit stream, most significant byte first
+#define		SERIES_HEADER_SIZE	2
+
+//Packs samples as in Gorilla. The first is stored whole, the rest as the change in
+//timestamp delta and the meaningful bits of the value XORed with the one before
+class PondSeriesWriter {
+private:
+	uint8_t*	buf;
+	uint16_t	size;
+	uint32_t	bits;			//Written after the header
+	uint16_t	samples;
+	uint32_t	prevTime;
+	int32_t		prevDelta;
+	uint64_t	prevValue;
+	uint8_t		prevLeading;	//0xFF until a window of meaningful bits is set
+	uint8_t		prevTrailing;
+	bool		overflow;
+	
+	void	writeBits(uint64_t value, uint8_t n);
+	
+public:
+	PondSeriesWriter(uint8_t* buffer, uint16_t capacity);
+	//False, with nothing written, when the sample doesn't fit
+	bool		append(uint32_t timestamp, double value);
+	void		clear();
+	uint16_t	length();
+	uint16_t	count();
+};
+
+class PondSeriesReader {
+private:
+	const uint8_t*	data;
+	uint16_t	len;
+	uint32_t	pos;			//Bits read after the header
+	uint16_t	samples;
+	uint16_t	remaining;
+	uint32_t	prevTime;
+	int32_t		prevDelta;
+	uint64_t	prevValue;
+	uint8_t		prevLeading;
+	uint8_t		prevTrailing;
+	
+	bool	readBits(uint8_t n, uint64_t* value);
+	bool	readSigned(uint8_t n, int32_t* value);
+	
+public:
+	PondSeriesReader(const uint8_t* buffer, uint16_t length);
+	//False once every sample has been read, or the data is cut short
+	bool		next(uint32_t* timestamp, double* value);
+	uint16_t	count();
+};
+
+//Samples of one stream collected until they're sent as one droplet payload
+class PondSeries {
+	friend class CoapDatapond;
+private:
+	uint8_t			buffer[SERIES_BUFFER_SIZE];
+	PondSeriesWriter	writer;
+	int				stream_id;
+	uint16_t		limit;
+	
+public:
+	//Sent once limit samples are in, or the buffer is full
+	PondSeries(int stream, uint16_t samples);
+};
+
+#endif
@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Datapond session state saved across deep sleep, so a node can skip logging in on wake
+// Written originally by Embedded Adventures
+
+#include <stddef.h>
+#include <string.h>
+#include "datapond-session.h"
+
+#ifdef ESP8266
+#include "Arduino.h"
+#endif
+
+static uint32_t sessionCheck(const pond_session* session) {
+	//FNV-1a over everything ahead of the check
+	const uint8_t* data = (const uint8_t*)session;
+	uint32_t hash = 2166136261UL;
+	for (size_t i = 0; i < offsetof(pond_session, check); i++)
+		hash = (hash ^ data[i]) * 16777619UL;
+	return hash;
+}
+
+bool pondSessionFill(pond_session* session, const char* server, uint16_t port, const char* cookie) {
+	size_t serverLength = strlen(server);
+	size_t cookieLength = strlen(cookie);
+	if ((serverLength >= SESSION_SERVER_SIZE) || (cookieLength >= SESSION_COOKIE_SIZE))
+		return false;
+	
+	//Unused bytes are zeroed so the check doesn't depend on what was there before
+	memset(session->server, 0, SESSION_SERVER_SIZE);
+	memset(session->cookie, 0, SESSION_COOKIE_SIZE);
+	memcpy(session->server, server, serverLength);
+	memcpy(session->cookie, cookie, cookieLength);
+	session->port = port;
+	return true;
+}
+
+void pondSessionSeal(pond_session* session) {
+	session->magic = SESSION_MAGIC;
+	session->check = sessionCheck(session);
+}
+
+bool pondSessionValid(const pond_session* session, const char* server, uint16_t port) {
+	if ((session->magic != SESSION_MAGIC) || (session->check != sessionCheck(session)))
+		return false;
+	//A session is only good with the server that issued it
+	if ((session->port != port) || (strncmp(session->server, server, SESSION_SERVER_SIZE) != 0))
+		return false;
+	return session->cookie[0] != '\0';
+}
+
+bool pondSessionSave(DropletStore* store, const pond_session* session) {
+	if (!store->open())
+		return false;
+	return store->write(0, session, sizeof(pond_session));
+}
+
+bool pondSessionLoad(DropletStore* store, pond_session* session) {
+	if (!store->open())
+		return false;
+	return store->read(0, session, sizeof(pond_session));
+}
+
+#ifdef ESP8266
+bool pondSessionSaveRtc(const pond_session* session, uint32_t offset) {
+	return ESP.rtcUserMemoryWrite(offset, (uint32_t*)session, sizeof(pond_session));
+}
+
+bool pondSessionLoadRtc(pond_session* session, uint32_t offset) {
+	return ESP.rtcUserMemoryRead(offset, (uint32_t*)session, sizeof(pond_session));
+}
+#endif
@@ -0,0 +1,73 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Datapond session state saved across deep sleep, so a node can skip logging in on wake
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_session_h
+#define __datapond_session_h
+
+#include <stdint.h>
+#include "datapond-log.h"
+
+#define		SESSION_MAGIC			0x53455353
+#define		SESSION_COOKIE_SIZE		96
+#define		SESSION_SERVER_SIZE		40
+//ms before logging in again when a login brought no session back, doubled each time up to the max
+#define		SESSION_RETRY_MIN		1000
+#define		SESSION_RETRY_MAX		60000
+
+//Everything a client needs to carry on where it left off. A multiple of 4 bytes for RTC memory
+typedef struct {
+	uint64_t	token;			//Next token counter, so old responses can't match new requests
+	uint32_t	magic;
+	uint16_t	messageID;
+	uint16_t	port;
+	char		server[SESSION_SERVER_SIZE];
+	char		cookie[SESSION_COOKIE_SIZE];
+	uint32_t	check;
+} pond_session;
+
+//Fills in the server and cookie. Returns false if either is too long to keep
+bool	pondSessionFill(pond_session* session, const char* server, uint16_t port, const char* cookie);
+//Seals the session once filled, and checks a loaded one is intact and for this server
+void	pondSessionSeal(pond_session* session);
+bool	pondSessionValid(const pond_session* session, const char* server, uint16_t port);
+
+//Kept in a file, at offset 0 of the store
+bool	pondSessionSave(DropletStore* store, const pond_session* session);
+bool	pondSessionLoad(DropletStore* store, pond_session* session);
+
+#ifdef ESP8266
+//Kept in RTC user memory, which survives deep sleep. offset is in 4 byte blocks
+bool	pondSessionSaveRtc(const pond_session* session, uint32_t offset);
+bool	pondSessionLoadRtc(pond_session* session, uint32_t offset);
+#endif
+
+#endif
@@ -0,0 +1,814 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Host benchmark of both datapond clients against the loopback mock server.
+// Reports req/s, p50/p99 latency and heap allocations per request, then
+// compares Observe with polling, keep-alive with a connection per request,
+// and checks the packed series the mock decoded. Times parsing a response in place
+// against the old copy to String and indexOf() path. Exits non-zero if a check fails
+// or any request path allocates once the client is up. With --soak, runs millions of
+// mixed requests instead and checks allocations, footprint and resident set don't grow
+// Written originally by Embedded Adventures
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include "Arduino.h"
+#include "coap-datapond.h"
+#include "http-datapond.h"
+#include "datapond-json.h"
+#include "datapond-mock.h"
+
+//Streams the runs write to
+#define		BENCH_STREAM		1
+#define		OBSERVE_STREAM		2
+#define		SERIES_STREAM		3
+//ms without progress before a run is given up on
+#define		BENCH_STALL			120000
+//Observe and polling runs
+#define		BENCH_UPDATES		40
+#define		POLL_PERIOD			40
+#define		UPDATE_PERIOD		97
+//Droplets per batch, few enough to go in one packet at the default BATCH_PAYLOAD_SIZE
+#define		BATCH_DROPLETS		6
+//Soak runs are split into segments, the first warms up and none after it may grow
+#define		SOAK_SEGMENTS		10
+//Resident set growth allowed after the first segment, in KB
+#define		SOAK_RSS_SLACK		256
+
+//Counted per thread, so the mock's own allocations stay out of the client's figures
+static thread_local uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+	allocations++;
+	void* p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+typedef struct {
+	unsigned long	start;
+	unsigned long	end;
+	bool			done;
+	bool			status;
+} bench_request;
+
+typedef struct {
+	const char*		name;
+	uint32_t		count;
+	uint32_t		failed;
+	unsigned long	elapsed;		//us
+	uint64_t		allocations;
+	uint32_t		connects;
+	std::vector<uint32_t>	latency;	//us
+} bench_result;
+
+static PondMockServer*	mock;
+static CoapDatapond*	coap;
+static HttpDatapond*	http;
+static int		requests = 2000;
+static int		soakRequests = 0;
+static int		window = 4;
+static float	loss = 0;
+static bool		checksFailed = false;
+
+static uint32_t	completed;
+static std::vector<bench_request>	pending;
+
+static double	observedValue;
+static bool		observedFresh;
+static uint32_t	observedCount;
+
+
+////////////////////////////////////////////////////////
+////			Reporting						 	////
+////////////////////////////////////////////////////////
+
+static double percentile(std::vector<uint32_t> samples, int p) {
+	if (samples.empty())
+		return 0;
+	std::sort(samples.begin(), samples.end());
+	return samples[(samples.size() - 1) * p / 100] / 1000.0;
+}
+
+static void report(const bench_result& result) {
+	double seconds = result.elapsed / 1000000.0;
+	printf("%-26s %7u req %9.0f req/s  p50 %7.3f ms  p99 %7.3f ms  %6.2f allocs/req  %4u failed",
+			result.name, result.count, (seconds > 0) ? result.count / seconds : 0,
+			percentile(result.latency, 50), percentile(result.latency, 99),
+			result.count ? (double)result.allocations / result.count : 0, result.failed);
+	if (result.connects != 0)
+		printf("  %u connects", result.connects);
+	printf("\n");
+}
+
+/*	Fails the run when loss isn't what got in the way	*/
+static void check(bool ok, const char* what) {
+	if (ok)
+		return;
+	printf("CHECK FAILED: %s\n", what);
+	if (loss == 0)
+		checksFailed = true;
+}
+
+/*	Fails the run if a request path touched the heap. Loss is no excuse, retries shouldn't allocate either	*/
+static void checkAllocations(const bench_result& result) {
+	if (result.allocations == 0)
+		return;
+	printf("CHECK FAILED: %s made %llu allocations\n", result.name, (unsigned long long)result.allocations);
+	checksFailed = true;
+}
+
+
+////////////////////////////////////////////////////////
+////			CoAP							 	////
+////////////////////////////////////////////////////////
+
+static void coapDone(void* context, pond_token tkn, bool status, uns8 code) {
+	bench_request* req = (bench_request*)context;
+	req->end = micros();
+	req->status = status;
+	req->done = true;
+	completed++;
+}
+
+/*	Polls complete through their delegate, the reading is taken while the response is still in place	*/
+static void pollDone(void* context, pond_token tkn, bool status, uns8 code) {
+	pond_reading reading;
+	if (status && coap->getReading(&reading) && (reading.fields & READING_VALUE)) {
+		observedValue = reading.value;
+		observedFresh = true;
+	}
+	coapDone(context, tkn, status, code);
+}
+
+static void coapReading(pond_token tkn, bool status, const pond_reading* reading) {
+	if (!status || !(reading->fields & READING_VALUE))
+		return;
+	observedValue = reading->value;
+	observedFresh = true;
+	observedCount++;
+}
+
+static void coapBlock(pond_token tkn, bool status, uns32 offset, const char* data, int len, bool last) {
+}
+
+/*	Runs the client until every request issued so far has completed. False if it stalls	*/
+static bool coapSettle(uint32_t target) {
+	unsigned long progress = millis();
+	uint32_t seen = completed;
+	while (completed < target) {
+		coap->run();
+		if (completed != seen) {
+			seen = completed;
+			progress = millis();
+		}
+		if (millis() - progress > BENCH_STALL)
+			return false;
+	}
+	return true;
+}
+
+typedef int (*coap_op)(int index, bench_request* req);
+
+static int coapCreate(int index, bench_request* req) {
+	return coap->createDroplet(BENCH_STREAM, index * 0.25, coapDone, req);
+}
+
+static int coapRead(int index, bench_request* req) {
+	return coap->getLastDroplet(BENCH_STREAM, coapDone, req);
+}
+
+static CoapPreparedRequest	prepared;
+
+static int coapPrepared(int index, bench_request* req) {
+	return coap->sendPrepared(&prepared, index * 0.5, coapDone, req);
+}
+
+static int coapStream(int index, bench_request* req) {
+	return coap->getStream(BENCH_STREAM, coapDone, req);
+}
+
+static int coapStats(int index, bench_request* req) {
+	return coap->getStatsToday(BENCH_STREAM, coapDone, req);
+}
+
+static int coapMixed(int index, bench_request* req) {
+	switch (index % 4) {
+		case 0: return coapCreate(index, req);
+		case 1: return coapRead(index, req);
+		case 2: return coapStats(index, req);
+	}
+	return coapStream(index, req);
+}
+
+/*	Keeps window requests in flight until count have completed	*/
+static bench_result coapRun(const char* name, coap_op op, int count) {
+	bench_result result;
+	result.name = name;
+	result.count = count;
+	result.failed = 0;
+	result.connects = 0;
+	result.latency.reserve(count);
+	pending.assign(count, bench_request());
+	completed = 0;
+	
+	uint64_t before = allocations;
+	unsigned long start = micros();
+	unsigned long progress = millis();
+	int issued = 0;
+	while ((int)completed < count) {
+		coap->run();
+		while ((issued < count) && coap->readyToSend()) {
+			bench_request* req = &pending[issued];
+			req->done = false;
+			req->start = micros();
+			int code = op(issued, req);
+			if ((code == TOKEN_TABLE_FULL) || (code == -1))
+				break;
+			issued++;
+			progress = millis();
+		}
+		if (millis() - progress > BENCH_STALL)
+			break;
+	}
+	result.elapsed = micros() - start;
+	result.allocations = allocations - before;
+	for (int i = 0; i < issued; i++) {
+		if (pending[i].done && pending[i].status)
+			result.latency.push_back(pending[i].end - pending[i].start);
+		else
+			result.failed++;
+	}
+	result.failed += count - issued;
+	return result;
+}
+
+/*	Sends batches one after another	*/
+static bench_result coapBatches(int batches) {
+	bench_result result;
+	result.name = "coap batch";
+	result.count = batches;
+	result.failed = 0;
+	result.connects = 0;
+	pending.assign(batches, bench_request());
+	result.latency.reserve(batches);
+	completed = 0;
+	
+	pond_mock_stats before = mock->stats();
+	uint64_t allocs = allocations;
+	unsigned long start = micros();
+	for (int b = 0; b < batches; b++) {
+		coap->beginBatch();
+		for (int i = 0; i < BATCH_DROPLETS; i++)
+			coap->addDroplet(BENCH_STREAM, b * 100 + i);
+		pending[b].start = micros();
+		if (coap->commitBatch(coapDone, &pending[b]) < 0) {
+			result.failed++;
+			completed++;
+			continue;
+		}
+		coapSettle(b + 1);
+		if (pending[b].done && pending[b].status)
+			result.latency.push_back(pending[b].end - pending[b].start);
+		else
+			result.failed++;
+	}
+	result.elapsed = micros() - start;
+	result.allocations = allocations - allocs;
+	uint32_t stored = mock->stats().droplets - before.droplets;
+	check(stored == (uint32_t)(batches - result.failed) * BATCH_DROPLETS, "every batched droplet reaches the server");
+	return result;
+}
+
+/*	Latency from a droplet landing on the server to the client seeing it, and packets per update	*/
+static void observeVersusPolling() {
+	std::vector<uint32_t> observed, polled;
+	pond_mock_stats before, after;
+	
+	mock->update(OBSERVE_STREAM, -1);
+	observedFresh = false;
+	observedCount = 0;
+	coap->observeStream(OBSERVE_STREAM);
+	unsigned long wait = millis();
+	while (!observedFresh && (millis() - wait < 5000))
+		coap->run();
+	
+	before = mock->stats();
+	for (int i = 0; i < BENCH_UPDATES; i++) {
+		observedFresh = false;
+		unsigned long start = micros();
+		mock->update(OBSERVE_STREAM, i);
+		wait = millis();
+		while (!(observedFresh && (observedValue == i)) && (millis() - wait < 1000))
+			coap->run();
+		if (observedFresh && (observedValue == i))
+			observed.push_back(micros() - start);
+	}
+	after = mock->stats();
+	uint32_t observePackets = (after.datagramsIn + after.datagramsOut) - (before.datagramsIn + before.datagramsOut);
+	coap->cancelObserve(coap->getLastToken());
+	for (wait = millis(); millis() - wait < 100; )
+		coap->run();
+	
+	//Polls go out every POLL_PERIOD ms whether anything changed or not, updates land between them
+	before = mock->stats();
+	bench_request req;
+	req.done = true;
+	bool waiting = false;
+	unsigned long updateStart = 0;
+	unsigned long begin = millis();
+	unsigned long nextPoll = begin;
+	for (int i = 0; i < BENCH_UPDATES; ) {
+		coap->run();
+		unsigned long now = millis();
+		if (!waiting && (now - begin >= (unsigned long)i * UPDATE_PERIOD)) {
+			observedFresh = false;
+			mock->update(OBSERVE_STREAM, 1000 + i);
+			updateStart = micros();
+			waiting = true;
+		}
+		if (req.done && ((long)(now - nextPoll) >= 0)) {
+			nextPoll += POLL_PERIOD;
+			req.done = false;
+			if (coap->getLastDroplet(OBSERVE_STREAM, pollDone, &req) < 0)
+				req.done = true;
+		}
+		if (waiting && observedFresh && (observedValue == 1000 + i)) {
+			polled.push_back(micros() - updateStart);
+			waiting = false;
+			i++;
+		}
+		else if (waiting && (micros() - updateStart > 1000000)) {
+			waiting = false;
+			i++;
+		}
+	}
+	after = mock->stats();
+	uint32_t pollPackets = (after.datagramsIn + after.datagramsOut) - (before.datagramsIn + before.datagramsOut);
+	
+	printf("%-26s %7zu of %d  p50 %7.3f ms  p99 %7.3f ms  %5.2f packets/update\n", "coap observe",
+			observed.size(), BENCH_UPDATES, percentile(observed, 50), percentile(observed, 99),
+			(double)observePackets / BENCH_UPDATES);
+	printf("%-26s %7zu of %d  p50 %7.3f ms  p99 %7.3f ms  %5.2f packets/update (every %d ms)\n", "coap polling",
+			polled.size(), BENCH_UPDATES, percentile(polled, 50), percentile(polled, 99),
+			(double)pollPackets / BENCH_UPDATES, POLL_PERIOD);
+	check(observed.size() == BENCH_UPDATES, "every update is observed");
+	check(polled.size() == BENCH_UPDATES, "every update is polled");
+}
+
+/*	Posts a packed series and checks the mock decoded every sample exactly	*/
+static void seriesCheck() {
+	PondSeries series(SERIES_STREAM, 32);
+	std::vector<pond_mock_sample> sent;
+	pond_mock_stats before = mock->stats();
+	
+	completed = 0;
+	for (int i = 0; i < 32; i++) {
+		pond_mock_sample s = {(uint32_t)(1500000000 + i * 60), 20.0 + (i % 7) * 0.25};
+		sent.push_back(s);
+		coap->sample(&series, s.timestamp, s.value);
+	}
+	unsigned long wait = millis();
+	while ((mock->stats().seriesSamples == before.seriesSamples) && (millis() - wait < 10000))
+		coap->run();
+	
+	std::vector<pond_mock_sample> got = mock->getLastSeries();
+	pond_mock_stats after = mock->stats();
+	uint32_t mismatches = 0;
+	for (size_t i = 0; i < sent.size(); i++) {
+		if ((i >= got.size()) || (got[i].timestamp != sent[i].timestamp) || (got[i].value != sent[i].value))
+			mismatches++;
+	}
+	uint32_t samples = after.seriesSamples - before.seriesSamples;
+	printf("%-26s %7u decoded  %u mismatched  %5.2f bytes/sample\n", "coap series", samples, mismatches,
+			samples ? (double)(after.seriesBytes - before.seriesBytes) / samples : 0);
+	check((samples == sent.size()) && (mismatches == 0), "the mock decodes the series as sent");
+}
+
+static void coapStart() {
+	bench_request login;
+	coap->begin("bench@datapond", "bench", 1);
+	coap->setWindow(window);
+	coap->setReadValueHandler(coapReading);
+	coap->setBlockHandler(coapBlock);
+	
+	completed = 0;
+	login.start = micros();
+	coap->login(coapDone, &login);
+	check(coapSettle(1) && login.status, "CoAP login");
+}
+
+static void coapBench() {
+	coapStart();
+	std::vector<bench_result> results;
+	results.push_back(coapRun("coap create", coapCreate, requests));
+	results.push_back(coapRun("coap read", coapRead, requests));
+	results.push_back(coapRun("coap stats today", coapStats, requests / 10));
+	coap->prepareDroplet(&prepared, BENCH_STREAM);
+	results.push_back(coapRun("coap prepared create", coapPrepared, requests));
+	results.push_back(coapRun("coap stream (block2)", coapStream, requests / 10));
+	results.push_back(coapBatches(requests / 10));
+	for (size_t i = 0; i < results.size(); i++) {
+		report(results[i]);
+		check(results[i].failed == 0, results[i].name);
+		checkAllocations(results[i]);
+	}
+	observeVersusPolling();
+	seriesCheck();
+	
+	const pond_rto* rto = coap->getRtoEstimator();
+	printf("%-26s rto %u ms  %u strong / %u weak samples  %u retransmits  %u timeouts\n", "coap estimator",
+			rto->rto, rto->strongSamples, rto->weakSamples, coap->getRetransmissions(), coap->getExchangeTimeouts());
+}
+
+
+////////////////////////////////////////////////////////
+////			HTTP							 	////
+////////////////////////////////////////////////////////
+
+typedef int (*http_op)(int index);
+
+static int httpCreate(int index) {
+	return http->createDroplet(BENCH_STREAM, index * 0.25);
+}
+
+static int httpRead(int index) {
+	return http->getLastDroplet(BENCH_STREAM);
+}
+
+static int httpStream(int index) {
+	return http->getStream(BENCH_STREAM);
+}
+
+static int httpStats(int index) {
+	return http->getStatsToday(BENCH_STREAM);
+}
+
+static int httpMixed(int index) {
+	switch (index % 4) {
+		case 0: return httpCreate(index);
+		case 1: return httpRead(index);
+		case 2: return httpStats(index);
+	}
+	return httpStream(index);
+}
+
+/*	Blocking requests one after another	*/
+static bench_result httpRun(const char* name, http_op op, int count) {
+	bench_result result;
+	result.name = name;
+	result.count = count;
+	result.failed = 0;
+	result.latency.reserve(count);
+	uint32_t connects = http->getConnects();
+	uint64_t before = allocations;
+	unsigned long start = micros();
+	for (int i = 0; i < count; i++) {
+		unsigned long t = micros();
+		int code = op(i);
+		if ((code >= 200) && (code < 300))
+			result.latency.push_back(micros() - t);
+		else
+			result.failed++;
+	}
+	result.elapsed = micros() - start;
+	result.allocations = allocations - before;
+	result.connects = http->getConnects() - connects;
+	return result;
+}
+
+static unsigned long	pipelineStart;
+static bench_result*	pipelineResult;
+
+static void pipelineResponse(uint8_t index, int code, pond_view body) {
+	if ((code >= 200) && (code < 300))
+		pipelineResult->latency.push_back(micros() - pipelineStart);
+	else
+		pipelineResult->failed++;
+}
+
+/*	Full pipelines of droplets, each response timed from the write of its pipeline	*/
+static bench_result httpPipeline(int count) {
+	bench_result result;
+	result.name = "http pipeline";
+	result.count = 0;
+	result.failed = 0;
+	pipelineResult = &result;
+	result.latency.reserve(count + HTTP_PIPELINE_DEPTH);
+	uint32_t connects = http->getConnects();
+	uint64_t before = allocations;
+	unsigned long start = micros();
+	while ((int)result.count < count) {
+		int queued = 0;
+		while ((queued < HTTP_PIPELINE_DEPTH) && http->queueDroplet(BENCH_STREAM, queued))
+			queued++;
+		pipelineStart = micros();
+		http->sendPipeline(pipelineResponse);
+		result.count += queued;
+	}
+	result.elapsed = micros() - start;
+	result.allocations = allocations - before;
+	result.connects = http->getConnects() - connects;
+	return result;
+}
+
+static void httpBench() {
+	int code = http->login("bench@datapond", "bench");
+	check((code >= 200) && (code < 300), "HTTP login");
+	
+	std::vector<bench_result> results;
+	http->setReuse(true);
+	results.push_back(httpRun("http create (keep-alive)", httpCreate, requests));
+	results.push_back(httpRun("http read (keep-alive)", httpRead, requests));
+	results.push_back(httpRun("http stats today", httpStats, requests / 10));
+	results.push_back(httpRun("http stream (chunked)", httpStream, requests / 10));
+	results.push_back(httpPipeline(requests));
+	http->setReuse(false);
+	results.push_back(httpRun("http create (no reuse)", httpCreate, requests / 4));
+	http->setReuse(true);
+	for (size_t i = 0; i < results.size(); i++) {
+		report(results[i]);
+		check(results[i].failed == 0, results[i].name);
+		checkAllocations(results[i]);
+	}
+	check(results[0].connects <= 1, "keep-alive reuses the connection");
+	
+	double reuse = results[0].count / (results[0].elapsed / 1000000.0);
+	double fresh = results[5].count / (results[5].elapsed / 1000000.0);
+	printf("%-26s %.2fx req/s with reuse\n", "http keep-alive", fresh > 0 ? reuse / fresh : 0);
+}
+
+
+////////////////////////////////////////////////////////
+////			JSON							 	////
+////////////////////////////////////////////////////////
+
+static const char*	readingBody = "{\"stream_id\":1,\"value\":12.5,\"timestamp\":1500000000}";
+static const char*	statsBody = "{\"stream_id\":1,\"min\":11.5,\"max\":13.5,\"avg\":12.5,\"count\":3}";
+
+/*	Pulls one member out the way the clients did before, by offsets into a String copy	*/
+static String stringField(const String& payload, const char* name) {
+	int start = payload.indexOf(name);
+	if (start < 0)
+		return String();
+	start += strlen(name);
+	int end = payload.indexOf(',', start);
+	if (end < 0)
+		end = payload.indexOf('}', start);
+	return payload.substring(start, end);
+}
+
+/*	The old response path: copy the body into a String, then slice out each field	*/
+static void stringReading(const char* body, pond_reading* reading) {
+	String payload = body;
+	String field;
+	reading->fields = 0;
+	if ((field = stringField(payload, "\"value\":")).length() != 0) {
+		reading->value = field.toFloat();
+		reading->fields |= READING_VALUE;
+	}
+	if ((field = stringField(payload, "\"timestamp\":")).length() != 0) {
+		reading->timestamp = field.toInt();
+		reading->fields |= READING_TIMESTAMP;
+	}
+	if ((field = stringField(payload, "\"min\":")).length() != 0) {
+		reading->min = field.toFloat();
+		reading->fields |= READING_MIN;
+	}
+	if ((field = stringField(payload, "\"max\":")).length() != 0) {
+		reading->max = field.toFloat();
+		reading->fields |= READING_MAX;
+	}
+	if ((field = stringField(payload, "\"avg\":")).length() != 0) {
+		reading->avg = field.toFloat();
+		reading->fields |= READING_AVG;
+	}
+	if ((field = stringField(payload, "\"count\":")).length() != 0) {
+		reading->count = field.toInt();
+		reading->fields |= READING_COUNT;
+	}
+}
+
+static bool sameReading(const pond_reading& a, const pond_reading& b) {
+	return (a.fields == b.fields)
+		&& (!(a.fields & READING_VALUE) || (a.value == b.value))
+		&& (!(a.fields & READING_TIMESTAMP) || (a.timestamp == b.timestamp))
+		&& (!(a.fields & READING_MIN) || (a.min == b.min))
+		&& (!(a.fields & READING_MAX) || (a.max == b.max))
+		&& (!(a.fields & READING_AVG) || (a.avg == b.avg))
+		&& (!(a.fields & READING_COUNT) || (a.count == b.count));
+}
+
+/*	Parses one body count times each way and reports us and allocations per response	*/
+static void jsonVersusString(const char* name, const char* body, int count) {
+	uint16_t len = strlen(body);
+	pond_reading parsed;
+	pond_reading sliced;
+	bool same = true;
+	
+	uint64_t before = allocations;
+	unsigned long start = micros();
+	for (int i = 0; i < count; i++)
+		same = pondJsonReading(body, len, &parsed) && same;
+	unsigned long jsonElapsed = micros() - start;
+	uint64_t jsonAllocs = allocations - before;
+	
+	before = allocations;
+	start = micros();
+	for (int i = 0; i < count; i++)
+		stringReading(body, &sliced);
+	unsigned long stringElapsed = micros() - start;
+	uint64_t stringAllocs = allocations - before;
+	
+	printf("%-26s json %6.3f us  %5.2f allocs   String %6.3f us  %5.2f allocs  per response\n", name,
+			(double)jsonElapsed / count, (double)jsonAllocs / count,
+			(double)stringElapsed / count, (double)stringAllocs / count);
+	check(same && sameReading(parsed, sliced), "both paths read the same fields");
+	bench_result result = {name, (uint32_t)count, 0, jsonElapsed, jsonAllocs, 0};
+	checkAllocations(result);
+}
+
+static void jsonBench() {
+	jsonVersusString("json reading", readingBody, requests * 10);
+	jsonVersusString("json stats", statsBody, requests * 10);
+}
+
+
+////////////////////////////////////////////////////////
+////			Soak							 	////
+////////////////////////////////////////////////////////
+
+/*	Resident set of the process in KB, 0 if /proc can't say	*/
+static long residentKb() {
+	long size = 0;
+	long resident = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (statm == NULL)
+		return 0;
+	if (fscanf(statm, "%ld %ld", &size, &resident) != 2)
+		resident = 0;
+	fclose(statm);
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*	Runs soakRequests mixed requests on one client in segments. After the first, no segment may
+	allocate, and neither the client's footprint nor the resident set may grow	*/
+static void soakClient(const char* name, bool useCoap) {
+	int segment = soakRequests / SOAK_SEGMENTS;
+	uint32_t footprint = 0;
+	long resident = 0;
+	long growth = 0;
+	uint64_t allocs = 0;
+	uint32_t failed = 0;
+	bool footprintSteady = true;
+	unsigned long start = millis();
+	
+	for (int s = 0; s < SOAK_SEGMENTS; s++) {
+		bench_result result = useCoap ? coapRun(name, coapMixed, segment) : httpRun(name, httpMixed, segment);
+		uint32_t bytes = useCoap ? coap->memoryFootprint(NULL) : http->memoryFootprint(NULL);
+		long kb = residentKb();
+		failed += result.failed;
+		if (s == 0) {
+			footprint = bytes;
+			resident = kb;
+			continue;
+		}
+		allocs += result.allocations;
+		footprintSteady = footprintSteady && (bytes == footprint);
+		if (kb - resident > growth)
+			growth = kb - resident;
+	}
+	
+	double seconds = (millis() - start) / 1000.0;
+	printf("%-26s %9d req %9.0f req/s  %4u failed  %llu allocations after warm-up  footprint %u bytes  resident +%ld KB\n",
+			name, segment * SOAK_SEGMENTS, (seconds > 0) ? segment * SOAK_SEGMENTS / seconds : 0, failed,
+			(unsigned long long)allocs, footprint, growth);
+	check(failed == 0, name);
+	if ((allocs != 0) || !footprintSteady || (growth > SOAK_RSS_SLACK)) {
+		printf("CHECK FAILED: %s grew\n", name);
+		checksFailed = true;
+	}
+}
+
+static void soak() {
+	coapStart();
+	int code = http->login("bench@datapond", "bench");
+	check((code >= 200) && (code < 300), "HTTP login");
+	http->setReuse(true);
+	soakClient("coap soak", true);
+	soakClient("http soak", false);
+}
+
+
+////////////////////////////////////////////////////////
+////			Main							 	////
+////////////////////////////////////////////////////////
+
+static void usage() {
+	printf("datapond_bench [--requests N] [--window W] [--loss P] [--delay MS] [--separate] [--idle-close MS] [--soak N]\n");
+}
+
+int main(int argc, char** argv) {
+	pond_mock_config config = {0, 0, false, 0};
+	
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--separate") == 0) {
+			config.separate = true;
+			continue;
+		}
+		if (value == NULL) {
+			usage();
+			return 2;
+		}
+		if (strcmp(arg, "--requests") == 0)
+			requests = atoi(value);
+		else if (strcmp(arg, "--window") == 0)
+			window = atoi(value);
+		else if (strcmp(arg, "--loss") == 0)
+			config.loss = atof(value);
+		else if (strcmp(arg, "--delay") == 0)
+			config.delay = atoi(value);
+		else if (strcmp(arg, "--idle-close") == 0)
+			config.idleClose = atoi(value);
+		else if (strcmp(arg, "--soak") == 0)
+			soakRequests = atoi(value);
+		else {
+			usage();
+			return 2;
+		}
+		i++;
+	}
+	loss = config.loss;
+	
+	mock = new PondMockServer(config);
+	if (!mock->start()) {
+		printf("Mock server failed to start\n");
+		return 1;
+	}
+	printf("Mock on CoAP %u and HTTP %u, loss %.2f, delay %u ms%s, %d requests, window %d\n",
+			mock->coapPort(), mock->httpPort(), config.loss, config.delay,
+			config.separate ? ", separate responses" : "", requests, window);
+	
+	coap = new CoapDatapond("127.0.0.1", 0, mock->coapPort());
+	http = new HttpDatapond("127.0.0.1", mock->httpPort());
+	pond_footprint footprint;
+	printf("Client RAM: CoAP %u bytes, HTTP %u bytes\n", coap->memoryFootprint(&footprint), http->memoryFootprint(&footprint));
+	
+	if (soakRequests > 0) {
+		soak();
+	}
+	else {
+		coapBench();
+		httpBench();
+		jsonBench();
+	}
+	
+	pond_mock_stats stats = mock->stats();
+	printf("Mock: %u datagrams in, %u out, %u lost, %u droplets, %u notifications, %u connections, %u HTTP requests\n",
+			stats.datagramsIn, stats.datagramsOut, stats.lost, stats.droplets, stats.notifications,
+			stats.connections, stats.httpRequests);
+	mock->stop();
+	printf(checksFailed ? "FAILED\n" : "OK\n");
+	return checksFailed ? 1 : 0;
+}
@@ -0,0 +1,963 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Loopback stand-in for the datapond server, CoAP and HTTP, with loss and delay
+// Written originally by Embedded Adventures
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include "Arduino.h"
+#include "coap-packet.h"
+#include "datapond-mock.h"
+#include "datapond-coap.h"
+#include "datapond-cbor.h"
+#include "datapond-json.h"
+#include "datapond-series.h"
+#include "datapond-format.h"
+
+//Content formats the mock answers in
+#define		MOCK_FORMAT_JSON	50
+#define		MOCK_FORMAT_CBOR	60
+#define		MOCK_FORMAT_OCTET	42
+
+#define		MOCK_OPT_ETAG		4
+#define		MOCK_OPT_OBSERVE	6
+#define		MOCK_OPT_FORMAT		12
+#define		MOCK_OPT_ACCEPT		17
+#define		MOCK_OPT_BLOCK2		23
+#define		MOCK_OPT_BLOCK1		27
+
+#define		MOCK_CODE_CREATED		0x41
+#define		MOCK_CODE_VALID			0x43
+#define		MOCK_CODE_CONTENT		0x45
+#define		MOCK_CODE_CONTINUE		0x5F
+#define		MOCK_CODE_BAD_REQUEST	0x80
+#define		MOCK_CODE_UNAUTHORIZED	0x81
+#define		MOCK_CODE_NOT_FOUND		0x84
+
+//Largest datagram taken
+#define		MOCK_DATAGRAM_SIZE		1500
+
+//Timeout a separate CON response starts with, as the client's
+#define		MOCK_ACK_TIMEOUT		2000
+#define		MOCK_MAX_RETRANSMIT		4
+
+//Options of a message being built, encoded in increasing order
+class MockOptions {
+	private:
+		std::vector<std::pair<uint16_t, std::string> >	items;
+		
+	public:
+		void	add(uint16_t number, const std::string& value) {
+			items.push_back(std::make_pair(number, value));
+		}
+		
+		void	addUint(uint16_t number, uint32_t value) {
+			std::string bytes;
+			for (; value != 0; value >>= 8)
+				bytes.insert(bytes.begin(), (char)(value & 0xFF));
+			add(number, bytes);
+		}
+		
+		std::string	encode() {
+			std::string out;
+			uint16_t last = 0;
+			std::stable_sort(items.begin(), items.end(),
+				[](const std::pair<uint16_t, std::string>& a, const std::pair<uint16_t, std::string>& b) { return a.first < b.first; });
+			for (size_t i = 0; i < items.size(); i++) {
+				const std::string& value = items[i].second;
+				std::string encoded(pondCoapOptionSize(items[i].first - last, value.size()), '\0');
+				pondCoapOption((uint8_t*)&encoded[0], items[i].first - last, value.size(), value.data());
+				out += encoded;
+				last = items[i].first;
+			}
+			return out;
+		}
+};
+
+static std::string numberText(double value) {
+	char text[POND_NUMBER_SIZE];
+	int len = pondFormatDouble(text, value, 2);
+	return std::string(text, len);
+}
+
+static std::string intText(int32_t value) {
+	char text[POND_NUMBER_SIZE];
+	int len = pondFormatInt(text, value);
+	return std::string(text, len);
+}
+
+static bool samePeer(const struct sockaddr_in& a, const struct sockaddr_in& b) {
+	return (a.sin_port == b.sin_port) && (a.sin_addr.s_addr == b.sin_addr.s_addr);
+}
+
+static void nonBlocking(int fd) {
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+PondMockServer::PondMockServer(const pond_mock_config& settings) {
+	config = settings;
+	running = false;
+	udp = -1;
+	listener = -1;
+	udpPort = 0;
+	tcpPort = 0;
+	messageID = 0x8000;
+	version = 1;
+	random = 0x2545F491;
+	memset(&counts, 0, sizeof(counts));
+}
+
+PondMockServer::~PondMockServer() {
+	stop();
+}
+
+bool PondMockServer::start() {
+	struct sockaddr_in local;
+	socklen_t size = sizeof(local);
+	int on = 1;
+	
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	local.sin_port = 0;
+	
+	udp = socket(AF_INET, SOCK_DGRAM, 0);
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	if ((udp < 0) || (listener < 0))
+		return false;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(udp, (struct sockaddr*)&local, sizeof(local)) != 0)
+		return false;
+	if ((bind(listener, (struct sockaddr*)&local, sizeof(local)) != 0) || (listen(listener, 16) != 0))
+		return false;
+	nonBlocking(udp);
+	nonBlocking(listener);
+	
+	getsockname(udp, (struct sockaddr*)&local, &size);
+	udpPort = ntohs(local.sin_port);
+	size = sizeof(local);
+	getsockname(listener, (struct sockaddr*)&local, &size);
+	tcpPort = ntohs(local.sin_port);
+	
+	running = true;
+	worker = std::thread(&PondMockServer::loop, this);
+	return true;
+}
+
+void PondMockServer::stop() {
+	if (running) {
+		running = false;
+		worker.join();
+	}
+	for (size_t i = 0; i < connections.size(); i++)
+		close(connections[i].fd);
+	connections.clear();
+	if (udp >= 0)
+		close(udp);
+	if (listener >= 0)
+		close(listener);
+	udp = -1;
+	listener = -1;
+}
+
+uint16_t PondMockServer::coapPort() {
+	return udpPort;
+}
+
+uint16_t PondMockServer::httpPort() {
+	return tcpPort;
+}
+
+/*	Takes effect for the next datagram or request	*/
+void PondMockServer::configure(const pond_mock_config& settings) {
+	std::lock_guard<std::mutex> guard(lock);
+	config = settings;
+}
+
+void PondMockServer::update(int stream, double value) {
+	std::lock_guard<std::mutex> guard(lock);
+	storeDroplet(stream, value);
+}
+
+pond_mock_stats PondMockServer::stats() {
+	std::lock_guard<std::mutex> guard(lock);
+	return counts;
+}
+
+void PondMockServer::resetStats() {
+	std::lock_guard<std::mutex> guard(lock);
+	memset(&counts, 0, sizeof(counts));
+}
+
+std::vector<pond_mock_sample> PondMockServer::getLastSeries() {
+	std::lock_guard<std::mutex> guard(lock);
+	return lastSeries;
+}
+
+/*	Decides whether the next datagram or response is lost, xorshift so runs repeat	*/
+bool PondMockServer::lose() {
+	if (config.loss <= 0)
+		return false;
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	if ((random % 10000) >= (uint32_t)(config.loss * 10000))
+		return false;
+	counts.lost++;
+	return true;
+}
+
+/*	Serves until stop(). Everything shared is touched with the lock held	*/
+void PondMockServer::loop() {
+	uint8_t buf[MOCK_DATAGRAM_SIZE];
+	std::vector<struct pollfd> fds;
+	
+	while (running) {
+		fds.clear();
+		struct pollfd p;
+		p.events = POLLIN;
+		p.revents = 0;
+		p.fd = udp;
+		fds.push_back(p);
+		p.fd = listener;
+		fds.push_back(p);
+		for (size_t i = 0; i < connections.size(); i++) {
+			p.fd = connections[i].fd;
+			fds.push_back(p);
+		}
+		poll(&fds[0], fds.size(), 1);
+		
+		std::lock_guard<std::mutex> guard(lock);
+		unsigned long now = millis();
+		if (fds[0].revents & POLLIN) {
+			struct sockaddr_in peer;
+			socklen_t size = sizeof(peer);
+			int len;
+			while ((len = recvfrom(udp, buf, sizeof(buf), 0, (struct sockaddr*)&peer, &size)) > 0) {
+				receiveDatagram(peer, buf, len);
+				size = sizeof(peer);
+			}
+		}
+		if (fds[1].revents & POLLIN)
+			acceptConnection(now);
+		
+		//Connections accepted above have no poll entry yet and are left for the next pass
+		for (size_t i = 0; i < connections.size(); ) {
+			bool open = true;
+			if ((i + 2 < fds.size()) && (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)))
+				open = readConnection(&connections[i], now);
+			if (open)
+				open = writeConnection(&connections[i], now);
+			if (open && (config.idleClose != 0) && connections[i].out.empty() &&
+				(now - connections[i].lastActivity > config.idleClose))
+				open = false;
+			if (open) {
+				i++;
+				continue;
+			}
+			close(connections[i].fd);
+			connections.erase(connections.begin() + i);
+			fds.erase(fds.begin() + i + 2);
+		}
+		flushDatagrams(now);
+	}
+}
+
+
+////////////////////////////////////////////////////////
+////			Droplets						 	////
+////////////////////////////////////////////////////////
+
+void PondMockServer::storeDroplet(int stream, double value) {
+	stream_state& state = streams[stream];
+	state.value = value;
+	state.timestamp = millis() / 1000;
+	state.version = version++;
+	counts.droplets++;
+	notify(stream);
+}
+
+std::string PondMockServer::readingJson(int stream) {
+	stream_state& state = streams[stream];
+	return "{\"stream_id\":" + intText(stream) + ",\"value\":" + numberText(state.value) +
+			",\"timestamp\":" + intText(state.timestamp) + "}";
+}
+
+std::string PondMockServer::statsJson(int stream) {
+	stream_state& state = streams[stream];
+	return "{\"stream_id\":" + intText(stream) + ",\"min\":" + numberText(state.value - 1) +
+			",\"max\":" + numberText(state.value + 1) + ",\"avg\":" + numberText(state.value) + ",\"count\":3}";
+}
+
+/*	Long enough to take several blocks	*/
+std::string PondMockServer::describeStream(int stream) {
+	std::string text = "{\"id\":" + intText(stream) + ",\"name\":\"mock stream\",\"description\":\"";
+	for (int i = 0; i < 24; i++)
+		text += "Readings from the loopback mock. ";
+	return text + "\"}";
+}
+
+/*	Counts the droplets in a JSON array or an indefinite CBOR array of maps	*/
+uint32_t PondMockServer::countBatch(const uint8_t* data, int len, bool cbor) {
+	uint32_t found = 0;
+	if (!cbor) {
+		std::string text((const char*)data, len);
+		for (size_t pos = text.find("stream_id"); pos != std::string::npos; pos = text.find("stream_id", pos + 1))
+			found++;
+		return found;
+	}
+	PondCborReader reader(data, len);
+	uint16_t items;
+	if (!reader.readArray(&items))
+		return 0;
+	while (!reader.atBreak() && (reader.peekType() == CBOR_MAP)) {
+		if (!reader.skip())
+			break;
+		found++;
+	}
+	return found;
+}
+
+
+////////////////////////////////////////////////////////
+////			CoAP							 	////
+////////////////////////////////////////////////////////
+
+std::string PondMockServer::coapMessage(uint8_t type, uint8_t code, uint16_t id, const uint8_t* token,
+										uint8_t tokenLength, const std::string& options, const std::string& payload) {
+	uint8_t head[COAP_HEADER_SIZE + 8];
+	int len = pondCoapHeader(head, type, code, id, token, tokenLength);
+	std::string message((const char*)head, len);
+	message += options;
+	if (!payload.empty()) {
+		message += (char)COAP_PAYLOAD_MARKER;
+		message += payload;
+	}
+	return message;
+}
+
+/*	Sends after the configured delay, unless it's lost	*/
+void PondMockServer::sendDatagram(const struct sockaddr_in& peer, const std::string& data) {
+	counts.datagramsOut++;
+	if (lose())
+		return;
+	if (config.delay == 0) {
+		sendto(udp, data.data(), data.size(), 0, (struct sockaddr*)&peer, sizeof(peer));
+		return;
+	}
+	datagram held;
+	held.due = millis() + config.delay;
+	held.peer = peer;
+	held.data = data;
+	held.retransmits = 0;
+	held.timeout = 0;
+	outgoing.push_back(held);
+}
+
+/*	Sends what the delay held back, and resends separate responses that got no ACK	*/
+void PondMockServer::flushDatagrams(unsigned long now) {
+	for (size_t i = 0; i < outgoing.size(); ) {
+		if ((long)(now - outgoing[i].due) < 0) {
+			i++;
+			continue;
+		}
+		sendto(udp, outgoing[i].data.data(), outgoing[i].data.size(), 0,
+				(struct sockaddr*)&outgoing[i].peer, sizeof(outgoing[i].peer));
+		outgoing.erase(outgoing.begin() + i);
+	}
+	for (size_t i = 0; i < confirmable.size(); ) {
+		datagram& con = confirmable[i];
+		if ((long)(now - con.due) < 0) {
+			i++;
+			continue;
+		}
+		if (con.retransmits >= MOCK_MAX_RETRANSMIT) {
+			confirmable.erase(confirmable.begin() + i);
+			continue;
+		}
+		con.retransmits++;
+		con.timeout *= 2;
+		con.due = now + con.timeout;
+		sendDatagram(con.peer, con.data);
+		i++;
+	}
+}
+
+void PondMockServer::receiveDatagram(const struct sockaddr_in& peer, const uint8_t* pkt, int len) {
+	counts.datagramsIn++;
+	if ((len < COAP_HEADER_SIZE) || lose())
+		return;
+	uint8_t type = (pkt[0] >> 4) & 0x03;
+	uint16_t id = (pkt[2] << 8) | pkt[3];
+	
+	//ACKs and resets end a separate response's retransmissions, a reset also ends an observation
+	if ((type == TYPE_ACK) || (type == TYPE_RST)) {
+		for (size_t i = 0; i < confirmable.size(); i++) {
+			const uint8_t* sent = (const uint8_t*)confirmable[i].data.data();
+			if (samePeer(confirmable[i].peer, peer) && (((sent[2] << 8) | sent[3]) == id)) {
+				confirmable.erase(confirmable.begin() + i);
+				break;
+			}
+		}
+		return;
+	}
+	if (pkt[1] == 0)
+		return;
+	
+	//A CON seen before is answered as it was the first time
+	if (type == TYPE_CON) {
+		for (size_t i = 0; i < replies.size(); i++) {
+			if ((replies[i].messageID == id) && samePeer(replies[i].peer, peer)) {
+				sendDatagram(peer, replies[i].reply);
+				return;
+			}
+		}
+	}
+	answerCoap(peer, pkt, len);
+}
+
+/*	Answers piggybacked, separately, or for NON requests with a NON. NON droplets get no answer	*/
+void PondMockServer::answerCoap(const struct sockaddr_in& peer, const uint8_t* pkt, int len) {
+	uint8_t type = (pkt[0] >> 4) & 0x03;
+	uint8_t tokenLength = pkt[0] & 0x0F;
+	uint16_t id = (pkt[2] << 8) | pkt[3];
+	const uint8_t* token = pkt + COAP_HEADER_SIZE;
+	uint8_t code;
+	observer watch;
+	
+	if ((tokenLength > 8) || (len < COAP_HEADER_SIZE + tokenLength))
+		return;
+	watch.stream = -1;
+	std::string tail = coapResponse(pkt, len, &code, &watch);
+	if (watch.stream >= 0) {
+		watch.peer = peer;
+		memcpy(watch.token, token, tokenLength);
+		watch.tokenLength = tokenLength;
+		observers.push_back(watch);
+	}
+	
+	std::string reply;
+	if (type == TYPE_NON) {
+		if (pkt[1] == COAP_POST)
+			return;
+		reply = coapMessage(TYPE_NON, code, messageID++, token, tokenLength, "", "");
+		reply += tail;
+		sendDatagram(peer, reply);
+		return;
+	}
+	if (config.separate) {
+		reply = coapMessage(TYPE_ACK, 0, id, NULL, 0, "", "");
+		std::string response = coapMessage(TYPE_CON, code, messageID++, token, tokenLength, "", "");
+		response += tail;
+		datagram con;
+		con.peer = peer;
+		con.data = response;
+		con.retransmits = 0;
+		con.timeout = MOCK_ACK_TIMEOUT;
+		con.due = millis() + config.delay + con.timeout;
+		confirmable.push_back(con);
+		sendDatagram(peer, reply);
+		sendDatagram(peer, response);
+	}
+	else {
+		reply = coapMessage(TYPE_ACK, code, id, token, tokenLength, "", "");
+		reply += tail;
+		sendDatagram(peer, reply);
+	}
+	
+	cached_reply cached;
+	cached.messageID = id;
+	cached.peer = peer;
+	cached.reply = reply;
+	if (replies.size() == MOCK_REPLY_CACHE)
+		replies.erase(replies.begin());
+	replies.push_back(cached);
+}
+
+/*	Runs the request, returning the options and payload of its response. A new observation is left in watch	*/
+std::string PondMockServer::coapResponse(const uint8_t* pkt, int len, uint8_t* code, observer* watch) {
+	pond_coap_options it;
+	std::string path, session, etag, value;
+	int stream = 0, format = -1, accept = -1;
+	bool observe = false, hasValue = false;
+	uint32_t observeValue = 0, block1 = 0, block2 = 0;
+	bool hasBlock1 = false, hasBlock2 = false;
+	
+	for (bool more = pondCoapFirstOption(&it, pkt, len); more; more = pondCoapNextOption(&it)) {
+		std::string text((const char*)it.value, it.valueLength);
+		switch (it.number) {
+			case OPT_URI_PATH:
+				path += (path.empty() ? "" : "/") + text;
+				break;
+			case OPT_URI_QUERY:
+				if (text.compare(0, 7, "stream=") == 0)
+					stream = atoi(text.c_str() + 7);
+				else if (text.compare(0, 8, "session=") == 0)
+					session = text.substr(8);
+				else if (text.compare(0, 6, "value=") == 0) {
+					value = text.substr(6);
+					hasValue = true;
+				}
+				break;
+			case MOCK_OPT_ETAG:
+				etag = text;
+				break;
+			case MOCK_OPT_OBSERVE:
+				observe = true;
+				observeValue = pondCoapUint(it.value, it.valueLength);
+				break;
+			case MOCK_OPT_FORMAT:
+				format = pondCoapUint(it.value, it.valueLength);
+				break;
+			case MOCK_OPT_ACCEPT:
+				accept = pondCoapUint(it.value, it.valueLength);
+				break;
+			case MOCK_OPT_BLOCK2:
+				hasBlock2 = true;
+				block2 = pondCoapUint(it.value, it.valueLength);
+				break;
+			case MOCK_OPT_BLOCK1:
+				hasBlock1 = true;
+				block1 = pondCoapUint(it.value, it.valueLength);
+				break;
+		}
+	}
+	const uint8_t* payload;
+	int payloadLength = pondCoapPayload(pkt, len, &payload);
+	uint8_t method = pkt[1];
+	MockOptions options;
+	std::string body;
+	int bodyFormat = MOCK_FORMAT_JSON;
+	
+	if (path == "user/login") {
+		pond_view email;
+		bool valid = (method == COAP_POST) && pondJsonFind((const char*)payload, payloadLength, "email", &email);
+		*code = valid ? MOCK_CODE_CREATED : MOCK_CODE_BAD_REQUEST;
+		if (valid) {
+			options.addUint(MOCK_OPT_FORMAT, MOCK_FORMAT_JSON);
+			body = "{\"session\":\"" MOCK_SESSION "\"}";
+		}
+		return options.encode() + (body.empty() ? "" : std::string(1, (char)COAP_PAYLOAD_MARKER) + body);
+	}
+	if (session != MOCK_SESSION) {
+		counts.unauthorized++;
+		*code = MOCK_CODE_UNAUTHORIZED;
+		return "";
+	}
+	
+	*code = MOCK_CODE_NOT_FOUND;
+	if ((path == "droplet") && (method == COAP_POST)) {
+		double number = 0;
+		//CBOR droplets carry {"value": v}, text ones a value= query
+		if (format == MOCK_FORMAT_CBOR) {
+			PondCborReader reader(payload, payloadLength);
+			uint16_t pairs;
+			const char* key;
+			uint16_t keyLength;
+			if (reader.readMap(&pairs) && reader.readText(&key, &keyLength) && (keyLength == 5) &&
+				(memcmp(key, "value", 5) == 0)) {
+				const char* text;
+				uint16_t textLength;
+				hasValue = (reader.peekType() == CBOR_TEXT) ? reader.readText(&text, &textLength) : reader.readNumber(&number);
+			}
+		}
+		else if (hasValue) {
+			number = strtod(value.c_str(), NULL);
+		}
+		*code = hasValue ? MOCK_CODE_CREATED : MOCK_CODE_BAD_REQUEST;
+		if (hasValue)
+			storeDroplet(stream, number);
+	}
+	else if ((path == "droplet/batch") && (method == COAP_POST)) {
+		std::string key = intText(pkt[0] & 0x0F) + std::string((const char*)pkt + COAP_HEADER_SIZE, pkt[0] & 0x0F);
+		std::string& upload = uploads[key];
+		uint32_t offset = hasBlock1 ? (COAP_BLOCK_NUM(block1) << (COAP_BLOCK_SZX(block1) + 4)) : 0;
+		if (offset == 0)
+			upload.clear();
+		if (offset == upload.size())
+			upload.append((const char*)payload, payloadLength);
+		if (hasBlock1) {
+			uint8_t option[3];
+			int optionLength = pondCoapBlockOption(option, COAP_BLOCK_NUM(block1), COAP_BLOCK_MORE(block1), COAP_BLOCK_SZX(block1));
+			options.add(MOCK_OPT_BLOCK1, std::string((const char*)option, optionLength));
+		}
+		if (hasBlock1 && COAP_BLOCK_MORE(block1)) {
+			*code = MOCK_CODE_CONTINUE;
+		}
+		else {
+			uint32_t found = countBatch((const uint8_t*)upload.data(), upload.size(), format == MOCK_FORMAT_CBOR);
+			counts.droplets += found;
+			uploads.erase(key);
+			*code = (found > 0) ? MOCK_CODE_CREATED : MOCK_CODE_BAD_REQUEST;
+		}
+	}
+	else if ((path == "droplet/series") && (method == COAP_POST)) {
+		PondSeriesReader reader(payload, payloadLength);
+		pond_mock_sample sample;
+		lastSeries.clear();
+		while (reader.next(&sample.timestamp, &sample.value))
+			lastSeries.push_back(sample);
+		bool whole = (format == MOCK_FORMAT_OCTET) && !lastSeries.empty() && (lastSeries.size() == reader.count());
+		*code = whole ? MOCK_CODE_CREATED : MOCK_CODE_BAD_REQUEST;
+		if (whole) {
+			counts.seriesSamples += lastSeries.size();
+			counts.seriesBytes += payloadLength;
+			series[stream] = std::string((const char*)payload, payloadLength);
+			storeDroplet(stream, lastSeries.back().value);
+			counts.droplets += lastSeries.size() - 1;
+		}
+	}
+	else if ((path == "droplet/series") && (series.count(stream) != 0)) {
+		*code = MOCK_CODE_CONTENT;
+		body = series[stream];
+		bodyFormat = MOCK_FORMAT_OCTET;
+	}
+	else if ((path == "droplet/last") && (streams.count(stream) != 0)) {
+		stream_state& state = streams[stream];
+		std::string tag;
+		for (int shift = 24; shift >= 0; shift -= 8)
+			tag += (char)((state.version >> shift) & 0xFF);
+		if (observe) {
+			for (size_t i = 0; i < observers.size(); i++) {
+				if ((observers[i].tokenLength == (pkt[0] & 0x0F)) &&
+					(memcmp(observers[i].token, pkt + COAP_HEADER_SIZE, observers[i].tokenLength) == 0)) {
+					observers.erase(observers.begin() + i);
+					break;
+				}
+			}
+			if (observeValue == 0) {
+				watch->stream = stream;
+				watch->seq = state.version;
+				watch->format = (accept == MOCK_FORMAT_CBOR) ? MOCK_FORMAT_CBOR : MOCK_FORMAT_JSON;
+				options.addUint(MOCK_OPT_OBSERVE, watch->seq);
+			}
+		}
+		options.add(MOCK_OPT_ETAG, tag);
+		if (!observe && (etag == tag)) {
+			*code = MOCK_CODE_VALID;
+		}
+		else {
+			*code = MOCK_CODE_CONTENT;
+			if (accept == MOCK_FORMAT_CBOR) {
+				uint8_t buf[64];
+				PondCborWriter cbor(buf, sizeof(buf));
+				cbor.beginMap(3);
+				cbor.writeText("stream_id");
+				cbor.writeInt(stream);
+				cbor.writeText("value");
+				cbor.writeDouble(state.value);
+				cbor.writeText("timestamp");
+				cbor.writeUnsigned(state.timestamp);
+				body = std::string((const char*)buf, cbor.length());
+				bodyFormat = MOCK_FORMAT_CBOR;
+			}
+			else {
+				body = readingJson(stream);
+			}
+		}
+	}
+	else if ((path.compare(0, 19, "stream/stats/today/") == 0) && (streams.count(atoi(path.c_str() + 19)) != 0)) {
+		*code = MOCK_CODE_CONTENT;
+		body = statsJson(atoi(path.c_str() + 19));
+	}
+	else if ((path.compare(0, 7, "stream/") == 0) && (path.find('/', 7) == std::string::npos)) {
+		*code = MOCK_CODE_CONTENT;
+		body = describeStream(atoi(path.c_str() + 7));
+	}
+	
+	//Bodies bigger than a block go out a block at a time, at the smaller of the two block sizes
+	if (!body.empty()) {
+		uint8_t szx = MOCK_BLOCK_SZX;
+		uint32_t num = 0;
+		if (hasBlock2) {
+			if (COAP_BLOCK_SZX(block2) < szx)
+				szx = COAP_BLOCK_SZX(block2);
+			num = COAP_BLOCK_NUM(block2);
+		}
+		uint32_t size = 16 << szx;
+		if ((body.size() > size) || (num > 0)) {
+			uint32_t offset = num * size;
+			if (offset >= body.size()) {
+				*code = MOCK_CODE_BAD_REQUEST;
+				return "";
+			}
+			bool more = (offset + size < body.size());
+			body = body.substr(offset, size);
+			uint8_t option[3];
+			int optionLength = pondCoapBlockOption(option, num, more, szx);
+			options.add(MOCK_OPT_BLOCK2, std::string((const char*)option, optionLength));
+		}
+		options.addUint(MOCK_OPT_FORMAT, bodyFormat);
+	}
+	std::string tail = options.encode();
+	if (!body.empty()) {
+		tail += (char)COAP_PAYLOAD_MARKER;
+		tail += body;
+	}
+	return tail;
+}
+
+/*	Sends every observer of stream a NON notification	*/
+void PondMockServer::notify(int stream) {
+	for (size_t i = 0; i < observers.size(); i++) {
+		observer& watch = observers[i];
+		if (watch.stream != stream)
+			continue;
+		MockOptions options;
+		std::string body;
+		options.addUint(MOCK_OPT_OBSERVE, ++watch.seq & 0xFFFFFF);
+		options.addUint(MOCK_OPT_FORMAT, watch.format);
+		if (watch.format == MOCK_FORMAT_CBOR) {
+			uint8_t buf[64];
+			PondCborWriter cbor(buf, sizeof(buf));
+			cbor.beginMap(2);
+			cbor.writeText("stream_id");
+			cbor.writeInt(stream);
+			cbor.writeText("value");
+			cbor.writeDouble(streams[stream].value);
+			body = std::string((const char*)buf, cbor.length());
+		}
+		else {
+			body = readingJson(stream);
+		}
+		counts.notifications++;
+		sendDatagram(watch.peer, coapMessage(TYPE_NON, MOCK_CODE_CONTENT, messageID++, watch.token,
+											watch.tokenLength, options.encode(), body));
+	}
+}
+
+
+////////////////////////////////////////////////////////
+////			HTTP							 	////
+////////////////////////////////////////////////////////
+
+void PondMockServer::acceptConnection(unsigned long now) {
+	int fd;
+	int on = 1;
+	while ((fd = accept(listener, NULL, NULL)) >= 0) {
+		nonBlocking(fd);
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		connection conn;
+		conn.fd = fd;
+		conn.lastActivity = now;
+		conn.closing = false;
+		connections.push_back(conn);
+		counts.connections++;
+	}
+}
+
+/*	Reads what arrived and takes every complete request. Returns false once the client has closed	*/
+bool PondMockServer::readConnection(connection* conn, unsigned long now) {
+	char buf[2048];
+	int len;
+	while ((len = recv(conn->fd, buf, sizeof(buf), 0)) > 0) {
+		conn->in.append(buf, len);
+		conn->lastActivity = now;
+	}
+	if ((len == 0) || ((len < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)))
+		return !conn->out.empty();
+	while (!conn->closing && takeRequest(conn, now))
+		;
+	return true;
+}
+
+/*	Writes replies whose delay is up. Returns false once a reply closes the connection	*/
+bool PondMockServer::writeConnection(connection* conn, unsigned long now) {
+	while (!conn->out.empty() && ((long)(now - conn->out[0].due) >= 0)) {
+		http_reply& reply = conn->out[0];
+		if (!reply.data.empty())
+			send(conn->fd, reply.data.data(), reply.data.size(), MSG_NOSIGNAL);
+		conn->lastActivity = now;
+		if (reply.close)
+			return false;
+		conn->out.erase(conn->out.begin());
+	}
+	return true;
+}
+
+/*	Takes one complete request off the connection, chunked bodies included. False if none is complete	*/
+bool PondMockServer::takeRequest(connection* conn, unsigned long now) {
+	size_t end = conn->in.find("\r\n\r\n");
+	if (end == std::string::npos)
+		return false;
+	std::string head = conn->in.substr(0, end);
+	size_t pos = end + 4;
+	std::string method, path, cookie, match;
+	long contentLength = 0;
+	bool chunked = false, closeAfter = false;
+	
+	size_t lineEnd = head.find("\r\n");
+	std::string line = head.substr(0, lineEnd);
+	size_t space = line.find(' ');
+	method = line.substr(0, space);
+	path = line.substr(space + 1, line.find(' ', space + 1) - space - 1);
+	while (lineEnd != std::string::npos) {
+		size_t start = lineEnd + 2;
+		lineEnd = head.find("\r\n", start);
+		line = head.substr(start, (lineEnd == std::string::npos) ? std::string::npos : lineEnd - start);
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			continue;
+		std::string name = line.substr(0, colon);
+		std::string value = line.substr(colon + 1);
+		value.erase(0, value.find_first_not_of(' '));
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+		if (name == "content-length")
+			contentLength = atol(value.c_str());
+		else if (name == "transfer-encoding")
+			chunked = (value.find("chunked") != std::string::npos);
+		else if (name == "cookie")
+			cookie = value;
+		else if (name == "if-none-match")
+			match = value;
+		else if (name == "connection")
+			closeAfter = (value.find("close") != std::string::npos);
+	}
+	
+	std::string body;
+	if (chunked) {
+		while (true) {
+			size_t sizeEnd = conn->in.find("\r\n", pos);
+			if (sizeEnd == std::string::npos)
+				return false;
+			long size = strtol(conn->in.c_str() + pos, NULL, 16);
+			if (size == 0) {
+				if (conn->in.size() < sizeEnd + 4)
+					return false;
+				pos = sizeEnd + 4;
+				break;
+			}
+			if (conn->in.size() < sizeEnd + 2 + size + 2)
+				return false;
+			body.append(conn->in, sizeEnd + 2, size);
+			pos = sizeEnd + 2 + size + 2;
+		}
+	}
+	else {
+		if (conn->in.size() < pos + contentLength)
+			return false;
+		body = conn->in.substr(pos, contentLength);
+		pos += contentLength;
+	}
+	conn->in.erase(0, pos);
+	counts.httpRequests++;
+	
+	//A lost response closes the connection unanswered, everything behind it is lost too
+	http_reply reply;
+	reply.due = now + config.delay;
+	reply.close = closeAfter;
+	if (lose()) {
+		reply.close = true;
+		conn->closing = true;
+	}
+	else {
+		reply.data = httpResponse(method, path, cookie, match, body);
+	}
+	if (reply.close)
+		conn->closing = true;
+	conn->out.push_back(reply);
+	return true;
+}
+
+static std::string httpReply(int status, const char* reason, const std::string& body, const std::string& etag, bool chunked) {
+	std::string reply = "HTTP/1.1 " + intText(status) + " " + reason + "\r\n";
+	if (!etag.empty())
+		reply += "ETag: " + etag + "\r\n";
+	if ((status == 304) || (status == 204))
+		return reply + "\r\n";
+	reply += "Content-Type: application/json\r\n";
+	if (!chunked)
+		return reply + "Content-Length: " + intText(body.size()) + "\r\n\r\n" + body;
+	
+	//Sent in small chunks so the client's chunk parser gets some work
+	reply += "Transfer-Encoding: chunked\r\n\r\n";
+	for (size_t pos = 0; pos < body.size(); pos += 100) {
+		std::string chunk = body.substr(pos, 100);
+		char size[8];
+		snprintf(size, sizeof(size), "%X", (unsigned)chunk.size());
+		reply += std::string(size) + "\r\n" + chunk + "\r\n";
+	}
+	return reply + "0\r\n\r\n";
+}
+
+std::string PondMockServer::httpResponse(const std::string& method, const std::string& target, const std::string& cookie,
+										const std::string& match, const std::string& body) {
+	size_t question = target.find('?');
+	std::string path = target.substr(0, question);
+	std::string query = (question == std::string::npos) ? "" : target.substr(question + 1);
+	int stream = 0;
+	size_t at = query.find("stream=");
+	if (at != std::string::npos)
+		stream = atoi(query.c_str() + at + 7);
+	
+	if ((path == "/user/login") && (method == "POST")) {
+		pond_view email;
+		if (!pondJsonFind(body.data(), body.size(), "email", &email))
+			return httpReply(400, "Bad Request", "{}", "", false);
+		return httpReply(200, "OK", "{\"session\":\"" MOCK_SESSION "\"}", "", false);
+	}
+	if (cookie.find("session=" MOCK_SESSION) == std::string::npos) {
+		counts.unauthorized++;
+		return httpReply(401, "Unauthorized", "{}", "", false);
+	}
+	
+	if ((path == "/droplet") && (method == "POST")) {
+		pond_view value;
+		if (!pondJsonFind(body.data(), body.size(), "value", &value))
+			return httpReply(400, "Bad Request", "{}", "", false);
+		storeDroplet(stream, pondViewNumber(value));
+		return httpReply(200, "OK", "{\"status\":\"created\"}", "", false);
+	}
+	if ((path == "/droplet/batch") && (method == "POST")) {
+		uint32_t found = countBatch((const uint8_t*)body.data(), body.size(), false);
+		counts.droplets += found;
+		return httpReply(200, "OK", "{\"created\":" + intText(found) + "}", "", false);
+	}
+	if ((path == "/droplet/last") && (streams.count(stream) != 0)) {
+		std::string tag = "\"" + intText(streams[stream].version) + "\"";
+		if (match == tag)
+			return httpReply(304, "Not Modified", "", tag, false);
+		return httpReply(200, "OK", readingJson(stream), tag, false);
+	}
+	if ((path.compare(0, 20, "/stream/stats/today/") == 0) && (streams.count(atoi(path.c_str() + 20)) != 0))
+		return httpReply(200, "OK", statsJson(atoi(path.c_str() + 20)), "", false);
+	if ((path.compare(0, 8, "/stream/") == 0) && isdigit(path[8]))
+		return httpReply(200, "OK", describeStream(atoi(path.c_str() + 8)), "", true);
+	if (path == "/pond/count")
+		return httpReply(200, "OK", "{\"count\":1}", "", false);
+	return httpReply(404, "Not Found", "{}", "", false);
+}
@@ -0,0 +1,189 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Loopback stand-in for the datapond server, CoAP and HTTP, with loss and delay
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_mock_h
+#define __datapond_mock_h
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <map>
+#include <string>
+#include <netinet/in.h>
+
+//Session handed out by user/login, and the cookie query or header requests must carry
+#define		MOCK_SESSION		"mock"
+//Bytes the mock's CoAP blocks hold at most, the client may ask for smaller ones
+#define		MOCK_BLOCK_SZX		4
+//Replies remembered for answering duplicate CONs
+#define		MOCK_REPLY_CACHE	64
+
+typedef struct {
+	float		loss;			//Chance each datagram, or each HTTP response, is lost. 0 to 1
+	uint32_t	delay;			//ms before every reply goes out
+	bool		separate;		//CONs get an empty ACK, the response follows as a CON of its own
+	uint32_t	idleClose;		//ms before an idle HTTP connection is closed, 0 never
+} pond_mock_config;
+
+typedef struct {
+	uint32_t	datagramsIn;	//Requests, ACKs and resends, lost ones included
+	uint32_t	datagramsOut;	//Replies and notifications, lost ones included
+	uint32_t	lost;
+	uint32_t	droplets;		//Stored through either server, batches and series included
+	uint32_t	notifications;
+	uint32_t	seriesSamples;	//Decoded from posted series
+	uint32_t	seriesBytes;	//Payload bytes of the series they came in
+	uint32_t	connections;
+	uint32_t	httpRequests;
+	uint32_t	unauthorized;
+} pond_mock_stats;
+
+typedef struct {
+	uint32_t	timestamp;
+	double		value;
+} pond_mock_sample;
+
+class PondMockServer {
+	private:
+		typedef struct {
+			double		value;
+			uint32_t	timestamp;
+			uint32_t	version;	//Changes with every droplet, used as the ETag
+		} stream_state;
+		
+		typedef struct {
+			struct sockaddr_in	peer;
+			uint8_t				token[8];
+			uint8_t				tokenLength;
+			int					stream;
+			uint32_t			seq;
+			uint8_t				format;
+		} observer;
+		
+		//Datagram held back by the delay, or a CON response waiting on its ACK
+		typedef struct {
+			unsigned long		due;
+			struct sockaddr_in	peer;
+			std::string			data;
+			uint8_t				retransmits;
+			uint32_t			timeout;
+		} datagram;
+		
+		typedef struct {
+			uint16_t			messageID;
+			struct sockaddr_in	peer;
+			std::string			reply;
+		} cached_reply;
+		
+		typedef struct {
+			unsigned long	due;
+			std::string		data;
+			bool			close;
+		} http_reply;
+		
+		typedef struct {
+			int						fd;
+			std::string				in;
+			std::vector<http_reply>	out;
+			unsigned long			lastActivity;
+			bool					closing;	//Nothing more is read once a reply closes it
+		} connection;
+		
+		pond_mock_config	config;
+		std::thread			worker;
+		std::atomic<bool>	running;
+		std::mutex			lock;
+		pond_mock_stats		counts;
+		
+		int			udp;
+		int			listener;
+		uint16_t	udpPort;
+		uint16_t	tcpPort;
+		uint16_t	messageID;
+		uint32_t	version;
+		uint32_t	random;
+		
+		std::map<int, stream_state>		streams;
+		std::vector<observer>			observers;
+		std::vector<datagram>			outgoing;		//Waiting on their delay
+		std::vector<datagram>			confirmable;	//Separate responses waiting on an ACK
+		std::vector<cached_reply>		replies;
+		std::map<std::string, std::string>	uploads;	//Block1 bodies by token
+		std::map<int, std::string>		series;			//Last series posted per stream
+		std::vector<pond_mock_sample>	lastSeries;
+		std::vector<connection>			connections;
+		
+		void	loop();
+		bool	lose();
+		
+		void	storeDroplet(int stream, double value);
+		void	notify(int stream);
+		void	sendDatagram(const struct sockaddr_in& peer, const std::string& data);
+		void	flushDatagrams(unsigned long now);
+		void	receiveDatagram(const struct sockaddr_in& peer, const uint8_t* pkt, int len);
+		void	answerCoap(const struct sockaddr_in& peer, const uint8_t* pkt, int len);
+		std::string	coapResponse(const uint8_t* pkt, int len, uint8_t* code, observer* watch);
+		std::string	coapMessage(uint8_t type, uint8_t code, uint16_t id, const uint8_t* token, uint8_t tokenLength,
+								const std::string& options, const std::string& payload);
+		
+		void	acceptConnection(unsigned long now);
+		bool	readConnection(connection* conn, unsigned long now);
+		bool	writeConnection(connection* conn, unsigned long now);
+		bool	takeRequest(connection* conn, unsigned long now);
+		std::string	httpResponse(const std::string& method, const std::string& path, const std::string& cookie,
+								const std::string& match, const std::string& body);
+		
+		std::string	readingJson(int stream);
+		std::string	statsJson(int stream);
+		std::string	describeStream(int stream);
+		uint32_t	countBatch(const uint8_t* data, int len, bool cbor);
+		
+	public:
+		PondMockServer(const pond_mock_config& settings);
+		~PondMockServer();
+		//Binds both servers to ephemeral loopback ports and starts serving
+		bool		start();
+		void		stop();
+		uint16_t	coapPort();
+		uint16_t	httpPort();
+		void		configure(const pond_mock_config& settings);
+		
+		//Stores a droplet as another device would, observers of the stream are notified
+		void		update(int stream, double value);
+		pond_mock_stats	stats();
+		void		resetStats();
+		std::vector<pond_mock_sample>	getLastSeries();
+};
+
+#endif
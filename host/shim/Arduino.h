@@ -0,0 +1,133 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Host stand-in for the parts of the Arduino core the datapond libraries use
+// Written originally by Embedded Adventures
+
+#ifndef __host_arduino_h
+#define __host_arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+typedef uint8_t		byte;
+typedef bool		boolean;
+
+//Time since the program started
+unsigned long	millis();
+unsigned long	micros();
+void			delay(unsigned long ms);
+//Lets other threads run, the mock server among them
+void			yield();
+
+//Heap backed like the Arduino one, so its allocations show up in the benchmark's counts
+class String {
+	private:
+		char*			buffer;
+		unsigned int	len;
+		unsigned int	capacity;
+		
+		bool	grow(unsigned int size);
+		String&	append(const char* text, unsigned int textLength);
+		
+	public:
+		String(const char* text = "");
+		String(const String& other);
+		String(char c);
+		String(int value);
+		String(unsigned long value);
+		String(double value, unsigned char decimals = 2);
+		~String();
+		
+		String&	operator=(const String& other);
+		String&	operator=(const char* text);
+		String&	operator+=(const String& other);
+		String&	operator+=(const char* text);
+		String&	operator+=(char c);
+		bool	operator==(const String& other) const;
+		bool	operator==(const char* text) const;
+		char	operator[](unsigned int index) const;
+		
+		unsigned int	length() const;
+		const char*		c_str() const;
+		bool			reserve(unsigned int size);
+		int				indexOf(char c) const;
+		int				indexOf(char c, unsigned int from) const;
+		int				indexOf(const char* text) const;
+		String			substring(unsigned int from, unsigned int to) const;
+		long			toInt() const;
+		float			toFloat() const;
+};
+
+String	operator+(const String& a, const String& b);
+
+class Print {
+	public:
+		virtual ~Print() { }
+		virtual size_t	write(uint8_t b) = 0;
+		virtual size_t	write(const uint8_t* data, size_t len);
+		virtual void	flush() { }
+		
+		size_t	print(const char* text);
+		size_t	print(const String& text);
+		size_t	print(char c);
+		size_t	print(int n);
+		size_t	print(unsigned int n);
+		size_t	print(long n);
+		size_t	print(unsigned long n);
+		size_t	print(double n, int digits = 2);
+		size_t	println();
+		template <typename T>
+		size_t	println(T value) { size_t n = print(value); return n + println(); }
+};
+
+class Stream : public Print {
+	public:
+		virtual int		available() = 0;
+		virtual int		read() = 0;
+		virtual int		peek() = 0;
+};
+
+//Serial output goes to stdout
+class HostSerial : public Print {
+	public:
+		void	begin(unsigned long baud) { }
+		size_t	write(uint8_t b);
+		size_t	write(const uint8_t* data, size_t len);
+};
+
+extern HostSerial	Serial;
+
+#endif
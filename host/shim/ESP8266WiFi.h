@@ -0,0 +1,66 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Host stand-in for the ESP8266 WiFi client, a plain TCP socket
+// Written originally by Embedded Adventures
+
+#ifndef __host_esp8266wifi_h
+#define __host_esp8266wifi_h
+
+#include "Arduino.h"
+
+//TCP connection with the Arduino client's calls. connected() stays true while unread data is left
+class WiFiClient {
+	private:
+		int		fd;
+		
+		WiFiClient(const WiFiClient&);
+		WiFiClient&	operator=(const WiFiClient&);
+		
+	public:
+		WiFiClient();
+		~WiFiClient();
+		
+		int		connect(const char* host, uint16_t port);
+		uint8_t	connected();
+		int		available();
+		int		read();
+		int		read(uint8_t* buf, size_t size);
+		int		peek();
+		size_t	write(uint8_t b);
+		size_t	write(const uint8_t* buf, size_t size);
+		void	flush() { }
+		void	stop();
+		void	setNoDelay(bool nodelay);
+};
+
+//Resolves host to an IPv4 address. Returns false if it can't be
+bool	hostResolve(const char* host, uint16_t port, void* address);
+
+#endif
@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Host stand-in for the ESP8266 UDP socket
+// Written originally by Embedded Adventures
+
+#ifndef __host_wifiudp_h
+#define __host_wifiudp_h
+
+#include "Arduino.h"
+#include <netinet/in.h>
+
+//Largest datagram kept
+#define		UDP_BUFFER_SIZE		1500
+
+class WiFiUDP {
+	private:
+		int					fd;
+		struct sockaddr_in	destination;
+		struct sockaddr_in	remote;
+		uint8_t				rx[UDP_BUFFER_SIZE];
+		int					rxLength;
+		int					rxPos;
+		uint8_t				tx[UDP_BUFFER_SIZE];
+		int					txLength;
+		
+	public:
+		WiFiUDP();
+		~WiFiUDP();
+		
+		//port 0 takes any free port
+		uint8_t	begin(uint16_t port);
+		void	stop();
+		
+		int		beginPacket(const char* host, uint16_t port);
+		size_t	write(uint8_t b);
+		size_t	write(const uint8_t* buf, size_t size);
+		int		endPacket();
+		
+		//Takes the next datagram without blocking. Returns its size, 0 if none has arrived
+		int		parsePacket();
+		int		available();
+		int		read();
+		int		read(uint8_t* buf, size_t len);
+		uint16_t	remotePort();
+};
+
+#endif
@@ -0,0 +1,282 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Host stand-in for the parts of the Arduino core the datapond libraries use
+// Written originally by Embedded Adventures
+
+#include <chrono>
+#include <thread>
+#include "Arduino.h"
+#include "datapond-format.h"
+
+HostSerial	Serial;
+
+static std::chrono::steady_clock::time_point	startTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+	std::this_thread::yield();
+}
+
+
+////////////////////////////////////////////////////////
+////			String							 	////
+////////////////////////////////////////////////////////
+
+String::String(const char* text) {
+	buffer = NULL;
+	len = 0;
+	capacity = 0;
+	*this = text;
+}
+
+String::String(const String& other) {
+	buffer = NULL;
+	len = 0;
+	capacity = 0;
+	*this = other;
+}
+
+String::String(char c) {
+	buffer = NULL;
+	len = 0;
+	capacity = 0;
+	append(&c, 1);
+}
+
+String::String(int value) {
+	char number[POND_NUMBER_SIZE];
+	buffer = NULL;
+	len = 0;
+	capacity = 0;
+	append(number, pondFormatInt(number, value));
+}
+
+String::String(unsigned long value) {
+	char number[POND_NUMBER_SIZE];
+	buffer = NULL;
+	len = 0;
+	capacity = 0;
+	append(number, pondFormatUnsigned(number, value));
+}
+
+String::String(double value, unsigned char decimals) {
+	char number[POND_NUMBER_SIZE];
+	buffer = NULL;
+	len = 0;
+	capacity = 0;
+	append(number, pondFormatDouble(number, value, decimals));
+}
+
+String::~String() {
+	delete[] buffer;
+}
+
+/*	Makes room for size characters and the terminator, keeping what's there	*/
+bool String::grow(unsigned int size) {
+	if ((buffer != NULL) && (size <= capacity))
+		return true;
+	char* bigger = new char[size + 1];
+	if (buffer != NULL)
+		memcpy(bigger, buffer, len + 1);
+	else
+		bigger[0] = '\0';
+	delete[] buffer;
+	buffer = bigger;
+	capacity = size;
+	return true;
+}
+
+String& String::append(const char* text, unsigned int textLength) {
+	grow(len + textLength);
+	memcpy(buffer + len, text, textLength);
+	len += textLength;
+	buffer[len] = '\0';
+	return *this;
+}
+
+String& String::operator=(const String& other) {
+	if (this == &other)
+		return *this;
+	len = 0;
+	return append(other.c_str(), other.len);
+}
+
+String& String::operator=(const char* text) {
+	len = 0;
+	if (text == NULL)
+		text = "";
+	return append(text, strlen(text));
+}
+
+String& String::operator+=(const String& other) {
+	return append(other.c_str(), other.len);
+}
+
+String& String::operator+=(const char* text) {
+	return append(text, strlen(text));
+}
+
+String& String::operator+=(char c) {
+	return append(&c, 1);
+}
+
+bool String::operator==(const String& other) const {
+	return (len == other.len) && (memcmp(c_str(), other.c_str(), len) == 0);
+}
+
+bool String::operator==(const char* text) const {
+	return strcmp(c_str(), text) == 0;
+}
+
+char String::operator[](unsigned int index) const {
+	return (index < len) ? buffer[index] : '\0';
+}
+
+unsigned int String::length() const {
+	return len;
+}
+
+const char* String::c_str() const {
+	return (buffer != NULL) ? buffer : "";
+}
+
+bool String::reserve(unsigned int size) {
+	return grow(size);
+}
+
+int String::indexOf(char c) const {
+	const char* found = strchr(c_str(), c);
+	return (found != NULL) ? found - c_str() : -1;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+	if (from >= len)
+		return -1;
+	const char* found = strchr(c_str() + from, c);
+	return (found != NULL) ? found - c_str() : -1;
+}
+
+int String::indexOf(const char* text) const {
+	const char* found = strstr(c_str(), text);
+	return (found != NULL) ? found - c_str() : -1;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+	String part;
+	if (to > len)
+		to = len;
+	if (from < to)
+		part.append(buffer + from, to - from);
+	return part;
+}
+
+long String::toInt() const {
+	return atol(c_str());
+}
+
+float String::toFloat() const {
+	return atof(c_str());
+}
+
+String operator+(const String& a, const String& b) {
+	String sum(a);
+	sum += b;
+	return sum;
+}
+
+
+////////////////////////////////////////////////////////
+////			Print							 	////
+////////////////////////////////////////////////////////
+
+size_t Print::write(const uint8_t* data, size_t len) {
+	size_t n = 0;
+	while ((n < len) && (write(data[n]) == 1))
+		n++;
+	return n;
+}
+
+size_t Print::print(const char* text) {
+	return write((const uint8_t*)text, strlen(text));
+}
+
+size_t Print::print(const String& text) {
+	return write((const uint8_t*)text.c_str(), text.length());
+}
+
+size_t Print::print(char c) {
+	return write((uint8_t)c);
+}
+
+size_t Print::print(int n) {
+	return print((long)n);
+}
+
+size_t Print::print(unsigned int n) {
+	return print((unsigned long)n);
+}
+
+size_t Print::print(long n) {
+	char number[POND_NUMBER_SIZE];
+	return write((const uint8_t*)number, pondFormatInt(number, n));
+}
+
+size_t Print::print(unsigned long n) {
+	char number[POND_NUMBER_SIZE];
+	return write((const uint8_t*)number, pondFormatUnsigned(number, n));
+}
+
+size_t Print::print(double n, int digits) {
+	char number[POND_NUMBER_SIZE];
+	return write((const uint8_t*)number, pondFormatDouble(number, n, digits));
+}
+
+size_t Print::println() {
+	return write((const uint8_t*)"\r\n", 2);
+}
+
+size_t HostSerial::write(uint8_t b) {
+	return fwrite(&b, 1, 1, stdout);
+}
+
+size_t HostSerial::write(const uint8_t* data, size_t len) {
+	return fwrite(data, 1, len, stdout);
+}
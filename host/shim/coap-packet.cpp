@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Host stand-in for the coap-packet library
+// Written originally by Embedded Adventures
+
+#include "coap-packet.h"
+
+CoapPacket::CoapPacket() {
+	begin();
+}
+
+void CoapPacket::begin() {
+	length = 0;
+	lastOption = 0;
+}
+
+void CoapPacket::append(const void* data, int len) {
+	if (length + len > COAP_PACKET_SIZE)
+		len = COAP_PACKET_SIZE - length;
+	memcpy(buffer + length, data, len);
+	length += len;
+}
+
+void CoapPacket::addHeader(uns8 type, uns8 code, uns16 messageID) {
+	begin();
+	buffer[0] = 0x40 | (type << 4);
+	buffer[1] = code;
+	buffer[2] = messageID >> 8;
+	buffer[3] = messageID & 0xFF;
+	length = 4;
+}
+
+void CoapPacket::addTokens(uns8 tokenLength, uns8* tokens) {
+	buffer[0] = (buffer[0] & 0xF0) | (tokenLength & 0x0F);
+	append(tokens, tokenLength);
+}
+
+/*	Writes the option header with 13/269 extended fields for delta and length	*/
+void CoapPacket::addOption(uns16 number, int len, const char* value) {
+	uns8 head[5];
+	int n = 1;
+	uns16 delta = number - lastOption;
+	uns8 fields[2];
+	uns16 values[2] = { delta, (uns16)len };
+	for (int i = 0; i < 2; i++) {
+		if (values[i] < 13) {
+			fields[i] = values[i];
+		}
+		else if (values[i] < 269) {
+			fields[i] = 13;
+			head[n++] = values[i] - 13;
+		}
+		else {
+			fields[i] = 14;
+			head[n++] = (values[i] - 269) >> 8;
+			head[n++] = (values[i] - 269) & 0xFF;
+		}
+	}
+	//Extended delta bytes come before extended length bytes, which the loop above already keeps
+	head[0] = (fields[0] << 4) | fields[1];
+	append(head, n);
+	append(value, len);
+	lastOption = number;
+}
+
+void CoapPacket::addPayload(int len, const char* payload) {
+	uns8 marker = 0xFF;
+	if (len <= 0)
+		return;
+	append(&marker, 1);
+	append(payload, len);
+}
+
+uns8* CoapPacket::getPacket() {
+	return buffer;
+}
+
+int CoapPacket::getPacketLength() {
+	return length;
+}
@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Host stand-in for the coap-packet library: builds one CoAP message at a time
+// Written originally by Embedded Adventures
+
+#ifndef __host_coap_packet_h
+#define __host_coap_packet_h
+
+#include "Arduino.h"
+
+typedef uint8_t		uns8;
+typedef uint16_t	uns16;
+typedef uint32_t	uns32;
+
+//Message types
+#define		TYPE_CON			0
+#define		TYPE_NON			1
+#define		TYPE_ACK			2
+#define		TYPE_RST			3
+
+//Request methods
+#define		COAP_GET			1
+#define		COAP_POST			2
+#define		COAP_PUT			3
+#define		COAP_DELETE			4
+
+#define		OPT_URI_PATH		11
+#define		OPT_URI_QUERY		15
+
+#define		CODE_CREATED		0x41
+#define		CODE_CONTENT		0x45
+
+//Largest message built
+#define		COAP_PACKET_SIZE	1024
+
+class CoapPacket {
+	private:
+		uns8	buffer[COAP_PACKET_SIZE];
+		int		length;
+		uns16	lastOption;
+		
+		void	append(const void* data, int len);
+		
+	public:
+		CoapPacket();
+		void	begin();
+		void	addHeader(uns8 type, uns8 code, uns16 messageID);
+		void	addTokens(uns8 tokenLength, uns8* tokens);
+		//Options must be added in increasing number, each is delta-encoded against the last
+		void	addOption(uns16 number, int length, const char* value);
+		void	addPayload(int length, const char* payload);
+		uns8*	getPacket();
+		int		getPacketLength();
+};
+
+#endif
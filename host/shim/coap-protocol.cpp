@@ -0,0 +1,216 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Host stand-in for the coap-protocol library
+// Written originally by Embedded Adventures
+
+#include "coap-protocol.h"
+
+#define		MESSAGE_TYPE(pkt)	(((pkt)[0] >> 4) & 0x03)
+#define		MESSAGE_ID(pkt)		(((uns16)(pkt)[2] << 8) | (pkt)[3])
+
+CoapProtocol::CoapProtocol() {
+	host = NULL;
+	port = 0;
+	txOrder = 0;
+	rxLength = 0;
+	clearQueue(RX);
+	clearQueue(TX);
+}
+
+void CoapProtocol::begin(uint16_t localPort) {
+	udp.begin(localPort);
+}
+
+void CoapProtocol::setDestination(const char* address, int destPort) {
+	host = address;
+	port = destPort;
+}
+
+void CoapProtocol::send(const uns8* data, int len) {
+	if (!udp.beginPacket(host, port))
+		return;
+	udp.write(data, len);
+	udp.endPacket();
+}
+
+int CoapProtocol::parseUDPPacket() {
+	int size = udp.parsePacket();
+	rxLength = (size > 0) ? udp.read(rxBuffer, UDP_BUFFER_SIZE) : 0;
+	return rxLength;
+}
+
+int CoapProtocol::receivePacket() {
+	if ((rxLength < 4) || (rxCount >= RX_QUEUE_SIZE))
+		return -1;
+	memcpy(rxQueue[rxCount].data, rxBuffer, rxLength);
+	rxQueue[rxCount].length = rxLength;
+	rxLength = 0;
+	return rxCount++;
+}
+
+void CoapProtocol::process_rx_queue() {
+	for (int i = 0; i < rxCount; i++)
+		processPacket(rxQueue[i].data, rxQueue[i].length);
+	rxCount = 0;
+}
+
+/*	Returns the CON waiting on the ACK or RST in pkt, or -1	*/
+int CoapProtocol::findMessage(const uns8* pkt) {
+	for (int i = 0; i < TX_QUEUE_SIZE; i++) {
+		if ((txQueue[i].state == COAP_ENTRY_WAIT_ACK) && (MESSAGE_ID(txQueue[i].data) == MESSAGE_ID(pkt)))
+			return i;
+	}
+	return -1;
+}
+
+/*	Returns the request waiting on the response in pkt, or -1	*/
+int CoapProtocol::findToken(const uns8* pkt, int pktLen) {
+	int tokenLength = pkt[0] & 0x0F;
+	if (pktLen < 4 + tokenLength)
+		return -1;
+	for (int i = 0; i < TX_QUEUE_SIZE; i++) {
+		const uns8* data = txQueue[i].data;
+		if ((txQueue[i].state < COAP_ENTRY_WAIT_ACK) || ((data[0] & 0x0F) != tokenLength))
+			continue;
+		if (memcmp(data + 4, pkt + 4, tokenLength) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*	Sends an empty ACK for a confirmable response	*/
+void CoapProtocol::acknowledge(const uns8* pkt) {
+	uns8 ack[4] = { (uns8)(0x40 | (TYPE_ACK << 4)), 0, pkt[2], pkt[3] };
+	send(ack, 4);
+}
+
+void CoapProtocol::processPacket(uns8* pkt, int pktLen) {
+	int i;
+	switch (MESSAGE_TYPE(pkt)) {
+		case TYPE_ACK:
+			i = findMessage(pkt);
+			if (i < 0)
+				return;
+			//An empty ACK leaves the request waiting on its separate response
+			if (pkt[1] == 0) {
+				txQueue[i].state = COAP_ENTRY_WAIT_RESPONSE;
+				txQueue[i].sent = millis();
+				txQueue[i].timeout = COAP_RESPONSE_TIMEOUT;
+			}
+			else {
+				txQueue[i].state = COAP_ENTRY_FREE;
+			}
+			txSuccessHandler(pkt, pktLen);
+			break;
+		case TYPE_RST:
+			i = findMessage(pkt);
+			if (i < 0)
+				return;
+			txQueue[i].state = COAP_ENTRY_FREE;
+			txFailureHandler(txQueue[i].data, txQueue[i].length);
+			break;
+		default:
+			if (pkt[1] == 0)
+				return;
+			if (MESSAGE_TYPE(pkt) == TYPE_CON)
+				acknowledge(pkt);
+			i = findToken(pkt, pktLen);
+			if (i >= 0)
+				txQueue[i].state = COAP_ENTRY_FREE;
+			availablePacketHandler(pkt, pktLen);
+			break;
+	}
+}
+
+void CoapProtocol::process_tx_queue() {
+	unsigned long now = millis();
+	int next = -1;
+	for (int i = 0; i < TX_QUEUE_SIZE; i++) {
+		coap_tx_entry* entry = &txQueue[i];
+		if (entry->state == COAP_ENTRY_NEW) {
+			if ((next < 0) || ((int32_t)(entry->order - txQueue[next].order) < 0))
+				next = i;
+			continue;
+		}
+		if ((entry->state == COAP_ENTRY_FREE) || (now - entry->sent < entry->timeout))
+			continue;
+		if (entry->state == COAP_ENTRY_WAIT_RESPONSE) {
+			entry->state = COAP_ENTRY_FREE;
+			responseTimeoutHandler(entry->data, entry->length);
+		}
+		else if (entry->retransmits >= COAP_MAX_RETRANSMIT) {
+			entry->state = COAP_ENTRY_FREE;
+			txFailureHandler(entry->data, entry->length);
+		}
+		else {
+			entry->retransmits++;
+			entry->sent = now;
+			entry->timeout *= 2;
+			send(entry->data, entry->length);
+		}
+	}
+	if (next < 0)
+		return;
+	
+	coap_tx_entry* entry = &txQueue[next];
+	send(entry->data, entry->length);
+	if (MESSAGE_TYPE(entry->data) != TYPE_CON) {
+		entry->state = COAP_ENTRY_FREE;
+		return;
+	}
+	entry->state = COAP_ENTRY_WAIT_ACK;
+	entry->sent = now;
+	entry->timeout = COAP_ACK_TIMEOUT;
+}
+
+void CoapProtocol::clearQueue(int queue) {
+	if (queue == RX) {
+		rxCount = 0;
+		return;
+	}
+	for (int i = 0; i < TX_QUEUE_SIZE; i++)
+		txQueue[i].state = COAP_ENTRY_FREE;
+}
+
+int CoapProtocol::addToTX(uns8* buf, int len) {
+	if ((len < 4) || (len > COAP_PACKET_SIZE))
+		return -1;
+	for (int i = 0; i < TX_QUEUE_SIZE; i++) {
+		if (txQueue[i].state != COAP_ENTRY_FREE)
+			continue;
+		memcpy(txQueue[i].data, buf, len);
+		txQueue[i].length = len;
+		txQueue[i].state = COAP_ENTRY_NEW;
+		txQueue[i].retransmits = 0;
+		txQueue[i].order = txOrder++;
+		return i;
+	}
+	return -1;
+}
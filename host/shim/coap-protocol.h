@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Host stand-in for the coap-protocol library: a TX queue with CON retransmission,
+// an RX queue and the handler calls the datapond client overrides
+// Written originally by Embedded Adventures
+
+#ifndef __host_coap_protocol_h
+#define __host_coap_protocol_h
+
+#include "coap-packet.h"
+#include "WiFiUdp.h"
+
+//clearQueue() selectors
+#define		RX		0
+#define		TX		1
+
+//Messages waiting to go out or on an answer
+#define		TX_QUEUE_SIZE			16
+//Datagrams received and not yet processed
+#define		RX_QUEUE_SIZE			8
+
+//First retransmission timeout in ms, doubled on each retransmission
+#ifndef COAP_ACK_TIMEOUT
+#define		COAP_ACK_TIMEOUT		2000
+#endif
+#ifndef COAP_MAX_RETRANSMIT
+#define		COAP_MAX_RETRANSMIT		4
+#endif
+//ms a request acknowledged with an empty ACK waits on its separate response
+#ifndef COAP_RESPONSE_TIMEOUT
+#define		COAP_RESPONSE_TIMEOUT	((COAP_ACK_TIMEOUT) * ((2UL << (COAP_MAX_RETRANSMIT)) - 1))
+#endif
+
+//TX entry states
+#define		COAP_ENTRY_FREE			0
+#define		COAP_ENTRY_NEW			1
+#define		COAP_ENTRY_WAIT_ACK		2
+#define		COAP_ENTRY_WAIT_RESPONSE	3
+
+typedef void (*packetReturn_callback)(uns8* pkt, int pktLen);
+
+typedef struct {
+	uns8			state;
+	uns8			retransmits;
+	uns32			order;			//Queue position, the oldest new message goes out first
+	unsigned long	sent;
+	unsigned long	timeout;
+	int				length;
+	uns8			data[COAP_PACKET_SIZE];
+} coap_tx_entry;
+
+typedef struct {
+	int		length;
+	uns8	data[UDP_BUFFER_SIZE];
+} coap_rx_entry;
+
+class CoapProtocol {
+	private:
+		WiFiUDP			udp;
+		const char*		host;
+		int				port;
+		coap_tx_entry	txQueue[TX_QUEUE_SIZE];
+		uns32			txOrder;
+		coap_rx_entry	rxQueue[RX_QUEUE_SIZE];
+		uns8			rxCount;
+		uns8			rxBuffer[UDP_BUFFER_SIZE];
+		int				rxLength;
+		
+		void	send(const uns8* data, int len);
+		void	acknowledge(const uns8* pkt);
+		int		findMessage(const uns8* pkt);
+		int		findToken(const uns8* pkt, int pktLen);
+		void	processPacket(uns8* pkt, int pktLen);
+		
+	public:
+		CoapProtocol();
+		virtual ~CoapProtocol() { }
+		void	begin(uint16_t localPort = 0);
+		void	setDestination(const char* address, int destPort);
+		
+		//Reads a waiting datagram. Returns its size, 0 if none
+		int		parseUDPPacket();
+		//Moves the datagram read by parseUDPPacket() to the RX queue. Returns its index or -1
+		int		receivePacket();
+		void	process_rx_queue();
+		//Retransmits and times out what's due, then sends the oldest new message
+		void	process_tx_queue();
+		void	clearQueue(int queue);
+		//Queues a message. Returns its TX queue index, -1 if the queue is full
+		int		addToTX(uns8* buf, int len);
+		void	printTokenEntry(int index) { }
+		
+		//Piggybacked responses and empty ACKs
+		virtual void	txSuccessHandler(uns8* pkt, int pktLen) { }
+		//The request itself, once its retransmissions ran out or it was reset
+		virtual void	txFailureHandler(uns8* pkt, int pktLen) { }
+		//Separate responses and notifications
+		virtual void	availablePacketHandler(uns8* pkt, int pktLen) { }
+		//The request itself, when its separate response never came
+		virtual void	responseTimeoutHandler(uns8* pkt, int pktLen) { }
+};
+
+#endif
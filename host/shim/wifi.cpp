@@ -0,0 +1,251 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Host stand-ins for the ESP8266 network sockets
+// Written originally by Embedded Adventures
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "ESP8266WiFi.h"
+#include "WiFiUdp.h"
+
+bool hostResolve(const char* host, uint16_t port, void* address) {
+	struct addrinfo hints;
+	struct addrinfo* found;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	if (getaddrinfo(host, NULL, &hints, &found) != 0)
+		return false;
+	memcpy(address, found->ai_addr, sizeof(struct sockaddr_in));
+	((struct sockaddr_in*)address)->sin_port = htons(port);
+	freeaddrinfo(found);
+	return true;
+}
+
+
+////////////////////////////////////////////////////////
+////			WiFiClient						 	////
+////////////////////////////////////////////////////////
+
+WiFiClient::WiFiClient() {
+	fd = -1;
+}
+
+WiFiClient::~WiFiClient() {
+	stop();
+}
+
+/*	Connects, blocking until it's up or refused. Returns 1 once connected	*/
+int WiFiClient::connect(const char* host, uint16_t port) {
+	struct sockaddr_in address;
+	stop();
+	if (!hostResolve(host, port, &address))
+		return 0;
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return 0;
+	if (::connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+		stop();
+		return 0;
+	}
+	return 1;
+}
+
+/*	True while the peer hasn't closed, or anything it sent before closing is unread	*/
+uint8_t WiFiClient::connected() {
+	uint8_t c;
+	if (fd < 0)
+		return 0;
+	if (available() > 0)
+		return 1;
+	int n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	if (n == 0)
+		return 0;
+	return (n > 0) || (errno == EAGAIN) || (errno == EWOULDBLOCK);
+}
+
+int WiFiClient::available() {
+	int n = 0;
+	if ((fd < 0) || (ioctl(fd, FIONREAD, &n) != 0))
+		return 0;
+	return n;
+}
+
+int WiFiClient::read() {
+	uint8_t c;
+	return (read(&c, 1) == 1) ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+	if (fd < 0)
+		return -1;
+	int n = recv(fd, buf, size, MSG_DONTWAIT);
+	return (n > 0) ? n : -1;
+}
+
+int WiFiClient::peek() {
+	uint8_t c;
+	if (fd < 0)
+		return -1;
+	return (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1) ? c : -1;
+}
+
+size_t WiFiClient::write(uint8_t b) {
+	return write(&b, 1);
+}
+
+/*	Writes everything or reports 0, a closed peer doesn't raise SIGPIPE	*/
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+	size_t sent = 0;
+	if (fd < 0)
+		return 0;
+	while (sent < size) {
+		ssize_t n = send(fd, buf + sent, size - sent, MSG_NOSIGNAL);
+		if (n <= 0)
+			return 0;
+		sent += n;
+	}
+	return sent;
+}
+
+void WiFiClient::stop() {
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+}
+
+void WiFiClient::setNoDelay(bool nodelay) {
+	int flag = nodelay ? 1 : 0;
+	if (fd >= 0)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+
+////////////////////////////////////////////////////////
+////			WiFiUDP							 	////
+////////////////////////////////////////////////////////
+
+WiFiUDP::WiFiUDP() {
+	fd = -1;
+	rxLength = 0;
+	rxPos = 0;
+	txLength = 0;
+}
+
+WiFiUDP::~WiFiUDP() {
+	stop();
+}
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+	struct sockaddr_in local;
+	stop();
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return 0;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr*)&local, sizeof(local)) != 0) {
+		stop();
+		return 0;
+	}
+	return 1;
+}
+
+void WiFiUDP::stop() {
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+}
+
+int WiFiUDP::beginPacket(const char* host, uint16_t port) {
+	txLength = 0;
+	return hostResolve(host, port, &destination) ? 1 : 0;
+}
+
+size_t WiFiUDP::write(uint8_t b) {
+	return write(&b, 1);
+}
+
+size_t WiFiUDP::write(const uint8_t* buf, size_t size) {
+	if (txLength + size > UDP_BUFFER_SIZE)
+		size = UDP_BUFFER_SIZE - txLength;
+	memcpy(tx + txLength, buf, size);
+	txLength += size;
+	return size;
+}
+
+int WiFiUDP::endPacket() {
+	if (fd < 0)
+		return 0;
+	ssize_t n = sendto(fd, tx, txLength, 0, (struct sockaddr*)&destination, sizeof(destination));
+	txLength = 0;
+	return (n >= 0) ? 1 : 0;
+}
+
+int WiFiUDP::parsePacket() {
+	socklen_t size = sizeof(remote);
+	rxLength = 0;
+	rxPos = 0;
+	if (fd < 0)
+		return 0;
+	int n = recvfrom(fd, rx, UDP_BUFFER_SIZE, MSG_DONTWAIT, (struct sockaddr*)&remote, &size);
+	if (n <= 0)
+		return 0;
+	rxLength = n;
+	return n;
+}
+
+int WiFiUDP::available() {
+	return rxLength - rxPos;
+}
+
+int WiFiUDP::read() {
+	return (rxPos < rxLength) ? rx[rxPos++] : -1;
+}
+
+int WiFiUDP::read(uint8_t* buf, size_t len) {
+	int n = available();
+	if ((int)len < n)
+		n = len;
+	memcpy(buf, rx + rxPos, n);
+	rxPos += n;
+	return n;
+}
+
+uint16_t WiFiUDP::remotePort() {
+	return ntohs(remote.sin_port);
+}
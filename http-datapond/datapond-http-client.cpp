@@ -0,0 +1,80 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// HTTP transport of the generic DatapondClient
+// Written originally by Embedded Adventures
+
+#include "datapond-http-client.h"
+
+PondHttpTransport::PondHttpTransport(const char* server, int port) : pond(server, port) {
+	pondUsername = NULL;
+	pondPassword = NULL;
+	window = HTTP_PIPELINE_DEPTH;
+	resultFn = NULL;
+	readFn = NULL;
+}
+
+/*	format is ignored, HTTP bodies are always JSON. window is at most HTTP_PIPELINE_DEPTH	*/
+void PondHttpTransport::begin(const char* username, const char* password, uint8_t format, uint16_t window) {
+	pondUsername = username;
+	pondPassword = password;
+	this->window = window;
+	pond.setCredentials(username, password);
+	pond.setAsync(true);
+}
+
+void PondHttpTransport::setHandlers(http_login_ptr loggedIn, http_result_ptr created, http_value_ptr read) {
+	resultFn = created;
+	readFn = read;
+	pond.setLoginHandler(loggedIn);
+	pond.setCompletionHandler(PondHttpTransport::completed, this);
+}
+
+/*	Every read comes through here, so they are all decoded as a CoAP read would be	*/
+void PondHttpTransport::completed(void* context, http_token tkn, uint8_t callbackCode, int code) {
+	PondHttpTransport* transport = (PondHttpTransport*)context;
+	bool status = (code >= 200) && (code < 300);
+	pond_reading reading;
+	
+	switch (callbackCode) {
+		case HTTP_LOGIN:
+			break;
+		case HTTP_CREATE_DROPLET:
+			if (transport->resultFn != NULL)
+				transport->resultFn(tkn, status);
+			break;
+		default:
+			if (transport->readFn != NULL) {
+				pond_view body = transport->pond.getPayloadView();
+				bool decoded = pondJsonReading(body.ptr, body.len, &reading);
+				transport->readFn(tkn, status && decoded, &reading);
+			}
+			break;
+	}
+}
@@ -0,0 +1,84 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// HTTP transport of the generic DatapondClient
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_http_client_h
+#define __datapond_http_client_h
+
+#include "http-datapond.h"
+#include "datapond-client.h"
+
+typedef void (*http_result_ptr)(http_token tkn, bool status);
+
+//Use as DatapondClient<PondHttpTransport>, constructed with the server address and port.
+//HttpDatapond runs in async mode underneath
+class PondHttpTransport {
+public:
+	typedef http_token		token_type;
+	typedef HttpDatapond	client_type;
+	static constexpr uint8_t	tokenLength = sizeof(http_token);
+	static constexpr uint16_t	maxWindow = HTTP_PIPELINE_DEPTH;
+	static constexpr bool		binary = false;
+	static constexpr int		busyResult = HTTP_ERROR_BUSY;
+	
+	//Request results that mean try again later, the window or the request buffer is full
+	static bool	busy(int result) { return (result == HTTP_ERROR_BUSY) || (result == HTTP_ERROR_NO_ROOM); }
+	
+private:
+	HttpDatapond	pond;
+	const char*		pondUsername;
+	const char*		pondPassword;
+	uint16_t		window;
+	http_result_ptr	resultFn;
+	http_value_ptr	readFn;
+	
+	bool			full() { return pond.getPending() >= window; }
+	static void		completed(void* context, http_token tkn, uint8_t callbackCode, int code);
+	
+public:
+	PondHttpTransport(const char* server, int port);
+	
+	void	begin(const char* username, const char* password, uint8_t format, uint16_t window);
+	void	setHandlers(http_login_ptr loggedIn, http_result_ptr created, http_value_ptr read);
+	void	run() { pond.run(); }
+	
+	//Requests beyond the window are turned away as busy
+	int		login() { return full() ? HTTP_ERROR_BUSY : pond.login(pondUsername, pondPassword); }
+	int		createDroplet(int stream_id, double value) { return full() ? HTTP_ERROR_BUSY : pond.createDroplet(stream_id, value); }
+	int		getLastDroplet(int stream_id) { return full() ? HTTP_ERROR_BUSY : pond.getLastDroplet(stream_id); }
+	int		getStatsToday(int stream_id) { return full() ? HTTP_ERROR_BUSY : pond.getStatsToday(stream_id); }
+	int		getStream(int stream_id) { return full() ? HTTP_ERROR_BUSY : pond.getStream(stream_id); }
+	
+	http_token		getLastToken() { return pond.getLastToken(); }
+	HttpDatapond*	client() { return &pond; }
+};
+
+#endif
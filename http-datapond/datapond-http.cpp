@@ -0,0 +1,541 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Kept-alive HTTP/1.1 connection with pipelining for the datapond client
+// Written originally by Embedded Adventures
+
+#include "Arduino.h"
+#include "datapond-http.h"
+#include "datapond-format.h"
+
+//Response parser states
+#define		HTTP_STATE_STATUS		0
+#define		HTTP_STATE_HEADER		1
+#define		HTTP_STATE_BODY			2
+#define		HTTP_STATE_CHUNK_SIZE	3
+#define		HTTP_STATE_CHUNK_DATA	4
+#define		HTTP_STATE_CHUNK_END	5
+#define		HTTP_STATE_TRAILER		6
+
+PondHttpConnection::PondHttpConnection(const char* ip, int remotePort) {
+	host = ip;
+	port = remotePort;
+	reuse = true;
+	timeout = HTTP_TIMEOUT;
+	connects = 0;
+	sink = NULL;
+	requestLength = 0;
+	requestSent = 0;
+	head = 0;
+	count = 0;
+	chunkLength = 0;
+	state = HTTP_STATE_STATUS;
+	lineLength = 0;
+	closeAfter = false;
+	received = false;
+	retried = false;
+	etag[0] = '\0';
+#if POND_METRICS
+	metrics = NULL;
+#endif
+}
+
+/*	Response bodies are written to sink as they arrive	*/
+void PondHttpConnection::setSink(Stream* stream) {
+	sink = stream;
+}
+
+/*	With reuse off, every request asks the server to close the connection after it	*/
+void PondHttpConnection::setReuse(bool keepAlive) {
+	reuse = keepAlive;
+}
+
+void PondHttpConnection::setTimeout(uint16_t ms) {
+	timeout = ms;
+}
+
+/*	Serializes a request into the queue. Returns false if the queue or its buffer is full	*/
+bool PondHttpConnection::queue(const char* method, const char* path, const char* cookie,
+								const char* body, int bodyLength, const char* match) {
+	return queueRequest(method, path, cookie, body, bodyLength, false, match);
+}
+
+/*	A streamed request is queued with its headers only, the body follows through writeBody()	*/
+bool PondHttpConnection::queueRequest(const char* method, const char* path, const char* cookie,
+										const char* body, int bodyLength, bool streamed, const char* match) {
+	char number[POND_NUMBER_SIZE];
+	int size = HTTP_REQUEST_BUFFER_SIZE;
+	int len = requestLength;
+	if (count == HTTP_PIPELINE_DEPTH)
+		return false;
+	if (body == NULL)
+		bodyLength = 0;
+	
+	len = pondAppend(request, len, size, method);
+	len = pondAppend(request, len, size, " ");
+	len = pondAppend(request, len, size, path);
+	len = pondAppend(request, len, size, " HTTP/1.1\r\nHost: ");
+	len = pondAppend(request, len, size, host);
+	if (port != 80) {
+		pondFormatInt(number, port);
+		len = pondAppend(request, len, size, ":");
+		len = pondAppend(request, len, size, number);
+	}
+	len = pondAppend(request, len, size, reuse ? "\r\nConnection: keep-alive\r\n" : "\r\nConnection: close\r\n");
+	if ((cookie != NULL) && (cookie[0] != '\0')) {
+		len = pondAppend(request, len, size, "Cookie: ");
+		len = pondAppend(request, len, size, cookie);
+		len = pondAppend(request, len, size, "\r\n");
+	}
+	if (match != NULL) {
+		len = pondAppend(request, len, size, "If-None-Match: ");
+		len = pondAppend(request, len, size, match);
+		len = pondAppend(request, len, size, "\r\n");
+	}
+	if (streamed) {
+		len = pondAppend(request, len, size, "Content-Type: application/json\r\nTransfer-Encoding: chunked\r\n");
+	}
+	else if (body != NULL) {
+		pondFormatInt(number, bodyLength);
+		len = pondAppend(request, len, size, "Content-Type: application/json\r\nContent-Length: ");
+		len = pondAppend(request, len, size, number);
+		len = pondAppend(request, len, size, "\r\n");
+	}
+	len = pondAppend(request, len, size, "\r\n");
+	
+	//pondAppend stops one short of the end, so reaching it means the request was cut off
+	if (len + bodyLength >= size - 1)
+		return false;
+	if (bodyLength > 0)
+		memcpy(request + len, body, bodyLength);
+	
+	int index = (head + count) % HTTP_PIPELINE_DEPTH;
+	queued[index].start = requestLength;
+	queued[index].idempotent = (strcmp(method, "GET") == 0);
+	queued[index].streamed = streamed;
+	queued[index].lost = false;
+	requestLength = len + bodyLength;
+	count++;
+	return true;
+}
+
+uint8_t PondHttpConnection::pending() {
+	return count;
+}
+
+/*	Sends the headers of a streamed request. Nothing else may be queued until endChunked()	*/
+bool PondHttpConnection::beginChunked(const char* method, const char* path, const char* cookie) {
+	if (count > 0)
+		return false;
+	if (!queueRequest(method, path, cookie, NULL, 0, true, NULL))
+		return false;
+	
+	chunkLength = 0;
+	int result = writeQueued();
+	if (result != HTTP_PENDING) {
+		finish(result);
+		return false;
+	}
+	return true;
+}
+
+/*	Adds to the streamed body. Chunks go out whenever the space behind the request fills	*/
+bool PondHttpConnection::writeBody(const char* data, int len) {
+	int room = HTTP_REQUEST_BUFFER_SIZE - requestLength - HTTP_CHUNK_OVERHEAD;
+	char* chunk = request + requestLength + 6;
+	if (room <= 0)
+		return false;
+	
+	while (len > 0) {
+		int n = room - chunkLength;
+		if (n > len)
+			n = len;
+		memcpy(chunk + chunkLength, data, n);
+		chunkLength += n;
+		data += n;
+		len -= n;
+		if ((chunkLength == room) && !flushChunk(false))
+			return false;
+	}
+	return true;
+}
+
+/*	Sends the rest of the streamed body and the last chunk, then waits for the response	*/
+int PondHttpConnection::endChunked() {
+	if (!flushChunk(true))
+		return finish(HTTP_ERROR_SEND_FAILED);
+	return next();
+}
+
+/*	Writes the held body bytes as one chunk, with the last chunk after them if last is set	*/
+bool PondHttpConnection::flushChunk(bool last) {
+	const char hex[] = "0123456789ABCDEF";
+	char* chunk = request + requestLength;
+	int len = 0;
+	
+	//The size is written with leading zeros so it always fits the space left for it
+	if (chunkLength > 0) {
+		chunk[0] = hex[(chunkLength >> 12) & 0x0F];
+		chunk[1] = hex[(chunkLength >> 8) & 0x0F];
+		chunk[2] = hex[(chunkLength >> 4) & 0x0F];
+		chunk[3] = hex[chunkLength & 0x0F];
+		chunk[4] = '\r';
+		chunk[5] = '\n';
+		len = 6 + chunkLength;
+		chunk[len++] = '\r';
+		chunk[len++] = '\n';
+	}
+	if (last) {
+		memcpy(chunk + len, "0\r\n\r\n", 5);
+		len += 5;
+	}
+	chunkLength = 0;
+	if (len == 0)
+		return true;
+	
+	lastActivity = millis();
+#if POND_METRICS
+	if (metrics != NULL)
+		metrics->sent(len);
+#endif
+	return client.write((const uint8_t*)chunk, len) == (size_t)len;
+}
+
+/*	Writes any newly queued requests, then reads what has arrived of the oldest response	*/
+int PondHttpConnection::poll() {
+	if (count == 0)
+		return HTTP_PENDING;
+	if (queued[head].lost)
+		return finish(HTTP_ERROR_CONNECTION_LOST);
+	int result = writeQueued();
+	if (result != HTTP_PENDING)
+		return finish(result);
+	
+	//Each pass reads for the oldest request only, the bytes after its end wait for the next poll()
+	while (client.available() > 0) {
+		received = true;
+		lastActivity = millis();
+		if ((state == HTTP_STATE_BODY) || (state == HTTP_STATE_CHUNK_DATA)) {
+			readBody();
+			if (remaining != 0)
+				continue;
+			if (state == HTTP_STATE_BODY)
+				return finish(status);
+			state = HTTP_STATE_CHUNK_END;
+			continue;
+		}
+#if POND_METRICS
+		if (metrics != NULL)
+			metrics->received(1);
+#endif
+		if (!readLine(client.read()))
+			continue;
+		result = takeLine();
+		if (result != HTTP_PENDING)
+			return finish(result);
+	}
+	
+	if (!client.connected()) {
+		//A body without a length runs until the server closes
+		if ((state == HTTP_STATE_BODY) && (remaining < 0))
+			return finish(status);
+		//A stale kept-alive connection closes before answering anything, so it's safe to send again
+		if (!retried && !queued[head].streamed && (!received || queued[head].idempotent)) {
+			retried = true;
+#if POND_METRICS
+			if (metrics != NULL)
+				metrics->retransmit();
+#endif
+			rewind(true);
+			return HTTP_PENDING;
+		}
+		return finish(HTTP_ERROR_CONNECTION_LOST);
+	}
+	if (millis() - lastActivity > timeout)
+		return finish(HTTP_ERROR_READ_TIMEOUT);
+	return HTTP_PENDING;
+}
+
+/*	Blocks until the oldest request completes	*/
+int PondHttpConnection::next() {
+	int result;
+	if (count == 0)
+		return HTTP_ERROR_NOT_CONNECTED;
+	do {
+		result = poll();
+		if (result == HTTP_PENDING)
+			yield();
+	} while (result == HTTP_PENDING);
+	return result;
+}
+
+/*	Drops the connection and everything queued on it	*/
+void PondHttpConnection::close() {
+	client.stop();
+	head = 0;
+	count = 0;
+	requestLength = 0;
+	requestSent = 0;
+	state = HTTP_STATE_STATUS;
+	lineLength = 0;
+}
+
+/*	Returns how many connections have been opened, reused requests don't add to it	*/
+uint32_t PondHttpConnection::getConnects() {
+	return connects;
+}
+
+/*	Returns the ETag of the last response read, empty if it had none	*/
+const char* PondHttpConnection::getETag() {
+	return etag;
+}
+
+#if POND_METRICS
+void PondHttpConnection::setMetrics(PondMetrics* counters) {
+	metrics = counters;
+}
+#endif
+
+/*	Connects unless the kept-alive connection is still up	*/
+bool PondHttpConnection::open() {
+	if (client.connected())
+		return true;
+	client.stop();
+	if (!client.connect(host, port))
+		return false;
+	client.setNoDelay(true);
+	connects++;
+	return true;
+}
+
+/*	Writes requests queued since the last write back to back	*/
+int PondHttpConnection::writeQueued() {
+	if (requestSent == requestLength)
+		return HTTP_PENDING;
+	if (!open())
+		return HTTP_ERROR_CONNECTION_REFUSED;
+	
+	size_t len = requestLength - requestSent;
+	if (client.write((const uint8_t*)request + requestSent, len) != len)
+		return HTTP_ERROR_SEND_FAILED;
+	requestSent = requestLength;
+	lastActivity = millis();
+#if POND_METRICS
+	if (metrics != NULL)
+		metrics->sent(len);
+#endif
+	return HTTP_PENDING;
+}
+
+/*	Collects a header line, returns true at its end. Carriage returns and overlong tails are dropped	*/
+bool PondHttpConnection::readLine(char c) {
+	if (c == '\n') {
+		line[lineLength] = '\0';
+		return true;
+	}
+	if ((c != '\r') && (lineLength < HTTP_LINE_SIZE - 1))
+		line[lineLength++] = c;
+	return false;
+}
+
+/*	Acts on a complete line. Returns the status once a response without a body ends	*/
+int PondHttpConnection::takeLine() {
+	int result = HTTP_PENDING;
+	switch (state) {
+		case HTTP_STATE_STATUS:
+			//Blank lines ahead of the status line are skipped
+			if (lineLength == 0)
+				break;
+			status = (strncmp(line, "HTTP/1.", 7) == 0) ? atoi(line + 9) : 0;
+			if (status < 100) {
+				result = HTTP_ERROR_NO_HTTP_SERVER;
+				break;
+			}
+			closeAfter = (line[7] == '0') || !reuse;
+			chunked = false;
+			etag[0] = '\0';
+			remaining = -1;
+			state = HTTP_STATE_HEADER;
+			break;
+		case HTTP_STATE_HEADER:
+			if (lineLength == 0)
+				result = startBody();
+			else
+				takeHeader();
+			break;
+		case HTTP_STATE_CHUNK_SIZE:
+			remaining = strtol(line, NULL, 16);
+			state = (remaining > 0) ? HTTP_STATE_CHUNK_DATA : HTTP_STATE_TRAILER;
+			break;
+		case HTTP_STATE_CHUNK_END:
+			state = HTTP_STATE_CHUNK_SIZE;
+			break;
+		case HTTP_STATE_TRAILER:
+			if (lineLength == 0)
+				result = status;
+			break;
+	}
+	lineLength = 0;
+	return result;
+}
+
+/*	Picks out the ETag and the headers that frame the body and decide if the connection stays up	*/
+void PondHttpConnection::takeHeader() {
+	//The ETag is compared byte for byte, so it's kept before the line is lowercased
+	if (strncasecmp(line, "etag:", 5) == 0) {
+		const char* value = line + 5;
+		while (*value == ' ')
+			value++;
+		strcpy(etag, value);
+		return;
+	}
+	
+	for (uint8_t i = 0; i < lineLength; i++)
+		line[i] = tolower(line[i]);
+	
+	if (strncmp(line, "content-length:", 15) == 0)
+		remaining = atol(line + 15);
+	else if (strncmp(line, "transfer-encoding:", 18) == 0)
+		chunked = (strstr(line + 18, "chunked") != NULL);
+	else if (strncmp(line, "connection:", 11) == 0) {
+		if (strstr(line + 11, "close") != NULL)
+			closeAfter = true;
+		else if (reuse && (strstr(line + 11, "keep-alive") != NULL))
+			closeAfter = false;
+	}
+}
+
+/*	Sets up for the body once the headers end. Returns the status if there isn't one	*/
+int PondHttpConnection::startBody() {
+	//Interim responses are followed by the real one
+	if (status < 200) {
+		state = HTTP_STATE_STATUS;
+		return HTTP_PENDING;
+	}
+	if ((status == 204) || (status == 304))
+		return status;
+	if (chunked) {
+		state = HTTP_STATE_CHUNK_SIZE;
+		return HTTP_PENDING;
+	}
+	if (remaining == 0)
+		return status;
+	if (remaining < 0)
+		closeAfter = true;
+	state = HTTP_STATE_BODY;
+	return HTTP_PENDING;
+}
+
+/*	Moves body bytes to the sink a block at a time	*/
+void PondHttpConnection::readBody() {
+	uint8_t block[64];
+	int len = client.available();
+	if (len > (int)sizeof(block))
+		len = sizeof(block);
+	if ((remaining >= 0) && (len > remaining))
+		len = remaining;
+	
+	len = client.read(block, len);
+	if (len <= 0)
+		return;
+#if POND_METRICS
+	if (metrics != NULL)
+		metrics->received(len);
+#endif
+	if (sink != NULL)
+		sink->write(block, len);
+	if (remaining > 0)
+		remaining -= len;
+}
+
+/*	Completes the oldest request with code and readies the parser for the next response	*/
+int PondHttpConnection::finish(int code) {
+	//Its bytes are done with, so a steady pipeline never runs out of room
+	cut(queued[head].start, requestEnd(0) - queued[head].start);
+	head = (head + 1) % HTTP_PIPELINE_DEPTH;
+	count--;
+	state = HTTP_STATE_STATUS;
+	lineLength = 0;
+	received = false;
+	retried = false;
+	
+	//After an error or a close, requests still waiting go out again on a new connection
+	if ((code < 0) || closeAfter)
+		rewind(false);
+	if (count == 0) {
+		requestLength = 0;
+		requestSent = 0;
+	}
+	return code;
+}
+
+/*	Drops the connection so requests still waiting are written again on a new one. Unless replayWritten
+	is set, those written in full may have reached the server and only idempotent ones go out again,
+	the rest are failed in turn by poll()	*/
+void PondHttpConnection::rewind(bool replayWritten) {
+	client.stop();
+	closeAfter = false;
+	state = HTTP_STATE_STATUS;
+	lineLength = 0;
+	received = false;
+	
+	for (uint8_t i = 0; (i < count) && !replayWritten; i++) {
+		pond_http_request* req = &queued[(head + i) % HTTP_PIPELINE_DEPTH];
+		uint16_t end = requestEnd(i);
+		if ((end > requestSent) || req->idempotent || req->lost)
+			continue;
+		req->lost = true;
+		cut(req->start, end - req->start);
+	}
+	requestSent = (count > 0) ? queued[head].start : requestLength;
+}
+
+/*	Returns where the request index places after the oldest ends in the request buffer	*/
+uint16_t PondHttpConnection::requestEnd(uint8_t index) {
+	if (index + 1 < count)
+		return queued[(head + index + 1) % HTTP_PIPELINE_DEPTH].start;
+	return requestLength;
+}
+
+/*	Takes len bytes at start out of the request buffer, moving the requests after them down	*/
+void PondHttpConnection::cut(uint16_t start, uint16_t len) {
+	if (len == 0)
+		return;
+	memmove(request + start, request + start + len, requestLength - start - len);
+	requestLength -= len;
+	if (requestSent >= start + len)
+		requestSent -= len;
+	else if (requestSent > start)
+		requestSent = start;
+	for (uint8_t i = 0; i < count; i++) {
+		pond_http_request* req = &queued[(head + i) % HTTP_PIPELINE_DEPTH];
+		if (req->start >= start + len)
+			req->start -= len;
+	}
+}
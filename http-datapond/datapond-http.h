@@ -0,0 +1,149 @@
+/*
+Copyright (c) 2016, Embedded Adventures
+All rights reserved.
+Contact us at source [at] embeddedadventures.com
+www.embeddedadventures.com
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+- Neither the name of Embedded Adventures nor the names of its contributors
+  may be used to endorse or promote products derived from this software
+  without specific prior written permission.
+ 
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF 
+THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Kept-alive HTTP/1.1 connection with pipelining for the datapond client
+// Written originally by Embedded Adventures
+
+#ifndef __datapond_http_h
+#define __datapond_http_h
+
+#include "datapond-config.h"
+#include "ESP8266WiFi.h"
+#include "datapond-metrics.h"
+
+//Chunk size line, trailing CRLF and last chunk around a streamed chunk
+#define		HTTP_CHUNK_OVERHEAD		13
+
+//Longest response header line kept, the rest of a longer line is dropped
+#define		HTTP_LINE_SIZE			64
+//ms without a byte from the server before a response is given up on
+#define		HTTP_TIMEOUT			5000
+
+//poll() result while the oldest response is still on its way
+#define		HTTP_PENDING			0
+
+//Errors, numbered as HTTPClient numbers them
+#define		HTTP_ERROR_CONNECTION_REFUSED	-1
+#define		HTTP_ERROR_SEND_FAILED			-2
+#define		HTTP_ERROR_NOT_CONNECTED		-4
+#define		HTTP_ERROR_CONNECTION_LOST		-5
+#define		HTTP_ERROR_NO_HTTP_SERVER		-7
+#define		HTTP_ERROR_NO_ROOM				-8
+#define		HTTP_ERROR_READ_TIMEOUT			-11
+//A pipeline is still waiting on responses
+#define		HTTP_ERROR_BUSY					-12
+
+typedef struct {
+	uint16_t	start;			//Offset of the request in the request buffer
+	bool		idempotent;		//Safe to send again if the connection drops mid-response
+	bool		streamed;		//Body went straight to the socket and can't be sent again
+	bool		lost;			//Written before the connection failed and not safe to send again, its bytes are gone
+} pond_http_request;
+
+class PondHttpConnection {
+	private:
+		WiFiClient		client;
+		const char*		host;
+		int				port;
+		bool			reuse;
+		uint16_t		timeout;
+		uint32_t		connects;
+		
+		//Queued requests, written back to back then answered in order
+		char				request[HTTP_REQUEST_BUFFER_SIZE];
+		uint16_t			requestLength;
+		uint16_t			requestSent;
+		pond_http_request	queued[HTTP_PIPELINE_DEPTH];
+		uint8_t				head;
+		uint8_t				count;
+		uint16_t			chunkLength;		//Streamed body bytes held after the request
+		
+		//Response parser
+		Stream*			sink;
+		uint8_t			state;
+		char			line[HTTP_LINE_SIZE];
+		uint8_t			lineLength;
+		int				status;
+		int32_t			remaining;
+		bool			chunked;
+		bool			closeAfter;
+		bool			received;		//Bytes of the oldest request's response arrived
+		bool			retried;
+		unsigned long	lastActivity;
+		char			etag[HTTP_LINE_SIZE];	//ETag of the response being read, empty if it has none
+#if POND_METRICS
+		PondMetrics*	metrics;
+#endif
+		
+		bool	queueRequest(const char* method, const char* path, const char* cookie,
+							const char* body, int bodyLength, bool streamed, const char* match);
+		bool	flushChunk(bool last);
+		bool	open();
+		int		writeQueued();
+		bool	readLine(char c);
+		int		takeLine();
+		void	takeHeader();
+		int		startBody();
+		void	readBody();
+		int		finish(int code);
+		void	rewind(bool replayWritten);
+		uint16_t	requestEnd(uint8_t index);
+		void	cut(uint16_t start, uint16_t len);
+		
+	public:
+		PondHttpConnection(const char* host, int port);
+		void		setSink(Stream* sink);
+		void		setReuse(bool reuse);
+		void		setTimeout(uint16_t ms);
+		
+		//Adds a request to the queue. It goes out on the next poll(). With match set it's
+		//conditional on If-None-Match, and an unchanged resource is answered with a 304
+		bool		queue(const char* method, const char* path, const char* cookie,
+							const char* body, int bodyLength, const char* match = NULL);
+		uint8_t		pending();
+		
+		//Streamed request body, sent with chunked transfer encoding while the queue is otherwise empty
+		bool		beginChunked(const char* method, const char* path, const char* cookie);
+		bool		writeBody(const char* data, int len);
+		int			endChunked();
+		
+		//Advances the oldest request. Returns HTTP_PENDING, its status code or an error
+		int			poll();
+		//Blocks until the oldest request completes
+		int			next();
+		void		close();
+		uint32_t	getConnects();
+		const char*	getETag();
+#if POND_METRICS
+		//Bytes on the wire and requests sent again on a new connection are counted here
+		void		setMetrics(PondMetrics* counters);
+#endif
+};
+
+#endif
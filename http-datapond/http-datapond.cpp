@@ -33,188 +33,896 @@ THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Arduino.h"
 #include "http-datapond.h"
-#include "ESP8266HTTPClient.h"
+#include "datapond-format.h"
 
-HttpDatapond::HttpDatapond(const char* ip, int port) {
+PondResponseBuffer::PondResponseBuffer() {
+	clear();
+}
+
+void PondResponseBuffer::clear() {
+	length = 0;
+	truncated = false;
+	buffer[0] = '\0';
+}
+
+const char* PondResponseBuffer::c_str() {
+	return buffer;
+}
+
+uint16_t PondResponseBuffer::size() {
+	return length;
+}
+
+bool PondResponseBuffer::isTruncated() {
+	return truncated;
+}
+
+size_t PondResponseBuffer::write(uint8_t b) {
+	return write(&b, 1);
+}
+
+/*	Always reports the whole write as taken so the transfer completes, extra bytes are dropped	*/
+size_t PondResponseBuffer::write(const uint8_t* data, size_t len) {
+	size_t room = RESPONSE_BUFFER_SIZE - length;
+	if (len > room) {
+		truncated = true;
+		memcpy(buffer + length, data, room);
+		length += room;
+	}
+	else {
+		memcpy(buffer + length, data, len);
+		length += len;
+	}
+	buffer[length] = '\0';
+	return len;
+}
+
+int PondResponseBuffer::available() {
+	return 0;
+}
+
+int PondResponseBuffer::read() {
+	return -1;
+}
+
+int PondResponseBuffer::peek() {
+	return -1;
+}
+
+void PondResponseBuffer::flush() {
+}
+
+HttpDatapond::HttpDatapond(const char* ip, int port) : connection(ip, port) {
 	pondIPAddress = ip;
 	serverPort = port;
+	connection.setSink(&response);
+#if POND_METRICS
+	connection.setMetrics(&metrics);
+#endif
+	dropletLog = NULL;
+	draining = false;
+	drainInFlight = false;
+	recoveryTime = 0;
+	
+	pondUsername = NULL;
+	pondPassword = NULL;
+	loginInFlight = false;
+	loginArmed = false;
+	loginTime = 0;
+	loginBackoff = SESSION_RETRY_MIN;
+	
+	async = false;
+	pendingHead = 0;
+	pendingCount = 0;
+	currentToken = 0;
+	_loggedIn = NULL;
+	_createDropletFn = NULL;
+	_responseFn = NULL;
+	_readValueFn = NULL;
+	_doneFn = NULL;
+	_doneContext = NULL;
+	aggregators = NULL;
+	cache = NULL;
+	cookie[0] = '\0';
+	url[0] = '\0';
+	bodyLength = 0;
 }
 
+/*	The credentials are kept to log in again if the session expires, so they must stay valid	*/
 int	HttpDatapond::login(const char* username, const char* password) {
-	url = "/user/login";
-	HTTPClient::begin(pondIPAddress, serverPort, url);
+	pondUsername = username;
+	pondPassword = password;
+	setUrl("/user/login");
+	bodyLength = formatLogin(body);
+	loginArmed = true;
+	loginTime = millis();
+	int code = request("POST", true, HTTP_LOGIN);
+	if (code == HTTP_QUEUED)
+		loginInFlight = true;
+	return code;
+}
+
+/*	Logs in again while there is no session. Each login that brings none back doubles the wait for the next.
+	Blocking requests log in again themselves, see relogin(). Credentials from setCredentials() alone
+	send nothing until the sketch's own login() or a rejected session	*/
+void HttpDatapond::retryLogin() {
+	if (!async || !loginArmed || (cookie[0] != '\0') || loginInFlight || (pondUsername == NULL))
+		return;
+	if (millis() - loginTime < loginBackoff)
+		return;
+	if (login(pondUsername, pondPassword) != HTTP_QUEUED)
+		return;
+	loginBackoff = (2 * loginBackoff < SESSION_RETRY_MAX) ? 2 * loginBackoff : SESSION_RETRY_MAX;
+}
+
+/*	Writes the login body into credentials, which holds HTTP_BODY_SIZE. Returns its length	*/
+int HttpDatapond::formatLogin(char* credentials) {
 	//body = "{\"email\": \"soon@along.com\",";
 	//body += " \"password\": \"blankevent\"}\r\n";
-	body = "{\"email\": \"" + (String)username;
-	body += "\",";
-	body += " \"password\": \"" + (String)password;
-	body += "\"}\r\n";
-	return HTTPClient::POST(body);
+	int len = pondAppend(credentials, 0, HTTP_BODY_SIZE, "{\"email\": \"");
+	len = pondAppend(credentials, len, HTTP_BODY_SIZE, pondUsername);
+	len = pondAppend(credentials, len, HTTP_BODY_SIZE, "\", \"password\": \"");
+	len = pondAppend(credentials, len, HTTP_BODY_SIZE, pondPassword);
+	return pondAppend(credentials, len, HTTP_BODY_SIZE, "\"}\r\n");
 }
 
+/*	Logs in again for a request that was turned away, leaving its url and body alone	*/
+bool HttpDatapond::relogin() {
+	char credentials[HTTP_BODY_SIZE];
+	if (pondUsername == NULL)
+		return false;
+	int len = formatLogin(credentials);
+	
+	cookie[0] = '\0';
+	response.clear();
+	if (!connection.queue("POST", "/user/login", NULL, credentials, len))
+		return false;
+	int code = connection.next();
+	if ((code < 200) || (code >= 300))
+		return false;
+	collectCookie();
+	return cookie[0] != '\0';
+}
+
+/*	Credentials for logging in again, for a restored session that never called login()	*/
+void HttpDatapond::setCredentials(const char* username, const char* password) {
+	pondUsername = username;
+	pondPassword = password;
+}
+
+/*	Copies the session out so it can be kept over deep sleep. Returns false without one	*/
+bool HttpDatapond::exportSession(pond_session* session) {
+	if (cookie[0] == '\0')
+		return false;
+	if (!pondSessionFill(session, pondIPAddress, serverPort, cookie))
+		return false;
+	session->messageID = 0;
+	session->token = currentToken;
+	pondSessionSeal(session);
+	return true;
+}
+
+/*	Picks up a saved session, so the first request doesn't wait on a login	*/
+bool HttpDatapond::restoreSession(const pond_session* session) {
+	if (!pondSessionValid(session, pondIPAddress, serverPort))
+		return false;
+	pondAppend(cookie, 0, HTTP_COOKIE_SIZE, session->cookie);
+	currentToken = (http_token)session->token;
+	return true;
+}
+
+/*	Extracts the cookie from the login response	*/
 void HttpDatapond::collectCookie() {
-	payload = HTTPClient::getString();
-	int cookieStart, cookieEnd;
-	cookieStart = payload.indexOf("session") + 10;
-	cookieEnd = payload.indexOf('}') - 1;
-	cookie = "session=" + payload.substring(cookieStart, cookieEnd);
-	Serial.print("\nCookie: ");
-	Serial.println(cookie);
-	Serial.println();
+	pond_view session;
+	//A cookie too long to keep is left out, and requests fail as unauthorized
+	if (!pondJsonFind(response.c_str(), response.size(), "session", &session) || (8 + session.len >= HTTP_COOKIE_SIZE))
+		return;
+	memcpy(cookie, "session=", 8);
+	memcpy(cookie + 8, session.ptr, session.len);
+	cookie[8 + session.len] = '\0';
+	loginBackoff = SESSION_RETRY_MIN;
 }
 
 int HttpDatapond::getLastDroplet(int stream_id) {
-	url = "/droplet/last?stream=" + (String)stream_id;
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
-	return code;
+	setUrl("/droplet/last?stream=", stream_id);
+	return request("GET", false, HTTP_READ_DROPLET);
 }
 
 int HttpDatapond::createDroplet(int stream_id, double data) {
-	url = "/droplet?stream=";
-	url += stream_id;
-	
-	body = "{\"value\":" + (String)data;
-	body += ",\"stream_id\":";
-	body += (String)stream_id;
-	body += "}\r\n";
+	return logDroplet(postDroplet(stream_id, data, 0), stream_id, data);
+}
+
+/*	Logs a droplet that failed to send. Queued droplets are kept by complete() if they fail	*/
+int HttpDatapond::logDroplet(int code, int stream_id, double data) {
+	if (code == HTTP_QUEUED) {
+		lastPending()->single_droplet = true;
+		lastPending()->stream_id = stream_id;
+		lastPending()->value = data;
+	}
+	else if ((dropletLog != NULL) && keepDroplet(code)) {
+		dropletLog->append(stream_id, data);
+	}
+	return code;
+}
+
+/*	Keep the droplet if the link or the session is down	*/
+bool HttpDatapond::keepDroplet(int code) {
+	return (code < 0) || (code == 401) || (code >= 500);
+}
+
+int HttpDatapond::createDroplet(int stream_id, const String& data) {
+	return createDroplet(stream_id, data.c_str());
+}
+
+/*	Creates a droplet with data written as is as its value, so text needs its quotes. Text that reads as a number is also logged as one	*/
+int HttpDatapond::createDroplet(int stream_id, const char* data) {
+	char* end;
+	double value = strtod(data, &end);
+	setUrl("/droplet?stream=", stream_id);
+	formatDroplet(stream_id, data, 0);
+	int code = request("POST", true, HTTP_CREATE_DROPLET);
+	//The log keeps numbers only, other text is lost if it can't be sent
+	if ((end != data) && (*end == '\0'))
+		return logDroplet(code, stream_id, value);
+	return code;
+}
+
+int HttpDatapond::getStatsToday(int stream_id) {
+	setUrl("/stream/stats/today/", stream_id);
+	return request("GET", false, HTTP_READ_DROPLET);
+}
+
+int HttpDatapond::getStatsFrom(const String& from, const String& towards, int stream_id) {
+	int len = setUrl("/stream/stats/range/", stream_id);
+	len = pondAppend(url, len, HTTP_URL_SIZE, "?from=");
+	len = pondAppend(url, len, HTTP_URL_SIZE, from.c_str());
+	len = pondAppend(url, len, HTTP_URL_SIZE, "&to=");
+	pondAppend(url, len, HTTP_URL_SIZE, towards.c_str());
+	return request("GET", false, HTTP_READ_DROPLET);
+}
+
+String HttpDatapond::getPayload() {
+	return String(response.c_str());
+}
+
+/*	Returns the last response body in place	*/
+pond_view HttpDatapond::getPayloadView() {
+	pond_view view = {response.c_str(), response.size()};
+	return view;
+}
+
+/*	Decodes the droplet or stats fields of the last response	*/
+bool HttpDatapond::getReading(pond_reading* reading) {
+	return pondJsonReading(response.c_str(), response.size(), reading);
+}
+
+/*	Sends one request on the kept-alive connection. Waits for its response unless in async mode	*/
+int HttpDatapond::request(const char* method, bool hasBody, uint8_t callbackCode) {
+	//Pipelines and asynchronous requests share the connection's queue, one kind at a time
+	if (connection.pending() > (async ? pendingCount : 0))
+		return HTTP_ERROR_BUSY;
 	
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
+	bool cached = cacheable(method);
+	pond_cache_entry* entry = cached ? cache->find(url, strlen(url)) : NULL;
+	//Blocking reads of a fresh entry don't reach the server at all
+	if (!async && (entry != NULL) && cache->isFresh(entry, millis())) {
+		cache->hit(entry, millis());
+		response.clear();
+		response.write((const uint8_t*)entry->body, entry->bodyLength);
+		return 200;
+	}
 	
-	int code = HTTPClient::POST(body);
-	payload = HTTPClient::getString();
+	int code = send(method, hasBody, callbackCode, cached);
+	//The server dropped the session. Log in again and repeat the request once
+	if ((code == 401) && (callbackCode != HTTP_LOGIN) && relogin())
+		code = send(method, hasBody, callbackCode, cached);
 	return code;
 }
 
-int HttpDatapond::createDroplet(int stream_id, String data) {
-	url = "/droplet?stream=";
-	url += stream_id;
+int HttpDatapond::send(const char* method, bool hasBody, uint8_t callbackCode, bool cached) {
+	char match[CACHE_ETAG_SIZE + 1];
+	const char* etag = NULL;
+	bool queued;
 	
-	body = "{\"value\":" + data;
-	body += ",\"stream_id\":";
-	body += (String)stream_id;
-	body += "}\r\n";
+	pond_cache_entry* stored = cached ? cache->find(url, strlen(url)) : NULL;
+	if ((stored != NULL) && (stored->etagLength > 0)) {
+		memcpy(match, stored->etag, stored->etagLength);
+		match[stored->etagLength] = '\0';
+		etag = match;
+	}
 	
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
+	if (connection.pending() == 0)
+		response.clear();
+	if (hasBody)
+		queued = connection.queue(method, url, cookie, body, bodyLength, etag);
+	else
+		queued = connection.queue(method, url, cookie, NULL, 0, etag);
+	if (!queued)
+		return HTTP_ERROR_NO_ROOM;
+	POND_METRIC(request(metricOp(callbackCode)));
+	POND_METRIC(queue(connection.pending()));
+	if (!async) {
+		unsigned long start = millis();
+		int code = settleCache(cached ? url : NULL, connection.next());
+		measure(metricOp(callbackCode), code, start);
+		return code;
+	}
 	
-	int code = HTTPClient::POST(body);
-	payload = HTTPClient::getString();
-	return code;
+	http_pending_struct* entry = &pending[(pendingHead + pendingCount) % HTTP_PIPELINE_DEPTH];
+	entry->token = ++currentToken;
+	entry->callback_code = callbackCode;
+	entry->single_droplet = false;
+	entry->logged = false;
+	entry->log_first = 0;
+	//The url is copied, as the next request overwrites it before this one's response arrives
+	pondAppend(entry->cache_url, 0, CACHE_REQUEST_SIZE, cached ? url : "");
+	entry->sent_time = millis();
+	pendingCount++;
+	POND_METRIC(slots(pendingCount));
+	return HTTP_QUEUED;
 }
 
-int HttpDatapond::getStatsToday(int stream_id) {
-	url = "/stream/stats/today/" + (String)stream_id;
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
+/*	Returns the request request() just queued	*/
+http_pending_struct* HttpDatapond::lastPending() {
+	return &pending[(pendingHead + pendingCount - 1) % HTTP_PIPELINE_DEPTH];
+}
+
+
+////////////////////////////////////////////////////////
+////			Asynchronous Requests			 	////
+////////////////////////////////////////////////////////
+
+/*	Requests queue instead of blocking while enabled. Finish outstanding ones before turning it off	*/
+void HttpDatapond::setAsync(bool enable) {
+	async = enable;
+}
+
+/*	Writes queued requests and reads what has arrived. Completed requests go to their handlers	*/
+void HttpDatapond::run() {
+	int code;
+	while (pendingCount > 0) {
+		code = connection.poll();
+		if (code == HTTP_PENDING)
+			break;
+		complete(code);
+	}
+	retryLogin();
+	for (PondAggregator* agg = aggregators; agg != NULL; agg = agg->next)
+		flushAggregator(agg, millis());
+}
+
+/*	Hands the oldest request's response to its handler	*/
+void HttpDatapond::complete(int code) {
+	//Copied out, a handler may queue the next request into this entry
+	http_pending_struct entry = pending[pendingHead];
+	pendingHead = (pendingHead + 1) % HTTP_PIPELINE_DEPTH;
+	pendingCount--;
+	code = settleCache(entry.cache_url, code);
+	bool status = (code >= 200) && (code < 300);
+	pond_reading reading;
+	measure(metricOp(entry.callback_code), code, entry.sent_time);
+	
+	switch (entry.callback_code) {
+		case HTTP_LOGIN:
+			loginInFlight = false;
+			if (status)
+				collectCookie();
+			if (_loggedIn != NULL)
+				_loggedIn(status);
+			break;
+		case HTTP_CREATE_DROPLET:
+			if (entry.logged)
+				settleLogged(code, entry.log_first, 1);
+			else if (entry.single_droplet && (dropletLog != NULL) && keepDroplet(code))
+				dropletLog->append(entry.stream_id, entry.value);
+			if (_createDropletFn != NULL)
+				_createDropletFn(entry.token, code);
+			break;
+		case HTTP_READ_DROPLET:
+			if (_readValueFn != NULL) {
+				bool decoded = pondJsonReading(response.c_str(), response.size(), &reading);
+				_readValueFn(entry.token, status && decoded, &reading);
+			}
+			if (_responseFn != NULL)
+				_responseFn(entry.token, code);
+			break;
+		default:
+			if (_responseFn != NULL)
+				_responseFn(entry.token, code);
+			break;
+	}
+	if (_doneFn != NULL)
+		_doneFn(_doneContext, entry.token, entry.callback_code, code);
+	response.clear();
+	
+	//The server dropped the session, log in again behind the requests already queued
+	if ((code == 401) && (entry.callback_code != HTTP_LOGIN)) {
+		cookie[0] = '\0';
+		loginArmed = true;
+		retryLogin();
+	}
+}
+
+/*	Returns the token of the most recently queued request	*/
+http_token HttpDatapond::getLastToken() {
+	return currentToken;
+}
+
+/*	Returns how many asynchronous requests are waiting on a response	*/
+uint8_t HttpDatapond::getPending() {
+	return pendingCount;
+}
+
+void HttpDatapond::setLoginHandler(http_login_ptr handler) {
+	_loggedIn = handler;
+}
+
+void HttpDatapond::setCreateDropletHandler(http_request_ptr handler) {
+	_createDropletFn = handler;
+}
+
+/*	Called with the response code of every request but login and createDroplet, the body is in getPayloadView()	*/
+void HttpDatapond::setResponseHandler(http_request_ptr handler) {
+	_responseFn = handler;
+}
+
+void HttpDatapond::setReadValueHandler(http_value_ptr handler) {
+	_readValueFn = handler;
+}
+
+void HttpDatapond::setCompletionHandler(http_done_fn handler, void* context) {
+	_doneFn = handler;
+	_doneContext = context;
+}
+
+/*	With reuse off, a new connection is made for every request	*/
+void HttpDatapond::setReuse(bool reuse) {
+	connection.setReuse(reuse);
+}
+
+/*	Operation a callback code is counted under	*/
+uint8_t HttpDatapond::metricOp(uint8_t callbackCode) {
+	switch (callbackCode) {
+		case HTTP_LOGIN:
+			return METRIC_LOGIN;
+		case HTTP_CREATE_DROPLET:
+			return METRIC_CREATE;
+		case HTTP_READ_DROPLET:
+		case HTTP_READ:
+			return METRIC_READ;
+	}
+	return METRIC_OTHER;
+}
+
+/*	Counts a completed request. Errors with no response aren't timed	*/
+void HttpDatapond::measure(uint8_t op, int code, unsigned long start) {
+#if POND_METRICS
+	if (code > 0)
+		metrics.latency(op, millis() - start);
+	if ((code < 200) || (code >= 300))
+		metrics.failure(op);
+	if (code == HTTP_ERROR_READ_TIMEOUT)
+		metrics.timeout();
+#endif
+}
+
+#if POND_METRICS
+PondMetrics* HttpDatapond::getMetrics() {
+	return &metrics;
+}
+
+/*	Posts the metrics summary as a text droplet in stream_id	*/
+int HttpDatapond::sendMetrics(int stream_id) {
+	//Written as a JSON string, createDroplet() takes the value as is
+	char text[METRICS_SUMMARY_SIZE + 2];
+	int len = metrics.summary(text + 1, METRICS_SUMMARY_SIZE);
+	text[0] = '"';
+	text[len + 1] = '"';
+	text[len + 2] = '\0';
+	return createDroplet(stream_id, text);
+}
+#endif
+
+/*	Returns how many connections have been made to the server	*/
+uint32_t HttpDatapond::getConnects() {
+	return connection.getConnects();
+}
+
+
+////////////////////////////////////////////////////////
+////			Bulk Ingest						 	////
+////////////////////////////////////////////////////////
+
+/*	Posts every record from source as one JSON array, streamed in chunks so memory use doesn't grow with the count	*/
+int HttpDatapond::ingest(droplet_source_ptr source, void* context, uint32_t* records) {
+	droplet_record rec;
+	char entry[INGEST_ENTRY_SIZE + 1];
+	uint32_t sent = 0;
+	bool written = true;
+	
+	if (records != NULL)
+		*records = 0;
+	if (connection.pending() > 0)
+		return HTTP_ERROR_BUSY;
+	response.clear();
+	setUrl("/droplet/batch");
+	unsigned long start = millis();
+	if (!connection.beginChunked("POST", url, cookie))
+		return HTTP_ERROR_SEND_FAILED;
+	
+	while (written && source(context, &rec)) {
+		entry[0] = (sent == 0) ? '[' : ',';
+		int len = formatEntry(entry + 1, &rec) + 1;
+		written = connection.writeBody(entry, len);
+		sent++;
+	}
+	if (written)
+		written = (sent == 0) ? connection.writeBody("[]", 2) : connection.writeBody("]", 1);
+	if (!written) {
+		connection.close();
+		return HTTP_ERROR_SEND_FAILED;
+	}
+	
+	if (records != NULL)
+		*records = sent;
+	POND_METRIC(request(METRIC_CREATE));
+	int code = connection.endChunked();
+	measure(METRIC_CREATE, code, start);
 	return code;
 }
 
-int HttpDatapond::getStatsFrom(String from, String towards, int stream_id) {
-	url = "/stream/stats/range/" + (String)stream_id + "?from=" + from + "&to=" + towards;
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
+/*	Writes a single droplet. A zero timestamp is left for the server to fill in	*/
+int HttpDatapond::formatEntry(char* entry, const droplet_record* rec) {
+	forgetStream(rec->stream_id);
+	int len = pondAppend(entry, 0, INGEST_ENTRY_SIZE, "{\"stream_id\":");
+	len += pondFormatInt(entry + len, rec->stream_id);
+	len = pondAppend(entry, len, INGEST_ENTRY_SIZE, ",\"value\":");
+	len += pondFormatDouble(entry + len, rec->value, 2);
+	if (rec->timestamp != 0) {
+		len = pondAppend(entry, len, INGEST_ENTRY_SIZE, ",\"timestamp\":");
+		len += pondFormatUnsigned(entry + len, rec->timestamp);
+	}
+	return pondAppend(entry, len, INGEST_ENTRY_SIZE, "}");
+}
+
+
+////////////////////////////////////////////////////////
+////			Read Cache						 	////
+////////////////////////////////////////////////////////
+
+/*	Caches GET responses in responseCache, NULL turns caching off	*/
+void HttpDatapond::setCache(PondCache* responseCache) {
+	cache = responseCache;
+}
+
+/*	Returns true if a request to url goes through the cache	*/
+bool HttpDatapond::cacheable(const char* method) {
+	return (cache != NULL) && (strcmp(method, "GET") == 0) && (strlen(url) < CACHE_REQUEST_SIZE);
+}
+
+/*	Drops the cached reads a write to stream_id makes stale	*/
+void HttpDatapond::forgetStream(int stream_id) {
+	char path[HTTP_URL_SIZE];
+	char number[POND_NUMBER_SIZE];
+	if (cache == NULL)
+		return;
+	pondFormatInt(number, stream_id);
+	int len = pondAppend(path, pondAppend(path, 0, HTTP_URL_SIZE, "/droplet/last?stream="), HTTP_URL_SIZE, number);
+	cache->invalidate(path, len);
+	len = pondAppend(path, pondAppend(path, 0, HTTP_URL_SIZE, "/stream/stats/today/"), HTTP_URL_SIZE, number);
+	cache->invalidate(path, len);
+}
+
+/*	Answers a 304 from the cache and keeps a full response for next time. request is the url the
+	response is for, NULL or empty if it isn't cached. Returns the code to report	*/
+int HttpDatapond::settleCache(const char* request, int code) {
+	if ((request == NULL) || (request[0] == '\0'))
+		return code;
+	uint8_t length = strlen(request);
+	pond_cache_entry* entry = cache->find(request, length);
+	if ((code == 304) && (entry != NULL)) {
+		cache->validated(entry, millis());
+		response.clear();
+		response.write((const uint8_t*)entry->body, entry->bodyLength);
+		return 200;
+	}
+	if ((code == 200) && !response.isTruncated()) {
+		const char* etag = connection.getETag();
+		cache->store(request, length, (const uint8_t*)etag, strlen(etag), response.c_str(), response.size(), 0, millis());
+		cache->miss();
+	}
 	return code;
 }
 
-String HttpDatapond::getPayload() {
-	return payload;
+
+////////////////////////////////////////////////////////
+////			Aggregation						 	////
+////////////////////////////////////////////////////////
+
+/*	Adds agg to the aggregators run() closes windows on. It must stay valid	*/
+void HttpDatapond::addAggregator(PondAggregator* agg) {
+	for (PondAggregator* a = aggregators; a != NULL; a = a->next) {
+		if (a == agg)
+			return;
+	}
+	agg->next = aggregators;
+	aggregators = agg;
+}
+
+/*	Adds a sample, sending the summary first if its window has closed	*/
+void HttpDatapond::sample(PondAggregator* agg, double value) {
+	uint32_t now = millis();
+	flushAggregator(agg, now);
+	agg->add(value, now);
+}
+
+/*	Sends one droplet per summary field that has a stream	*/
+void HttpDatapond::flushAggregator(PondAggregator* agg, uint32_t now) {
+	pond_reading summary;
+	if (!agg->poll(now, &summary))
+		return;
+	for (int i = 0; i < AGG_FIELDS; i++) {
+		double value;
+		int stream_id = agg->output(i, &summary, &value);
+		if (stream_id != 0)
+			createDroplet(stream_id, value);
+	}
+}
+
+
+////////////////////////////////////////////////////////
+////			Pipelined Requests				 	////
+////////////////////////////////////////////////////////
+
+/*	Queues a getLastDroplet to go out with the rest of the pipeline	*/
+bool HttpDatapond::queueLastDroplet(int stream_id) {
+	if (pendingCount > 0)
+		return false;
+	setUrl("/droplet/last?stream=", stream_id);
+	if (!connection.queue("GET", url, cookie, NULL, 0))
+		return false;
+	POND_METRIC(request(METRIC_OTHER));
+	POND_METRIC(queue(connection.pending()));
+	return true;
+}
+
+/*	Queues a createDroplet to go out with the rest of the pipeline	*/
+bool HttpDatapond::queueDroplet(int stream_id, double data) {
+	if (pendingCount > 0)
+		return false;
+	char value[POND_NUMBER_SIZE];
+	pondFormatDouble(value, data, 2);
+	setUrl("/droplet?stream=", stream_id);
+	formatDroplet(stream_id, value, 0);
+	if (!connection.queue("POST", url, cookie, body, bodyLength))
+		return false;
+	POND_METRIC(request(METRIC_OTHER));
+	POND_METRIC(queue(connection.pending()));
+	return true;
+}
+
+/*	Sends the queued requests on one connection and hands each response to handler in order. Returns how many succeeded	*/
+int HttpDatapond::sendPipeline(http_response_ptr handler) {
+	int succeeded = 0;
+	if (pendingCount > 0)
+		return HTTP_ERROR_BUSY;
+	//Every response is timed from the write of the pipeline
+	unsigned long start = millis();
+	for (uint8_t index = 0; connection.pending() > 0; index++) {
+		response.clear();
+		int code = connection.next();
+		measure(METRIC_OTHER, code, start);
+		if ((code >= 200) && (code < 300))
+			succeeded++;
+		if (handler != NULL)
+			handler(index, code, getPayloadView());
+	}
+	return succeeded;
 }
 
 int HttpDatapond::getPond(int pond_id) {
-	url = "/pond/" + (String)pond_id;
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
-	return code;
+	setUrl("/pond/", pond_id);
+	return request("GET", false, HTTP_READ);
 }
 
 int HttpDatapond::getPondCount() {
-	url = "/pond/count";
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
-	return code;
+	setUrl("/pond/count");
+	return request("GET", false, HTTP_READ);
 }
 
 int HttpDatapond::getStream(int stream_id) {
-	url = "/stream/"+ (String)stream_id;
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
-	return code;
+	setUrl("/stream/", stream_id);
+	return request("GET", false, HTTP_READ);
 }
 
 int HttpDatapond::getStreamsInPond(int pond_id) {
-	url = "/stream?pond="+ (String)pond_id;
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
-	return code;
+	setUrl("/stream?pond=", pond_id);
+	return request("GET", false, HTTP_READ);
 }
 
 int HttpDatapond::getStreamCountInPond(int pond_id) {
-	url = "/stream/count?pond="+ (String)pond_id;
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
-	return code;
+	setUrl("/stream/count?pond=", pond_id);
+	return request("GET", false, HTTP_READ);
+}
+
+/*	Posts a droplet. A zero timestamp is left for the server to fill in	*/
+int HttpDatapond::postDroplet(int stream_id, double data, uint32_t timestamp) {
+	char value[POND_NUMBER_SIZE];
+	pondFormatDouble(value, data, 2);
+	setUrl("/droplet?stream=", stream_id);
+	formatDroplet(stream_id, value, timestamp);
+	return request("POST", true, HTTP_CREATE_DROPLET);
+}
+
+/*	Writes the path into url. Returns its length	*/
+int HttpDatapond::setUrl(const char* path) {
+	return pondAppend(url, 0, HTTP_URL_SIZE, path);
+}
+
+/*	Writes the path with id after it into url	*/
+int HttpDatapond::setUrl(const char* path, int32_t id) {
+	char number[POND_NUMBER_SIZE];
+	pondFormatInt(number, id);
+	return pondAppend(url, setUrl(path), HTTP_URL_SIZE, number);
+}
+
+/*	Writes a droplet body with value as is. A zero timestamp is left for the server to fill in	*/
+int HttpDatapond::formatDroplet(int stream_id, const char* value, uint32_t timestamp) {
+	char number[POND_NUMBER_SIZE];
+	forgetStream(stream_id);
+	int len = pondAppend(body, 0, HTTP_BODY_SIZE, "{\"value\":");
+	len = pondAppend(body, len, HTTP_BODY_SIZE, value);
+	len = pondAppend(body, len, HTTP_BODY_SIZE, ",\"stream_id\":");
+	pondFormatInt(number, stream_id);
+	len = pondAppend(body, len, HTTP_BODY_SIZE, number);
+	if (timestamp != 0) {
+		len = pondAppend(body, len, HTTP_BODY_SIZE, ",\"timestamp\":");
+		pondFormatUnsigned(number, timestamp);
+		len = pondAppend(body, len, HTTP_BODY_SIZE, number);
+	}
+	bodyLength = pondAppend(body, len, HTTP_BODY_SIZE, "}\r\n");
+	return bodyLength;
+}
+
+void HttpDatapond::setDropletLog(DropletLog* log) {
+	dropletLog = log;
 }
 
-String HttpDatapond::getCookie() {
+/*	Sends up to maxRecords logged droplets, oldest first. Returns the number handled	*/
+int HttpDatapond::drainLog(int maxRecords) {
+	droplet_record rec;
+	int handled = 0;
+	
+	if ((dropletLog == NULL) || dropletLog->isEmpty())
+		return 0;
+	if (!draining) {
+		draining = true;
+		drainStart = millis();
+	}
+	
+	while ((handled < maxRecords) && !dropletLog->isEmpty() && !drainInFlight) {
+		//Oldest record is unreadable, skip past it
+		if (!dropletLog->peek(0, &rec)) {
+			dropletLog->discard(1);
+			continue;
+		}
+		int code = postDroplet(rec.stream_id, rec.value, rec.timestamp);
+		//In async mode the record is settled once its response arrives
+		if (code == HTTP_QUEUED) {
+			lastPending()->logged = true;
+			lastPending()->log_first = rec.sequence;
+			drainInFlight = true;
+			handled++;
+			break;
+		}
+		settleLogged(code, rec.sequence, 1);
+		if (keepDroplet(code))
+			break;
+		handled++;
+	}
+	
+	if (dropletLog->isEmpty() && draining) {
+		recoveryTime = millis() - drainStart;
+		draining = false;
+	}
+	return handled;
+}
+
+/*	Updates the log with the outcome of posting the records starting at sequence first. Any of them
+	overwritten while the request was in flight are no longer in the log and are left alone	*/
+void HttpDatapond::settleLogged(int code, uint32_t first, uint16_t records) {
+	drainInFlight = false;
+	if ((code >= 200) && (code < 300))
+		dropletLog->consume(first, records);
+	else if (!keepDroplet(code))
+		dropletLog->discard(first, records);
+	
+	if (draining && dropletLog->isEmpty()) {
+		recoveryTime = millis() - drainStart;
+		draining = false;
+	}
+}
+
+/*	Sends up to maxRecords logged droplets in one streamed request. Returns the number handled	*/
+int HttpDatapond::drainLogBulk(uint16_t maxRecords) {
+	droplet_record rec;
+	uint32_t sent = 0;
+	
+	if ((dropletLog == NULL) || dropletLog->isEmpty() || drainInFlight)
+		return 0;
+	//Oldest record is unreadable, skip past it
+	if (!dropletLog->peek(0, &rec)) {
+		dropletLog->discard(1);
+		return 0;
+	}
+	if (!draining) {
+		draining = true;
+		drainStart = millis();
+	}
+	
+	bulkIndex = 0;
+	bulkLimit = maxRecords;
+	uint32_t first = dropletLog->tail();
+	int code = ingest(logSource, this, &sent);
+	if (keepDroplet(code))
+		return 0;
+	settleLogged(code, first, sent);
+	return sent;
+}
+
+/*	Reads the log oldest first for drainLogBulk(), stopping at the limit or an unreadable record	*/
+bool HttpDatapond::logSource(void* context, droplet_record* record) {
+	HttpDatapond* pond = (HttpDatapond*)context;
+	if (pond->bulkIndex >= pond->bulkLimit)
+		return false;
+	if (!pond->dropletLog->peek(pond->bulkIndex, record))
+		return false;
+	pond->bulkIndex++;
+	return true;
+}
+
+/*	Returns how long the last drain took to empty the log, in ms	*/
+unsigned long HttpDatapond::getRecoveryTime() {
+	return recoveryTime;
+}
+
+const char* HttpDatapond::getCookie() {
 	return cookie;
 }
 
+/*	Adds up the client and everything attached to it. The total is also returned	*/
+uint32_t HttpDatapond::memoryFootprint(pond_footprint* report) {
+	pond_footprint footprint;
+	footprint.client = sizeof(*this);
+	footprint.requests = sizeof(pending) + sizeof(connection);
+	footprint.buffers = sizeof(response) + sizeof(body) + sizeof(url) + sizeof(cookie);
+	footprint.attached = 0;
+	if (cache != NULL)
+		footprint.attached += sizeof(PondCache);
+	if (dropletLog != NULL)
+		footprint.attached += sizeof(DropletLog);
+	for (PondAggregator* agg = aggregators; agg != NULL; agg = agg->next)
+		footprint.attached += sizeof(PondAggregator);
+	footprint.total = footprint.client + footprint.attached;
+	if (report != NULL)
+		*report = footprint;
+	return footprint.total;
+}
+
 //Currently unsupported
 int HttpDatapond::getCountries() {
-	url = "/countries/";
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
-	return code;
+	setUrl("/countries/");
+	return request("GET", false, HTTP_READ);
 }
 	
-int HttpDatapond::getCountries(String query) {
-	url = "/countries?startswith=" + query;
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
-	return code;
+int HttpDatapond::getCountries(const String& query) {
+	pondAppend(url, setUrl("/countries?startswith="), HTTP_URL_SIZE, query.c_str());
+	return request("GET", false, HTTP_READ);
 }
 
 int HttpDatapond::getTimeZones(int countryCode) {
-	url = "/timezones?country=" + (String)countryCode;
-	HTTPClient::setReuse(true);
-	HTTPClient::begin(pondIPAddress, serverPort, url);
-	HTTPClient::addHeader((String)"Cookie", cookie, false);
-	int code = HTTPClient::GET();
-	payload = HTTPClient::getString();
-	return code;
+	setUrl("/timezones?country=", countryCode);
+	return request("GET", false, HTTP_READ);
 }
 
 
@@ -33,40 +33,230 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef __HTTP-DATAPOND_h
 #define __HTTP-DATAPOND_h
 #include "ESP8266WiFi.h"
-#include "ESP8266HTTPClient.h"
+#include "datapond-log.h"
+#include "datapond-json.h"
+#include "datapond-http.h"
+#include "datapond-session.h"
+#include "datapond-aggregate.h"
+#include "datapond-cache.h"
+#include "datapond-footprint.h"
 
+//Response bodies longer than this are cut short
+#define		RESPONSE_BUFFER_SIZE	512
+//Longest droplet written by ingest()
+#define		INGEST_ENTRY_SIZE		96
+#define		HTTP_COOKIE_SIZE		SESSION_COOKIE_SIZE
 
-class HttpDatapond : public HTTPClient{
+//Request result in async mode once it's queued, see getLastToken()
+#define		HTTP_QUEUED				1
+
+//Callback codes of asynchronous requests
+#define		HTTP_LOGIN				0x01
+#define		HTTP_CREATE_DROPLET		0x10
+#define		HTTP_READ_DROPLET		0x20
+#define		HTTP_READ				0x21
+
+typedef uint32_t	http_token;
+
+typedef void (*http_response_ptr)(uint8_t index, int code, pond_view body);
+typedef void (*http_login_ptr)(bool status);
+//Completion delegate of every asynchronous request, called with the context it was set with
+//after the handlers. The response body is still in place while it runs
+typedef void (*http_done_fn)(void* context, http_token tkn, uint8_t callbackCode, int code);
+typedef void (*http_request_ptr)(http_token tkn, int code);
+typedef void (*http_value_ptr)(http_token tkn, bool status, const pond_reading* reading);
+//Record source for ingest(). Fills record and returns true until there are none left
+typedef bool (*droplet_source_ptr)(void* context, droplet_record* record);
+
+//Asynchronous request waiting on its response, in the order they were sent
+typedef struct {
+	http_token	token;
+	uint8_t		callback_code;
+	bool		single_droplet;		//stream_id and value can be logged again on failure
+	bool		logged;				//Droplet is a record from the log
+	uint32_t	log_first;			//Sequence of that record
+	int			stream_id;
+	double		value;
+	char		cache_url[CACHE_REQUEST_SIZE];	//GET answered through the cache, empty for anything else
+	unsigned long	sent_time;
+} http_pending_struct;
+
+//Fixed buffer the response body is streamed into, so it can be parsed in place
+class PondResponseBuffer : public Stream {
+	private:
+		char		buffer[RESPONSE_BUFFER_SIZE + 1];
+		uint16_t	length;
+		bool		truncated;
+		
+	public:
+		PondResponseBuffer();
+		void		clear();
+		const char*	c_str();
+		uint16_t	size();
+		bool		isTruncated();
+		
+		size_t	write(uint8_t b);
+		size_t	write(const uint8_t* data, size_t len);
+		int		available();
+		int		read();
+		int		peek();
+		void	flush();
+};
+
+
+class HttpDatapond {
 	private:
 		int 			serverPort;
 		const char*		pondIPAddress;
 		
-		String	cookie;
-		String	body;
-		String	url;
-		String 	payload;
+		char	cookie[HTTP_COOKIE_SIZE];
+		const char*	pondUsername;	//From login(), kept to log in again when the session expires
+		const char*	pondPassword;
+		bool		loginInFlight;
+		bool		loginArmed;		//run() logs in again only after the first login() or a rejected session
+		unsigned long	loginTime;		//When the last login went out
+		uint32_t	loginBackoff;
+		char	body[HTTP_BODY_SIZE];
+		int		bodyLength;
+		char	url[HTTP_URL_SIZE];
+		PondResponseBuffer	response;
+		PondHttpConnection	connection;
+		
+		DropletLog*		dropletLog;
+		bool			draining;
+		bool			drainInFlight;
+		unsigned long	drainStart;
+		unsigned long	recoveryTime;
+		
+		//Asynchronous mode variables
+		bool				async;
+		http_pending_struct	pending[HTTP_PIPELINE_DEPTH];
+		uint8_t				pendingHead;
+		uint8_t				pendingCount;
+		http_token			currentToken;
+		
+		//Asynchronous callback functions
+		http_login_ptr		_loggedIn;
+		http_request_ptr	_createDropletFn;
+		http_request_ptr	_responseFn;
+		http_value_ptr		_readValueFn;
+		http_done_fn		_doneFn;
+		void*				_doneContext;
+		
+		int		postDroplet(int stream_id, double data, uint32_t timestamp);
+		int		request(const char* method, bool hasBody, uint8_t callbackCode);
+		int		send(const char* method, bool hasBody, uint8_t callbackCode, bool cached = false);
+		int		setUrl(const char* path);
+		int		setUrl(const char* path, int32_t id);
+		int		formatDroplet(int stream_id, const char* value, uint32_t timestamp);
+		int		formatLogin(char* credentials);
+		bool	relogin();
+		void	retryLogin();
+		http_pending_struct*	lastPending();
+		void	complete(int code);
+		bool	keepDroplet(int code);
+		int		logDroplet(int code, int stream_id, double data);
+		void	settleLogged(int code, uint32_t first, uint16_t records);
+		
+		PondCache*		cache;
+		bool			cacheable(const char* method);
+		int				settleCache(const char* request, int code);
+		void			forgetStream(int stream_id);
+		
+		PondAggregator*	aggregators;
+		void	flushAggregator(PondAggregator* agg, uint32_t now);
+		
+#if POND_METRICS
+		PondMetrics		metrics;
+#endif
+		uint8_t	metricOp(uint8_t callbackCode);
+		void	measure(uint8_t op, int code, unsigned long start);
+		
+		//Bulk ingest functions
+		uint16_t	bulkIndex;
+		uint16_t	bulkLimit;
+		int			formatEntry(char* entry, const droplet_record* rec);
+		static bool	logSource(void* context, droplet_record* record);
 		
 	public:
 		HttpDatapond(const char* ip, int port);
 		
 		int 	login(const char* username, const char* password);
+		
+		//Session kept over deep sleep. A restored session is used until the server rejects it,
+		//then the credentials given here or to login() are used to log in again
+		void	setCredentials(const char* username, const char* password);
+		bool	exportSession(pond_session* session);
+		bool	restoreSession(const pond_session* session);
+		
 		void	collectCookie();
-		String	getPayload();
-		String	getCookie();
+		//getPayload() copies the body to the heap, the view and reading don't
+		String		getPayload();
+		pond_view	getPayloadView();
+		bool		getReading(pond_reading* reading);
+		const char*	getCookie();
 		int		getLastDroplet(int stream_id);
 		int 	getStatsToday(int stream_id);
-		int		getStatsFrom(String from, String towards, int stream_id);
+		int		getStatsFrom(const String& from, const String& towards, int stream_id);
 		int		createDroplet(int stream_id, double data);
-		int		createDroplet(int stream_id, String data);
+		int		createDroplet(int stream_id, const String& data);
+		int		createDroplet(int stream_id, const char* data);
 		int		getPond(int pond_id);
 		int		getPondCount();
 		int		getStream(int stream_id);
 		int		getStreamsInPond(int pond_id);
 		int		getStreamCountInPond(int pond_id);
 		
+		//GETs are answered from the cache while fresh, then revalidated with If-None-Match.
+		//Async reads always revalidate. A 304 comes back as 200 with the cached body
+		void		setCache(PondCache* responseCache);
+		
+		//Exact RAM used by the client and what's attached to it
+		uint32_t	memoryFootprint(pond_footprint* report = NULL);
+		
+		//The connection is kept alive between requests unless reuse is turned off
+		void		setReuse(bool reuse);
+		uint32_t	getConnects();
+		
+#if POND_METRICS
+		//Requests, failures, timeouts, bytes and latency per operation. sendMetrics() posts the summary as a droplet
+		PondMetrics*	getMetrics();
+		int				sendMetrics(int stream_id);
+#endif
+		
+		//In async mode requests return HTTP_QUEUED and complete through the handlers from run()
+		void		setAsync(bool enable);
+		void		run();
+		http_token	getLastToken();
+		uint8_t		getPending();
+		void	setLoginHandler(http_login_ptr handler);
+		void	setCreateDropletHandler(http_request_ptr handler);
+		void	setResponseHandler(http_request_ptr handler);
+		void	setReadValueHandler(http_value_ptr handler);
+		void	setCompletionHandler(http_done_fn handler, void* context);
+		
+		//Pipelined requests, written back to back and answered in order
+		bool	queueLastDroplet(int stream_id);
+		bool	queueDroplet(int stream_id, double data);
+		int		sendPipeline(http_response_ptr handler);
+		
+		//Any number of droplets in one request, streamed as they are read from source
+		int		ingest(droplet_source_ptr source, void* context, uint32_t* records = NULL);
+		
+		//Samples are summarised on the device, only the summaries go out as droplets.
+		//Windows that close between samples are sent from run()
+		void	addAggregator(PondAggregator* agg);
+		void	sample(PondAggregator* agg, double value);
+		
+		//Unsent droplets are kept in the log until drainLog() delivers them
+		void			setDropletLog(DropletLog* log);
+		int				drainLog(int maxRecords);
+		int				drainLogBulk(uint16_t maxRecords);
+		unsigned long	getRecoveryTime();
+		
 		//Currently Unsupported
 		int		getCountries();
-		int		getCountries(String query);
+		int		getCountries(const String& query);
 		int		getTimeZones(int countryCode);
 };
 